@@ -0,0 +1,113 @@
+#include "BenchmarkRunner.h"
+
+#include <chrono>
+
+namespace
+{
+	constexpr uint64_t MAX_ITERATIONS = 1ULL << 34;
+}
+
+BenchmarkRunner::BenchmarkRunner(double minSeconds, uint32_t repetitions, const std::string &filter)
+	: minSeconds(minSeconds), repetitions(repetitions > 0 ? repetitions : 1), filter(filter)
+{}
+
+bool BenchmarkRunner::isSelected(const std::string &name) const
+{
+	return (filter.empty() || name.find(filter) != std::string::npos);
+}
+
+void BenchmarkRunner::runMicro(const std::string &name, const Kernel &kernel)
+{
+	if (!isSelected(name))
+		return;
+
+	uint64_t iterations = 1;
+	double seconds = timeKernel(kernel, iterations, sink);
+	while (seconds < minSeconds && iterations < MAX_ITERATIONS)
+	{
+		// Aim a bit past minSeconds so the last calibration run usually counts.
+		double scale = seconds > 0 ? 1.2 * minSeconds / seconds : 10;
+		if (scale > 10)
+			scale = 10;
+		if (scale < 2)
+			scale = 2;
+		iterations = static_cast<uint64_t>(static_cast<double>(iterations) * scale);
+		seconds = timeKernel(kernel, iterations, sink);
+	}
+
+	double best = seconds;
+	for (uint32_t i = 1; i < repetitions; i++)
+	{
+		double current = timeKernel(kernel, iterations, sink);
+		if (current < best)
+			best = current;
+	}
+
+	Result result;
+	result.name = name;
+	result.kind = "micro";
+	result.values.emplace_back("iterations", static_cast<double>(iterations));
+	result.values.emplace_back("ns_per_op", best * 1e9 / static_cast<double>(iterations));
+	result.values.emplace_back("ops_per_second", static_cast<double>(iterations) / best);
+	addResult(result);
+}
+
+void BenchmarkRunner::addResult(const Result &result)
+{
+	printf("%-40s", result.name.c_str());
+	for (const std::pair<std::string, double> &value : result.values)
+		printf(" %s=%.4g", value.first.c_str(), value.second);
+	printf("\n");
+	fflush(stdout);
+	results.push_back(result);
+}
+
+void BenchmarkRunner::writeJson(FILE *file, const std::vector<std::pair<std::string, std::string>> &context) const
+{
+	fprintf(file, "{\n  \"context\": {");
+	for (size_t i = 0; i < context.size(); i++)
+	{
+		fprintf(file, "%s\n    ", i > 0 ? "," : "");
+		writeString(file, context[i].first);
+		fprintf(file, ": ");
+		writeString(file, context[i].second);
+	}
+	fprintf(file, "\n  },\n  \"benchmarks\": [");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		fprintf(file, "%s\n    {\"name\": ", i > 0 ? "," : "");
+		writeString(file, results[i].name);
+		fprintf(file, ", \"kind\": ");
+		writeString(file, results[i].kind);
+		for (const std::pair<std::string, double> &value : results[i].values)
+		{
+			fprintf(file, ", ");
+			writeString(file, value.first);
+			fprintf(file, ": %.17g", value.second);
+		}
+		fprintf(file, "}");
+	}
+	fprintf(file, "\n  ]\n}\n");
+}
+
+double BenchmarkRunner::timeKernel(const Kernel &kernel, uint64_t iterations, double &sink)
+{
+	auto start = std::chrono::steady_clock::now();
+	sink += kernel(iterations);
+	return (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+void BenchmarkRunner::writeString(FILE *file, const std::string &str)
+{
+	fputc('"', file);
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			fprintf(file, "\\%c", c);
+		else if (static_cast<unsigned char>(c) < 0x20)
+			fprintf(file, "\\u%04x", c);
+		else
+			fputc(c, file);
+	}
+	fputc('"', file);
+}
\ No newline at end of file
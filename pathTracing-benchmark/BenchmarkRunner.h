@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal benchmark harness. Microbenchmarks are calibrated until one run
+// lasts at least minSeconds, then repeated and the fastest run is kept.
+// Every result is a flat list of named numbers so the JSON output stays
+// easy to diff between builds.
+class BenchmarkRunner
+{
+public:
+	struct Result
+	{
+		std::string name;
+		std::string kind;
+		std::vector<std::pair<std::string, double>> values;
+	};
+
+	// Runs the measured operation `iterations` times and returns a value
+	// derived from its results, so the compiler can not drop the work.
+	typedef std::function<double(uint64_t iterations)> Kernel;
+
+	BenchmarkRunner(double minSeconds, uint32_t repetitions, const std::string &filter);
+
+	bool isSelected(const std::string &name) const;
+
+	void runMicro(const std::string &name, const Kernel &kernel);
+	void addResult(const Result &result);
+
+	const std::vector<Result> &getResults() const { return (results); }
+
+	// context is written as-is in the "context" object.
+	void writeJson(FILE *file, const std::vector<std::pair<std::string, std::string>> &context) const;
+
+private:
+	double minSeconds;
+	uint32_t repetitions;
+	std::string filter;
+
+	std::vector<Result> results;
+	double sink = 0;
+
+	static double timeKernel(const Kernel &kernel, uint64_t iterations, double &sink);
+	static void writeString(FILE *file, const std::string &str);
+};
\ No newline at end of file
@@ -0,0 +1,684 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BenchmarkRunner.h"
+#include "BVH.h"
+#include "Camera.h"
+#include "ctmRand.h"
+#include "Denoiser.h"
+#include "HitableCollection.h"
+#include "HitRecord.h"
+#include "Instance.h"
+#include "Material.h"
+#include "MaterialTable.h"
+#include "PackedSpheres.h"
+#include "PathTracing.h"
+#include "Pcg32.h"
+#include "RayPacket.h"
+#include "RenderStats.h"
+#include "Sampler.h"
+#include "Scenes.h"
+#include "Sphere.h"
+#include "ThreadPool.h"
+#include "TileScheduler.h"
+#include "TriangleMesh.h"
+
+namespace
+{
+	constexpr uint64_t SCENE_SEED = 0x5eed;
+	constexpr uint32_t NBR_INPUTS = 1024; // power of two
+	constexpr uint32_t NBR_PACKETS = 256; // power of two
+	constexpr uint32_t SAMPLER_SPP = 64;
+	constexpr uint32_t DENOISE_SIZE = 128;
+	constexpr uint32_t WAIT_INTERVAL_MS = 1000;
+	constexpr uint32_t TILE_SIZE = 16;
+	constexpr uint32_t PROBE_MESH_RINGS = 256; // 256 * 512 * 2 triangles
+	constexpr uint32_t PROBE_MESH_SEGMENTS = 512;
+	// Noise level the render benchmarks extrapolate their time to, assuming
+	// the squared error falls as 1 / spp.
+	constexpr double TARGET_RMSE = 0.01;
+
+	struct Options
+	{
+		std::string output = "benchmark.json";
+		std::string filter;
+		double minSeconds = 0.25;
+		uint32_t repetitions = 3;
+		uint32_t width = 320;
+		uint32_t height = 200;
+		uint32_t nbSamples = 8;
+		uint32_t referenceSamples = 256;
+		std::vector<uint32_t> threadCounts;
+	};
+
+	// One configuration of the end-to-end render, the defaults are those of
+	// the viewer.
+	struct RenderSettings
+	{
+		uint32_t nbSamples = 0;
+		TileScheduler::Order tileOrder = TileScheduler::Order::HILBERT;
+		PathTracing::IntegratorMode integratorMode = PathTracing::IntegratorMode::PER_PATH;
+		bool isRouletteEnabled = true;
+		Sampler::Type samplerType = Sampler::Type::SOBOL;
+	};
+
+	struct RenderOutput
+	{
+		double seconds = 0;
+		RenderStats stats;
+		std::vector<glm::vec3> picture;
+	};
+
+	struct SceneInputs
+	{
+		std::vector<glm::vec2> uv;
+		std::vector<Ray> cameraRays;
+		// Camera rays that hit the probe sphere, with their hit record.
+		std::vector<Ray> hitRays;
+		std::vector<HitRecord> hitRecords;
+		// Camera rays of random squares of pixels at the render resolution.
+		std::vector<RayPacket> packets;
+	};
+
+	void printUsage(const char *program)
+	{
+		printf("Usage: %s [options]\n", program);
+		printf("  -o, --output <path>       JSON report (default benchmark.json)\n");
+		printf("      --filter <text>       only run benchmarks whose name contains text\n");
+		printf("      --min-time <seconds>  minimum duration of one microbenchmark run (default 0.25)\n");
+		printf("      --repetitions <n>     runs per benchmark, the fastest is kept (default 3)\n");
+		printf("  -w, --width <n>           render width (default 320)\n");
+		printf("  -h, --height <n>          render height (default 200)\n");
+		printf("  -s, --spp <n>             render samples per pixel (default 8)\n");
+		printf("      --reference-spp <n>   samples per pixel of the reference the render error is measured\n");
+		printf("                            against (default 256)\n");
+		printf("  -t, --threads <list>      comma separated render thread counts\n");
+		printf("                            (default powers of two up to every hardware thread)\n");
+	}
+
+	uint32_t parseUInt(const char *option, const char *value)
+	{
+		char *end = nullptr;
+		unsigned long result = strtoul(value, &end, 10);
+		if (end == value || *end != '\0' || value[0] == '-' || result == 0 || result > UINT32_MAX)
+			throw std::invalid_argument(std::string("Invalid value for ") + option + ": " + value);
+		return (static_cast<uint32_t>(result));
+	}
+
+	std::vector<uint32_t> parseThreadCounts(const char *option, const char *value)
+	{
+		std::vector<uint32_t> counts;
+		std::string list(value);
+		size_t begin = 0;
+		while (begin <= list.size())
+		{
+			size_t end = list.find(',', begin);
+			if (end == std::string::npos)
+				end = list.size();
+			counts.push_back(parseUInt(option, list.substr(begin, end - begin).c_str()));
+			begin = end + 1;
+		}
+		return (counts);
+	}
+
+	// Returns false when only the usage was requested.
+	bool parseOptions(int ac, char **av, Options &options)
+	{
+		for (int i = 1; i < ac; i++)
+		{
+			const char *arg = av[i];
+			if (strcmp(arg, "--help") == 0)
+				return (false);
+
+			auto nextValue = [&]()
+			{
+				if (i + 1 >= ac)
+					throw std::invalid_argument(std::string("Missing value for ") + arg);
+				return (av[++i]);
+			};
+			if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0)
+				options.output = nextValue();
+			else if (strcmp(arg, "--filter") == 0)
+				options.filter = nextValue();
+			else if (strcmp(arg, "--min-time") == 0)
+			{
+				const char *value = nextValue();
+				options.minSeconds = atof(value);
+				if (options.minSeconds <= 0)
+					throw std::invalid_argument(std::string("Invalid value for ") + arg + ": " + value);
+			}
+			else if (strcmp(arg, "--repetitions") == 0)
+				options.repetitions = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "-w") == 0 || strcmp(arg, "--width") == 0)
+				options.width = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--height") == 0)
+				options.height = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "-s") == 0 || strcmp(arg, "--spp") == 0)
+				options.nbSamples = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "--reference-spp") == 0)
+				options.referenceSamples = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "-t") == 0 || strcmp(arg, "--threads") == 0)
+				options.threadCounts = parseThreadCounts(arg, nextValue());
+			else
+				throw std::invalid_argument(std::string("Unknown option: ") + arg);
+		}
+
+		if (options.threadCounts.empty())
+		{
+			uint32_t hardware = std::thread::hardware_concurrency();
+			if (hardware == 0)
+				hardware = 1;
+			for (uint32_t count = 1; count < hardware; count *= 2)
+				options.threadCounts.push_back(count);
+			options.threadCounts.push_back(hardware);
+		}
+		return (true);
+	}
+
+	SceneDescription createRandomScene()
+	{
+		SceneDescription scene;
+		ctmSeed(SCENE_SEED);
+		Scenes::create("random", scene);
+		return (scene);
+	}
+
+	Camera createCamera(const SceneDescription &scene, const Options &options)
+	{
+		return (Camera(scene.lookFrom, scene.lookAt, scene.up, scene.vfov,
+			static_cast<float>(options.width) / options.height, scene.aperture, scene.focusDist));
+	}
+
+	void prepareInputs(SceneInputs &inputs, const Camera &cam, const Sphere &probe)
+	{
+		Pcg32 rng(SCENE_SEED, 1);
+		while (inputs.uv.size() < NBR_INPUTS)
+		{
+			glm::vec2 uv(rng.nextFloat(), rng.nextFloat());
+			Ray ray = cam.getRay(uv.x, uv.y, glm::vec2(rng.nextFloat(), rng.nextFloat()));
+			inputs.uv.push_back(uv);
+			inputs.cameraRays.push_back(ray);
+		}
+
+		// Aim at the probe so every scatter input is a real hit.
+		while (inputs.hitRays.size() < NBR_INPUTS)
+		{
+			glm::vec3 target = probe.getCenter() + probe.getRadius() * 0.99f
+				* (2.0f * glm::vec3(rng.nextFloat(), rng.nextFloat(), rng.nextFloat()) - glm::vec3(1, 1, 1));
+			glm::vec3 origin = probe.getCenter() + glm::vec3(0, 0, 5 * probe.getRadius());
+			Ray ray(origin, target - origin);
+			HitRecord record;
+			if (probe.hit(ray, 0.001f, 100.0f, record))
+			{
+				inputs.hitRays.push_back(ray);
+				inputs.hitRecords.push_back(record);
+			}
+		}
+	}
+
+	void preparePackets(SceneInputs &inputs, const Camera &cam, const Options &options)
+	{
+		Pcg32 rng(SCENE_SEED, 5);
+		uint32_t nbX = options.width > RayPacket::WIDTH ? options.width - RayPacket::WIDTH + 1 : 1;
+		uint32_t nbY = options.height > RayPacket::WIDTH ? options.height - RayPacket::WIDTH + 1 : 1;
+		inputs.packets.resize(NBR_PACKETS);
+		for (RayPacket &packet : inputs.packets)
+		{
+			uint32_t x0 = rng.nextUInt() % nbX;
+			uint32_t y0 = rng.nextUInt() % nbY;
+			packet.clear();
+			for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+			{
+				float u = (x0 + lane % RayPacket::WIDTH + rng.nextFloat()) / options.width;
+				float v = (y0 + lane / RayPacket::WIDTH + rng.nextFloat()) / options.height;
+				packet.set(lane, cam.getRay(u, v, glm::vec2(rng.nextFloat(), rng.nextFloat())));
+			}
+			packet.prepare();
+		}
+	}
+
+	double runScatter(const Material &material, const SceneInputs &inputs, uint64_t iterations)
+	{
+		Pcg32 rng(SCENE_SEED, 2);
+		double sum = 0;
+		for (uint64_t i = 0; i < iterations; i++)
+		{
+			uint32_t index = static_cast<uint32_t>(i) & (NBR_INPUTS - 1);
+			const HitRecord &record = inputs.hitRecords[index];
+			Ray scattered;
+			glm::vec3 attenuation;
+			glm::vec3 u(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+			if (material.scatter(inputs.hitRays[index], record, u, attenuation, scattered))
+				sum += scattered.getDirection().x;
+		}
+		return (sum);
+	}
+
+	double runHit(const IHitable &hitable, const std::vector<Ray> &rays, uint64_t iterations)
+	{
+		double sum = 0;
+		for (uint64_t i = 0; i < iterations; i++)
+		{
+			HitRecord record;
+			if (hitable.hit(rays[static_cast<uint32_t>(i) & (NBR_INPUTS - 1)], 0.001f, 100.0f, record))
+				sum += record.t;
+		}
+		return (sum);
+	}
+
+	// Latitude and longitude tessellation of the probe sphere.
+	void tessellateProbe(TriangleMesh &mesh, const Sphere &probe, uint32_t rings, uint32_t segments)
+	{
+		std::vector<glm::vec3> vertices;
+		std::vector<uint32_t> indices;
+		for (uint32_t ring = 0; ring <= rings; ring++)
+		{
+			float theta = glm::pi<float>() * ring / rings;
+			for (uint32_t segment = 0; segment < segments; segment++)
+			{
+				float phi = 2 * glm::pi<float>() * segment / segments;
+				glm::vec3 direction(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+				vertices.push_back(probe.getCenter() + probe.getRadius() * direction);
+			}
+		}
+		for (uint32_t ring = 0; ring < rings; ring++)
+		{
+			for (uint32_t segment = 0; segment < segments; segment++)
+			{
+				uint32_t a = ring * segments + segment;
+				uint32_t b = ring * segments + (segment + 1) % segments;
+				uint32_t c = a + segments;
+				uint32_t d = b + segments;
+				indices.insert(indices.end(), { a, b, c, b, d, c });
+			}
+		}
+		mesh.setGeometry(std::move(vertices), std::move(indices));
+	}
+
+	void runMicrobenchmarks(BenchmarkRunner &runner, const SceneInputs &inputs, const Camera &cam,
+		const Sphere &probe, const HitableCollection &collection, const BVH &bvh)
+	{
+		runner.runMicro("ctmRand", [](uint64_t iterations)
+		{
+			double sum = 0;
+			for (uint64_t i = 0; i < iterations; i++)
+				sum += ctmRand();
+			return (sum);
+		});
+
+		runner.runMicro("Pcg32::nextFloat", [](uint64_t iterations)
+		{
+			Pcg32 rng(SCENE_SEED, 3);
+			double sum = 0;
+			for (uint64_t i = 0; i < iterations; i++)
+				sum += rng.nextFloat();
+			return (sum);
+		});
+
+		runner.runMicro("Camera::getRay", [&](uint64_t iterations)
+		{
+			Pcg32 rng(SCENE_SEED, 4);
+			double sum = 0;
+			for (uint64_t i = 0; i < iterations; i++)
+			{
+				const glm::vec2 &uv = inputs.uv[static_cast<uint32_t>(i) & (NBR_INPUTS - 1)];
+				sum += cam.getRay(uv.x, uv.y, glm::vec2(rng.nextFloat(), rng.nextFloat())).getDirection().x;
+			}
+			return (sum);
+		});
+
+		// One operation starts a sample and reads the 3 scatter dimensions
+		// of one of its first bounces.
+		for (uint32_t i = 0; i < static_cast<uint32_t>(Sampler::Type::COUNT); i++)
+		{
+			Sampler sampler(static_cast<Sampler::Type>(i), SAMPLER_SPP);
+			sampler.startSample(0, 0, 0);
+			sampler.get1D(Sampler::PIXEL); // builds the blue noise mask outside of the timing
+			runner.runMicro(std::string("Sampler::get3D/") + Sampler::getTypeName(sampler.getType()), [&](uint64_t iterations)
+			{
+				double sum = 0;
+				for (uint64_t j = 0; j < iterations; j++)
+				{
+					uint32_t index = static_cast<uint32_t>(j);
+					sampler.startSample(index & 63, (index >> 6) & 63, (index >> 12) % SAMPLER_SPP);
+					sampler.startBounce(index & 3);
+					sum += sampler.get3D(Sampler::SCATTER).x;
+				}
+				return (sum);
+			});
+		}
+
+		runner.runMicro("Sphere::hit", [&](uint64_t iterations)
+		{
+			return (runHit(probe, inputs.cameraRays, iterations));
+		});
+		runner.runMicro("HitableCollection::hit/random", [&](uint64_t iterations)
+		{
+			return (runHit(collection, inputs.cameraRays, iterations));
+		});
+		runner.runMicro("BVH::hit/random", [&](uint64_t iterations)
+		{
+			return (runHit(bvh, inputs.cameraRays, iterations));
+		});
+		// One operation is a whole packet in both, traced ray by ray then
+		// together.
+		runner.runMicro("BVH::hit/packet", [&](uint64_t iterations)
+		{
+			double sum = 0;
+			for (uint64_t i = 0; i < iterations; i++)
+			{
+				const RayPacket &packet = inputs.packets[static_cast<uint32_t>(i) & (NBR_PACKETS - 1)];
+				for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+				{
+					HitRecord record;
+					if (bvh.hit(packet.rays[lane], 0.001f, 100.0f, record))
+						sum += record.t;
+				}
+			}
+			return (sum);
+		});
+		runner.runMicro("BVH::hitPacket/packet", [&](uint64_t iterations)
+		{
+			double sum = 0;
+			HitRecord records[RayPacket::SIZE];
+			for (uint64_t i = 0; i < iterations; i++)
+			{
+				const RayPacket &packet = inputs.packets[static_cast<uint32_t>(i) & (NBR_PACKETS - 1)];
+				uint32_t hitMask = bvh.hitPacket(packet, 0.001f, 100.0f, records);
+				for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+				{
+					if (hitMask & (1u << lane))
+						sum += records[lane].t;
+				}
+			}
+			return (sum);
+		});
+
+		std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>(probe.getMaterialId());
+		tessellateProbe(*mesh, probe, PROBE_MESH_RINGS, PROBE_MESH_SEGMENTS);
+		runner.runMicro("TriangleMesh::hit/probe", [&](uint64_t iterations)
+		{
+			return (runHit(*mesh, inputs.hitRays, iterations));
+		});
+		// Same rays through an identity transform, the difference is the cost
+		// of entering an instance.
+		Instance instance(mesh, glm::mat3(1.0f), glm::vec3(0, 0, 0));
+		runner.runMicro("Instance::hit/probe", [&](uint64_t iterations)
+		{
+			return (runHit(instance, inputs.hitRays, iterations));
+		});
+		mesh->setSimdLevel(PackedSpheres::SimdLevel::SCALAR);
+		runner.runMicro("TriangleMesh::hit/probe/scalar", [&](uint64_t iterations)
+		{
+			return (runHit(*mesh, inputs.hitRays, iterations));
+		});
+
+		Material lambert = Material::lambert(glm::vec3(0.5f, 0.5f, 0.5f));
+		Material metal = Material::metal(glm::vec3(0.7f, 0.6f, 0.5f), 0.3f);
+		Material dialectric = Material::dialectric(1.5f);
+		runner.runMicro("Lambert::scatter", [&](uint64_t iterations)
+		{
+			return (runScatter(lambert, inputs, iterations));
+		});
+		runner.runMicro("Metal::scatter", [&](uint64_t iterations)
+		{
+			return (runScatter(metal, inputs, iterations));
+		});
+		runner.runMicro("Dialectric::scatter", [&](uint64_t iterations)
+		{
+			return (runScatter(dialectric, inputs, iterations));
+		});
+
+		// One operation denoises a noisy DENOISE_SIZE square split between
+		// two planes at different depths, on a single thread.
+		uint32_t nbPixels = DENOISE_SIZE * DENOISE_SIZE;
+		std::vector<glm::vec3> picture(nbPixels);
+		std::vector<glm::vec3> normals(nbPixels);
+		std::vector<glm::vec3> albedos(nbPixels);
+		std::vector<float> depths(nbPixels);
+		std::vector<float> variances(nbPixels);
+		Pcg32 rng(SCENE_SEED, 5);
+		for (uint32_t i = 0; i < nbPixels; i++)
+		{
+			bool isLeft = i % DENOISE_SIZE < DENOISE_SIZE / 2;
+			normals[i] = isLeft ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+			albedos[i] = isLeft ? glm::vec3(0.8f, 0.3f, 0.3f) : glm::vec3(0.5f, 0.5f, 0.5f);
+			depths[i] = isLeft ? 2.0f : 5.0f;
+			picture[i] = albedos[i] * (rng.nextFloat() * 2);
+			variances[i] = 0.01f;
+		}
+		PathTracing::Guides guides = { normals.data(), albedos.data(), depths.data(), variances.data() };
+		ThreadPool denoisePool(1);
+		Denoiser denoiser(denoisePool);
+		runner.runMicro("Denoiser::denoise", [&](uint64_t iterations)
+		{
+			double sum = 0;
+			for (uint64_t i = 0; i < iterations; i++)
+				sum += denoiser.denoise(picture.data(), guides, DENOISE_SIZE, DENOISE_SIZE)[i % nbPixels].x;
+			return (sum);
+		});
+	}
+
+	RenderOutput render(const IHitable &world, const SceneDescription &scene, const Camera &cam, ThreadPool &pool,
+		const Options &options, const RenderSettings &settings)
+	{
+		PathTracing pathTracing(options.width, options.height, settings.nbSamples, world, scene.materials, scene.lights, cam, pool);
+		pathTracing.setSky(scene.skyHorizon, scene.skyZenith);
+		pathTracing.setTileScheduling(settings.tileOrder, TILE_SIZE);
+		pathTracing.setIntegratorMode(settings.integratorMode);
+		pathTracing.setRussianRoulette(settings.isRouletteEnabled);
+		pathTracing.setSampler(settings.samplerType);
+		auto start = std::chrono::steady_clock::now();
+		pathTracing.startRendering();
+		while (pathTracing.isRendering())
+			pathTracing.waitForResult(WAIT_INTERVAL_MS);
+
+		RenderOutput output;
+		output.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		output.stats = pathTracing.getStats();
+		const glm::vec3 *picture = pathTracing.getPic();
+		output.picture.assign(picture, picture + options.width * options.height);
+		return (output);
+	}
+
+	double computeRmse(const std::vector<glm::vec3> &picture, const std::vector<glm::vec3> &reference)
+	{
+		double sum = 0;
+		for (size_t i = 0; i < picture.size(); i++)
+		{
+			glm::vec3 error = picture[i] - reference[i];
+			sum += glm::dot(error, error);
+		}
+		return (sqrt(sum / (3 * picture.size())));
+	}
+
+	// Fastest of the repetitions. The error is against a reference rendered
+	// with the random sampler and without roulette, so it shares no sample
+	// with the Sobol renders and carries no roulette noise.
+	void runRender(BenchmarkRunner &runner, const std::string &name, const IHitable &world, const SceneDescription &scene,
+		const Camera &cam, uint32_t threadCount, const Options &options, const RenderSettings &settings,
+		std::vector<glm::vec3> &reference)
+	{
+		if (!runner.isSelected(name))
+			return;
+
+		ThreadPool pool(threadCount);
+		if (reference.empty())
+		{
+			RenderSettings referenceSettings;
+			referenceSettings.nbSamples = options.referenceSamples;
+			referenceSettings.isRouletteEnabled = false;
+			referenceSettings.samplerType = Sampler::Type::RANDOM;
+			printf("Rendering the %u spp reference...\n", options.referenceSamples);
+			fflush(stdout);
+			reference = render(world, scene, cam, pool, options, referenceSettings).picture;
+		}
+
+		RenderOutput output;
+		double best = 0;
+		for (uint32_t i = 0; i < options.repetitions; i++)
+		{
+			output = render(world, scene, cam, pool, options, settings);
+			if (i == 0 || output.seconds < best)
+				best = output.seconds;
+		}
+
+		double nbPaths = static_cast<double>(options.width) * options.height * settings.nbSamples;
+		double nbRays = static_cast<double>(output.stats.getRayCount());
+		double rmse = computeRmse(output.picture, reference);
+		BenchmarkRunner::Result result;
+		result.name = name;
+		result.kind = "render";
+		result.values.emplace_back("threads", threadCount);
+		result.values.emplace_back("width", options.width);
+		result.values.emplace_back("height", options.height);
+		result.values.emplace_back("spp", settings.nbSamples);
+		result.values.emplace_back("seconds", best);
+		result.values.emplace_back("rays", nbRays);
+		result.values.emplace_back("rays_per_second", nbRays / best);
+		result.values.emplace_back("paths_per_second", nbPaths / best);
+		result.values.emplace_back("rmse", rmse);
+		result.values.emplace_back("seconds_to_target_rmse", best * rmse * rmse / (TARGET_RMSE * TARGET_RMSE));
+		result.values.emplace_back("rays_to_target_rmse", nbRays * rmse * rmse / (TARGET_RMSE * TARGET_RMSE));
+		runner.addResult(result);
+	}
+
+	// Scaling over the thread counts with the default settings, then one
+	// setting changed at a time on the most threads: tile order, integrator
+	// and roulette.
+	void runRenderBenchmarks(BenchmarkRunner &runner, const BVH &bvh, const SceneDescription &scene, const Camera &cam,
+		const Options &options)
+	{
+		std::vector<glm::vec3> reference;
+		RenderSettings defaults;
+		defaults.nbSamples = options.nbSamples;
+		for (uint32_t threadCount : options.threadCounts)
+		{
+			std::string name = "render/random/threads:" + std::to_string(threadCount);
+			runRender(runner, name, bvh, scene, cam, threadCount, options, defaults, reference);
+		}
+
+		uint32_t threadCount = *std::max_element(options.threadCounts.begin(), options.threadCounts.end());
+		for (TileScheduler::Order order : { TileScheduler::Order::SCANLINE, TileScheduler::Order::MORTON, TileScheduler::Order::HILBERT })
+		{
+			RenderSettings settings = defaults;
+			settings.tileOrder = order;
+			std::string name = std::string("render/random/order:") + TileScheduler::getOrderName(order);
+			runRender(runner, name, bvh, scene, cam, threadCount, options, settings, reference);
+		}
+		for (PathTracing::IntegratorMode mode : { PathTracing::IntegratorMode::PER_PATH, PathTracing::IntegratorMode::WAVEFRONT })
+		{
+			RenderSettings settings = defaults;
+			settings.integratorMode = mode;
+			std::string name = std::string("render/random/integrator:") + (mode == PathTracing::IntegratorMode::WAVEFRONT ? "wavefront" : "path");
+			runRender(runner, name, bvh, scene, cam, threadCount, options, settings, reference);
+		}
+		for (bool isRouletteEnabled : { true, false })
+		{
+			RenderSettings settings = defaults;
+			settings.isRouletteEnabled = isRouletteEnabled;
+			std::string name = std::string("render/random/roulette:") + (isRouletteEnabled ? "on" : "off");
+			runRender(runner, name, bvh, scene, cam, threadCount, options, settings, reference);
+		}
+	}
+
+	std::vector<std::pair<std::string, std::string>> getContext(const Options &options)
+	{
+		char date[32];
+		time_t now = time(nullptr);
+		strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+		std::vector<std::pair<std::string, std::string>> context;
+		context.emplace_back("date", date);
+#if defined(_MSC_VER)
+		context.emplace_back("compiler", "msvc " + std::to_string(_MSC_VER));
+#elif defined(__VERSION__)
+		context.emplace_back("compiler", __VERSION__);
+#endif
+#ifdef _DEBUG
+		context.emplace_back("build", "debug");
+#else
+		context.emplace_back("build", "release");
+#endif
+		context.emplace_back("hardware_threads", std::to_string(std::thread::hardware_concurrency()));
+		context.emplace_back("simd", PackedSpheres::getSimdLevelName(PackedSpheres::getSupportedSimdLevel()));
+		context.emplace_back("scene_seed", std::to_string(SCENE_SEED));
+		context.emplace_back("min_time", std::to_string(options.minSeconds));
+		context.emplace_back("repetitions", std::to_string(options.repetitions));
+		return (context);
+	}
+}
+
+// Microbenchmarks of the hot functions and end-to-end renders of the random
+// scene, reported on stdout and as JSON.
+int main(int ac, char **av)
+{
+	Options options;
+	try
+	{
+		if (!parseOptions(ac, av, options))
+		{
+			printUsage(av[0]);
+			return (0);
+		}
+	}
+	catch (std::invalid_argument &e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		printUsage(av[0]);
+		return (1);
+	}
+
+	try
+	{
+		// Both containers get their own copy of the same scene, whose
+		// material ids are the same in both.
+		SceneDescription collectionScene = createRandomScene();
+		HitableCollection collection;
+		collection.build(collectionScene.hitables);
+		SceneDescription scene = createRandomScene();
+		BVH bvh;
+		bvh.build(scene.hitables, scene.arena);
+
+		Camera cam = createCamera(scene, options);
+		uint32_t probeMaterial = scene.materials.add(Material::lambert(glm::vec3(0.5f, 0.5f, 0.5f)));
+		Sphere probe(glm::vec3(0, 1, 0), 1, probeMaterial);
+
+		SceneInputs inputs;
+		prepareInputs(inputs, cam, probe);
+		preparePackets(inputs, cam, options);
+
+		BenchmarkRunner runner(options.minSeconds, options.repetitions, options.filter);
+		runMicrobenchmarks(runner, inputs, cam, probe, collection, bvh);
+		runRenderBenchmarks(runner, bvh, scene, cam, options);
+
+		FILE *file = fopen(options.output.c_str(), "w");
+		if (!file)
+			throw std::runtime_error("Unable to open " + options.output + " for writing.");
+		runner.writeJson(file, getContext(options));
+		if (fclose(file) != 0)
+			throw std::runtime_error("Failed to write " + options.output + ".");
+		printf("Wrote %s\n", options.output.c_str());
+	}
+	catch (std::exception &e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return (1);
+	}
+	return (0);
+}
\ No newline at end of file
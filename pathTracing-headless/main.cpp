@@ -0,0 +1,400 @@
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "BVH.h"
+#include "Camera.h"
+#include "Denoiser.h"
+#include "ImageWriter.h"
+#include "PathTracing.h"
+#include "RenderStats.h"
+#include "Scenes.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	constexpr uint32_t LIVE_STATS_INTERVAL_MS = 1000;
+
+	struct Options
+	{
+		uint32_t width = 1080;
+		uint32_t height = 720;
+		uint32_t nbSamples = 8;
+		uint32_t nbThreads = 0;
+		bool pinThreads = false;
+		std::string scene = "random";
+		std::string output = "output.pfm";
+		uint32_t tileSize = 16;
+		TileScheduler::Order tileOrder = TileScheduler::Order::HILBERT;
+		PathTracing::IntegratorMode integratorMode = PathTracing::IntegratorMode::PER_PATH;
+		bool isRouletteEnabled = true;
+		uint32_t rouletteDepth = PathTracing::DEFAULT_ROULETTE_DEPTH;
+		bool arePacketsEnabled = true;
+		bool isLightSamplingEnabled = true;
+		Sampler::Type samplerType = Sampler::Type::SOBOL;
+		bool isAdaptive = false;
+		float noiseThreshold = 0.02f;
+		bool isDenoising = false;
+		uint32_t aovMask = 0;
+	};
+
+	void printUsage(const char *program)
+	{
+		printf("Usage: %s [options]\n", program);
+		printf("  -w, --width <n>          image width (default 1080)\n");
+		printf("  -h, --height <n>         image height (default 720)\n");
+		printf("  -s, --spp <n>            samples per pixel (default 8)\n");
+		printf("  -t, --threads <n>        worker threads, 0 uses every hardware thread (default 0)\n");
+		printf("      --pin                pin each worker to a core\n");
+		printf("      --scene <name>       built-in scene:");
+		for (const std::string &name : Scenes::getNames())
+			printf(" %s", name.c_str());
+		printf(" (default random)\n");
+		printf("                           or a .scene file, compiled to a .scene.cache next to it\n");
+		printf("  -o, --output <path>      .ppm, .pfm or .exr file (default output.pfm)\n");
+		printf("      --tile-size <n>      tile side in pixels (default 16), scanline runs are 512 pixels\n");
+		printf("      --tile-order <order> scanline, morton or hilbert (default hilbert)\n");
+		printf("      --integrator <mode>  path or wavefront (default path)\n");
+		printf("      --no-roulette        disable Russian roulette\n");
+		printf("      --roulette-depth <n> bounces before the roulette starts (default %u)\n", PathTracing::DEFAULT_ROULETTE_DEPTH);
+		printf("      --no-packets         trace camera rays one by one instead of in packets\n");
+		printf("      --no-light-sampling  only reach emissive spheres through scattered rays\n");
+		printf("      --sampler <type>     random, stratified, sobol, halton or bluenoise (default sobol)\n");
+		printf("      --adaptive <error>   adaptive sampling, stops pixels below this relative error\n");
+		printf("      --denoise            write the picture filtered by the edge-aware denoiser\n");
+		printf("      --aov <list>         comma separated AOVs written next to the output, or all:");
+		for (uint32_t i = 0; i < static_cast<uint32_t>(PathTracing::Aov::COUNT); i++)
+			printf(" %s", PathTracing::getAovName(static_cast<PathTracing::Aov>(i)));
+		printf("\n");
+	}
+
+	uint32_t parseUInt(const char *option, const char *value)
+	{
+		char *end = nullptr;
+		unsigned long result = strtoul(value, &end, 10);
+		if (end == value || *end != '\0' || value[0] == '-' || result > UINT32_MAX)
+			throw std::invalid_argument(std::string("Invalid value for ") + option + ": " + value);
+		return (static_cast<uint32_t>(result));
+	}
+
+	TileScheduler::Order parseTileOrder(const char *value)
+	{
+		for (TileScheduler::Order order : { TileScheduler::Order::SCANLINE, TileScheduler::Order::MORTON, TileScheduler::Order::HILBERT })
+		{
+			if (strcmp(value, TileScheduler::getOrderName(order)) == 0)
+				return (order);
+		}
+		throw std::invalid_argument(std::string("Unknown tile order: ") + value);
+	}
+
+	PathTracing::IntegratorMode parseIntegratorMode(const char *value)
+	{
+		if (strcmp(value, "path") == 0)
+			return (PathTracing::IntegratorMode::PER_PATH);
+		if (strcmp(value, "wavefront") == 0)
+			return (PathTracing::IntegratorMode::WAVEFRONT);
+		throw std::invalid_argument(std::string("Unknown integrator: ") + value);
+	}
+
+	Sampler::Type parseSamplerType(const char *value)
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(Sampler::Type::COUNT); i++)
+		{
+			Sampler::Type type = static_cast<Sampler::Type>(i);
+			if (strcmp(value, Sampler::getTypeName(type)) == 0)
+				return (type);
+		}
+		throw std::invalid_argument(std::string("Unknown sampler: ") + value);
+	}
+
+	PathTracing::Aov parseAov(const std::string &name)
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(PathTracing::Aov::COUNT); i++)
+		{
+			PathTracing::Aov aov = static_cast<PathTracing::Aov>(i);
+			if (name == PathTracing::getAovName(aov))
+				return (aov);
+		}
+		throw std::invalid_argument("Unknown AOV: " + name);
+	}
+
+	uint32_t parseAovs(const char *value)
+	{
+		std::string list(value);
+		uint32_t mask = 0;
+		size_t begin = 0;
+		while (begin <= list.size())
+		{
+			size_t end = list.find(',', begin);
+			if (end == std::string::npos)
+				end = list.size();
+			std::string name = list.substr(begin, end - begin);
+			if (name == "all")
+				mask |= PathTracing::getAovBit(PathTracing::Aov::COUNT) - 1;
+			else
+				mask |= PathTracing::getAovBit(parseAov(name));
+			begin = end + 1;
+		}
+		return (mask);
+	}
+
+	// output.pfm gives output.depth.pfm for the depth.
+	std::string getAovPath(const std::string &output, PathTracing::Aov aov)
+	{
+		size_t dot = output.rfind('.');
+		return (output.substr(0, dot) + "." + PathTracing::getAovName(aov) + output.substr(dot));
+	}
+
+	// Every AOV is written as a color image, the depth and the ids in the
+	// three channels and a miss as -1 for the ids. PFM and EXR keep the
+	// exact values.
+	void writeAovs(const PathTracing &pathTracing, uint32_t mask, const std::string &output, ImageWriter::Format format)
+	{
+		PathTracing::Aovs aovs;
+		if (!pathTracing.getAovs(aovs))
+			return;
+		uint32_t nbPixels = static_cast<uint32_t>(pathTracing.getWidth() * pathTracing.getHeight());
+		std::vector<glm::vec3> image(nbPixels);
+		for (uint32_t i = 0; i < static_cast<uint32_t>(PathTracing::Aov::COUNT); i++)
+		{
+			PathTracing::Aov aov = static_cast<PathTracing::Aov>(i);
+			if (!(mask & PathTracing::getAovBit(aov)))
+				continue;
+
+			const glm::vec3 *data = image.data();
+			const uint32_t *ids = nullptr;
+			switch (aov)
+			{
+			case PathTracing::Aov::DEPTH:
+				for (uint32_t pixel = 0; pixel < nbPixels; pixel++)
+					image[pixel] = glm::vec3(aovs.depths[pixel], aovs.depths[pixel], aovs.depths[pixel]);
+				break;
+			case PathTracing::Aov::NORMAL:
+				data = aovs.normals;
+				break;
+			case PathTracing::Aov::ALBEDO:
+				data = aovs.albedos;
+				break;
+			case PathTracing::Aov::OBJECT_ID:
+				ids = aovs.objectIds;
+				break;
+			default:
+				ids = aovs.materialIds;
+				break;
+			}
+			for (uint32_t pixel = 0; ids && pixel < nbPixels; pixel++)
+			{
+				float id = ids[pixel] == PathTracing::MISS_ID ? -1.0f : static_cast<float>(ids[pixel]);
+				image[pixel] = glm::vec3(id, id, id);
+			}
+
+			std::string path = getAovPath(output, aov);
+			ImageWriter::write(path, format, data, pathTracing.getWidth(), pathTracing.getHeight());
+			printf("Wrote %s\n", path.c_str());
+		}
+	}
+
+	// Returns false when only the usage was requested.
+	bool parseOptions(int ac, char **av, Options &options)
+	{
+		for (int i = 1; i < ac; i++)
+		{
+			const char *arg = av[i];
+			if (strcmp(arg, "--help") == 0)
+				return (false);
+			if (strcmp(arg, "--pin") == 0)
+			{
+				options.pinThreads = true;
+				continue;
+			}
+			if (strcmp(arg, "--no-roulette") == 0)
+			{
+				options.isRouletteEnabled = false;
+				continue;
+			}
+			if (strcmp(arg, "--no-packets") == 0)
+			{
+				options.arePacketsEnabled = false;
+				continue;
+			}
+			if (strcmp(arg, "--no-light-sampling") == 0)
+			{
+				options.isLightSamplingEnabled = false;
+				continue;
+			}
+			if (strcmp(arg, "--denoise") == 0)
+			{
+				options.isDenoising = true;
+				continue;
+			}
+
+			auto nextValue = [&]()
+			{
+				if (i + 1 >= ac)
+					throw std::invalid_argument(std::string("Missing value for ") + arg);
+				return (av[++i]);
+			};
+			if (strcmp(arg, "-w") == 0 || strcmp(arg, "--width") == 0)
+				options.width = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--height") == 0)
+				options.height = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "-s") == 0 || strcmp(arg, "--spp") == 0)
+				options.nbSamples = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "-t") == 0 || strcmp(arg, "--threads") == 0)
+				options.nbThreads = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "--scene") == 0)
+				options.scene = nextValue();
+			else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0)
+				options.output = nextValue();
+			else if (strcmp(arg, "--tile-size") == 0)
+				options.tileSize = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "--roulette-depth") == 0)
+				options.rouletteDepth = parseUInt(arg, nextValue());
+			else if (strcmp(arg, "--tile-order") == 0)
+				options.tileOrder = parseTileOrder(nextValue());
+			else if (strcmp(arg, "--integrator") == 0)
+				options.integratorMode = parseIntegratorMode(nextValue());
+			else if (strcmp(arg, "--aov") == 0)
+				options.aovMask = parseAovs(nextValue());
+			else if (strcmp(arg, "--sampler") == 0)
+				options.samplerType = parseSamplerType(nextValue());
+			else if (strcmp(arg, "--adaptive") == 0)
+			{
+				const char *value = nextValue();
+				options.isAdaptive = true;
+				options.noiseThreshold = static_cast<float>(atof(value));
+				if (options.noiseThreshold <= 0)
+					throw std::invalid_argument(std::string("Invalid value for ") + arg + ": " + value);
+			}
+			else
+				throw std::invalid_argument(std::string("Unknown option: ") + arg);
+		}
+
+		if (options.width == 0 || options.height == 0 || options.nbSamples == 0)
+			throw std::invalid_argument("Width, height and samples per pixel must be positive.");
+		return (true);
+	}
+
+	// Once the BVH is built, its nodes are in the arena too.
+	void printFootprint(const SceneDescription &scene)
+	{
+		constexpr double KIB = 1024.0;
+		printf("Scene memory:");
+		for (uint32_t i = 0; i < static_cast<uint32_t>(SceneArena::Category::COUNT); i++)
+		{
+			SceneArena::Category category = static_cast<SceneArena::Category>(i);
+			printf(" %s %.1f KiB,", SceneArena::getCategoryName(category), scene.arena.getUsedSize(category) / KIB);
+		}
+		printf(" materials %.1f KiB\n", scene.materials.size() * sizeof(Material) / KIB);
+		printf("Arena: %.1f KiB reserved in %zu blocks\n", scene.arena.getReservedSize() / KIB, scene.arena.getBlockCount());
+	}
+}
+
+// Renders one image without any window or GPU and writes it to disk.
+int main(int ac, char **av)
+{
+	Options options;
+	ImageWriter::Format format;
+	try
+	{
+		if (!parseOptions(ac, av, options))
+		{
+			printUsage(av[0]);
+			return (0);
+		}
+		if (!ImageWriter::getFormatFromPath(options.output, format))
+			throw std::invalid_argument("Output must end with .ppm, .pfm or .exr: " + options.output);
+	}
+	catch (std::invalid_argument &e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		printUsage(av[0]);
+		return (1);
+	}
+
+	try
+	{
+		SceneDescription scene;
+		if (!Scenes::create(options.scene, scene))
+			throw std::runtime_error("Unknown scene: " + options.scene);
+
+		BVH world;
+		world.build(scene.hitables, scene.arena);
+		printFootprint(scene);
+		Camera cam(scene.lookFrom, scene.lookAt, scene.up, scene.vfov,
+			static_cast<float>(options.width) / options.height, scene.aperture, scene.focusDist);
+
+		ThreadPool pool(options.nbThreads, options.pinThreads);
+		PathTracing pathTracing(options.width, options.height, options.nbSamples, world, scene.materials, scene.lights, cam, pool);
+		pathTracing.setSky(scene.skyHorizon, scene.skyZenith);
+		pathTracing.setLightSampling(options.isLightSamplingEnabled);
+		pathTracing.setTileScheduling(options.tileOrder, options.tileSize);
+		pathTracing.setIntegratorMode(options.integratorMode);
+		pathTracing.setRussianRoulette(options.isRouletteEnabled, options.rouletteDepth);
+		pathTracing.setPrimaryPackets(options.arePacketsEnabled);
+		pathTracing.setSampler(options.samplerType);
+		pathTracing.setAdaptiveSampling(options.isAdaptive, options.noiseThreshold);
+		pathTracing.setGuideBuffers(options.isDenoising);
+		pathTracing.setAovs(options.aovMask);
+
+		printf("Rendering %s at %ux%u, %u spp (%s) on %u threads\n", options.scene.c_str(),
+			options.width, options.height, options.nbSamples, Sampler::getTypeName(options.samplerType), pool.getThreadCount());
+
+		auto startTime = std::chrono::steady_clock::now();
+		pathTracing.startRendering();
+		// Rays per second over the last interval, on stderr so the line can
+		// be rewritten in place.
+		auto liveTime = startTime;
+		uint64_t liveRays = 0;
+		bool hasLiveLine = false;
+		while (pathTracing.isRendering())
+		{
+			pathTracing.waitForResult(LIVE_STATS_INTERVAL_MS);
+			auto now = std::chrono::steady_clock::now();
+			if (now - liveTime >= std::chrono::milliseconds(LIVE_STATS_INTERVAL_MS))
+			{
+				uint64_t nbRays = pathTracing.getStats().getRayCount();
+				double interval = std::chrono::duration<double>(now - liveTime).count();
+				fprintf(stderr, "\r%.3f M rays/s ", (nbRays - liveRays) / interval / 1e6);
+				liveTime = now;
+				liveRays = nbRays;
+				hasLiveLine = true;
+			}
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		if (hasLiveLine)
+			fprintf(stderr, "\n");
+
+		RenderStats stats = pathTracing.getStats();
+		printf("Rendered in %.3f s\n", seconds);
+		stats.print(stdout, seconds);
+
+		const glm::vec3 *picture = pathTracing.getPic();
+		Denoiser denoiser(pool);
+		if (options.isDenoising)
+		{
+			startTime = std::chrono::steady_clock::now();
+			picture = denoiser.denoise(pathTracing);
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+			printf("Denoised in %.3f s\n", seconds);
+		}
+		ImageWriter::write(options.output, format, picture, options.width, options.height);
+		printf("Wrote %s\n", options.output.c_str());
+		// Only the requested AOVs, not the ones filled for the denoiser.
+		writeAovs(pathTracing, options.aovMask, options.output, format);
+	}
+	catch (std::exception &e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return (1);
+	}
+	return (0);
+}
\ No newline at end of file
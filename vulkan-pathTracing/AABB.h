@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <utility>
+
+#include "Ray.h"
+
+struct AABB
+{
+	glm::vec3 min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	AABB() = default;
+	AABB(const glm::vec3 &newMin, const glm::vec3 &newMax)
+		: min(newMin), max(newMax)
+	{}
+
+	void grow(const glm::vec3 &point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void grow(const AABB &box)
+	{
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	glm::vec3 getCenter() const { return (0.5f * (min + max)); }
+
+	float getSurfaceArea() const
+	{
+		glm::vec3 d = max - min;
+		if (d.x < 0 || d.y < 0 || d.z < 0)
+			return (0);
+		return (2 * (d.x * d.y + d.y * d.z + d.z * d.x));
+	}
+
+	// Slab test, invDirection is 1 / ray.getDirection() computed once per ray.
+	bool hit(const Ray &ray, const glm::vec3 &invDirection, float minTime, float maxTime) const
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			float t0 = (min[a] - ray.getOrigin()[a]) * invDirection[a];
+			float t1 = (max[a] - ray.getOrigin()[a]) * invDirection[a];
+			if (invDirection[a] < 0)
+				std::swap(t0, t1);
+			minTime = t0 > minTime ? t0 : minTime;
+			maxTime = t1 < maxTime ? t1 : maxTime;
+			if (maxTime < minTime)
+				return (false);
+		}
+		return (true);
+	}
+};
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "AdaptiveSampler.h"
+
+#include <algorithm>
+
+constexpr uint32_t AdaptiveSampler::MAX_HEAP_FACTOR;
+
+void AdaptiveSampler::configure(uint32_t nbTiles, uint32_t newMinSamples, uint32_t newMaxSamples)
+{
+	std::lock_guard<std::mutex> lock(locker);
+	minSamples = newMinSamples;
+	maxSamples = newMaxSamples;
+	tiles.assign(nbTiles, TileState());
+	// The first minSamples passes are handed out in order by the caller.
+	for (TileState &state : tiles)
+		state.issued = minSamples;
+	rebuildHeap();
+}
+
+bool AdaptiveSampler::pickTile(uint32_t &tile, uint32_t &sample)
+{
+	std::lock_guard<std::mutex> lock(locker);
+	while (!heap.empty())
+	{
+		Entry top = heap.front();
+		std::pop_heap(heap.begin(), heap.end(), &AdaptiveSampler::isLowerPriority);
+		heap.pop_back();
+		if (top.version != tiles[top.tile].version)
+			continue;
+
+		tile = top.tile;
+		sample = tiles[tile].issued;
+		tiles[tile].issued += 1;
+		pushTile(tile);
+		return (true);
+	}
+	return (false);
+}
+
+void AdaptiveSampler::updateTile(uint32_t tile, float error, bool isConverged)
+{
+	std::lock_guard<std::mutex> lock(locker);
+	TileState &state = tiles[tile];
+	state.accumulated += 1;
+	state.error = error;
+	state.isConverged = isConverged;
+	pushTile(tile);
+}
+
+// Invalidates the entry of the tile and pushes its new priority, unless it
+// is done.
+void AdaptiveSampler::pushTile(uint32_t tile)
+{
+	TileState &state = tiles[tile];
+	state.version += 1;
+	if (state.isConverged || state.issued >= maxSamples)
+		return;
+	if (heap.size() >= MAX_HEAP_FACTOR * tiles.size())
+	{
+		rebuildHeap();
+		return;
+	}
+
+	Entry entry;
+	entry.isMeasured = state.accumulated >= minSamples;
+	entry.tile = tile;
+	entry.version = state.version;
+	if (entry.isMeasured)
+	{
+		// Squared error expected once the in-flight samples land, divided by
+		// the sample count: roughly what one more sample takes off it.
+		float issued = static_cast<float>(state.issued);
+		entry.priority = state.error * state.error * static_cast<float>(state.accumulated) / (issued * issued);
+	}
+	else
+		entry.priority = -static_cast<float>(state.issued);
+	heap.push_back(entry);
+	std::push_heap(heap.begin(), heap.end(), &AdaptiveSampler::isLowerPriority);
+}
+
+void AdaptiveSampler::rebuildHeap()
+{
+	heap.clear();
+	for (uint32_t i = 0; i < static_cast<uint32_t>(tiles.size()); i++)
+		pushTile(i);
+}
+
+bool AdaptiveSampler::isLowerPriority(const Entry &a, const Entry &b)
+{
+	if (a.isMeasured != b.isMeasured)
+		return (b.isMeasured);
+	return (a.priority < b.priority);
+}
\ No newline at end of file
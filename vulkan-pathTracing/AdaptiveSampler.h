@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+// Hands out tiles by remaining error once every tile received its first
+// minSamples passes. A tile is picked by how much one more sample should
+// lower its squared error, counting the samples still in flight, so the
+// workers spread over the noisy regions instead of piling on the single
+// worst tile.
+//
+// The tiles wait in a max-heap keyed on that priority. Every change of a
+// tile pushes a new entry and leaves the old one behind, stale entries are
+// dropped when they reach the top, so both calls cost O(log nbTiles)
+// under the lock.
+class AdaptiveSampler
+{
+public:
+	void configure(uint32_t nbTiles, uint32_t minSamples, uint32_t maxSamples);
+
+	// Returns false once every tile converged or reached maxSamples,
+	// otherwise sets the tile and the sample index to render.
+	bool pickTile(uint32_t &tile, uint32_t &sample);
+
+	// Called after a block of the tile was accumulated. error is the RMS
+	// relative error of its pixels that did not converge yet, isConverged
+	// tells if all of them are below the threshold.
+	void updateTile(uint32_t tile, float error, bool isConverged);
+
+private:
+	// The heap is rebuilt from the tiles when stale entries make it this
+	// many times larger than the tile count.
+	static constexpr uint32_t MAX_HEAP_FACTOR = 4;
+
+	struct TileState
+	{
+		float error = 0;
+		uint32_t issued = 0;
+		uint32_t accumulated = 0;
+		uint32_t version = 0; // of the last entry pushed for the tile
+		bool isConverged = false;
+	};
+
+	struct Entry
+	{
+		// Tiles whose first passes are still in flight have no error yet,
+		// they come after every measured tile, fewest issued first.
+		bool isMeasured;
+		float priority;
+		uint32_t tile;
+		uint32_t version;
+	};
+
+	uint32_t minSamples = 0;
+	uint32_t maxSamples = 0;
+
+	std::mutex locker;
+	std::vector<TileState> tiles;
+	std::vector<Entry> heap;
+
+	void pushTile(uint32_t tile);
+	void rebuildHeap();
+	static bool isLowerPriority(const Entry &a, const Entry &b);
+};
\ No newline at end of file
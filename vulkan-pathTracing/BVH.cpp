@@ -0,0 +1,482 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include "HitRecord.h"
+#include "LogMessage.h"
+#include "RayPacket.h"
+#include "RenderStats.h"
+#include "SceneArena.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+# define BVH_X86
+# include <immintrin.h>
+#endif
+
+namespace
+{
+	// Interval arithmetic over the origins and inverse directions of the
+	// packet, false only if none of its rays can hit the box. A product of
+	// intervals is bounded by its corners and rounding is monotonic, so
+	// the test stays conservative in floating point.
+	bool intersectsPacket(const AABB &box, const RayPacket &packet, float minTime, float maxTime)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			float nearPlane = packet.isDirectionNegative[a] ? box.max[a] : box.min[a];
+			float farPlane = packet.isDirectionNegative[a] ? box.min[a] : box.max[a];
+			float near0 = nearPlane - packet.maxOrigin[a];
+			float near1 = nearPlane - packet.minOrigin[a];
+			float far0 = farPlane - packet.maxOrigin[a];
+			float far1 = farPlane - packet.minOrigin[a];
+			float entry = std::min(std::min(near0 * packet.minInvDirection[a], near0 * packet.maxInvDirection[a]),
+				std::min(near1 * packet.minInvDirection[a], near1 * packet.maxInvDirection[a]));
+			float exit = std::max(std::max(far0 * packet.minInvDirection[a], far0 * packet.maxInvDirection[a]),
+				std::max(far1 * packet.minInvDirection[a], far1 * packet.maxInvDirection[a]));
+			minTime = entry > minTime ? entry : minTime;
+			maxTime = exit < maxTime ? exit : maxTime;
+			if (maxTime < minTime)
+				return (false);
+		}
+		return (true);
+	}
+
+	// Slab test of every lane of mask against the box, with the same
+	// operations as AABB::hit so a lane hits exactly when its ray would.
+	uint32_t intersectLanes(const AABB &box, const RayPacket &packet, float minTime, const float *closest, uint32_t mask)
+	{
+		uint32_t hitMask = 0;
+#ifdef BVH_X86
+		for (uint32_t group = 0; group < RayPacket::SIZE; group += 4)
+		{
+			__m128 tNear = _mm_set1_ps(minTime);
+			__m128 tFar = _mm_load_ps(closest + group);
+			for (int a = 0; a < 3; a++)
+			{
+				__m128 origin = _mm_load_ps(packet.origins[a] + group);
+				__m128 invDirection = _mm_load_ps(packet.invDirections[a] + group);
+				__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.min[a]), origin), invDirection);
+				__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.max[a]), origin), invDirection);
+				if (packet.isDirectionNegative[a])
+					std::swap(t0, t1);
+				tNear = _mm_max_ps(t0, tNear);
+				tFar = _mm_min_ps(t1, tFar);
+			}
+			hitMask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpge_ps(tFar, tNear))) << group;
+		}
+#else
+		for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+		{
+			glm::vec3 invDirection(packet.invDirections[0][lane], packet.invDirections[1][lane], packet.invDirections[2][lane]);
+			if ((mask & (1u << lane)) && box.hit(packet.rays[lane], invDirection, minTime, closest[lane]))
+				hitMask |= 1u << lane;
+		}
+#endif
+		return (hitMask & mask);
+	}
+
+	uint32_t getLowestLane(uint32_t mask)
+	{
+		uint32_t lane = 0;
+		while (!(mask & (1u << lane)))
+			lane++;
+		return (lane);
+	}
+
+	uint32_t getLaneCount(uint32_t mask)
+	{
+		uint32_t count = 0;
+		for (; mask != 0; mask &= mask - 1)
+			count++;
+		return (count);
+	}
+}
+
+BVH::~BVH()
+{
+	release();
+}
+
+void BVH::takeOwnershipOf(IHitable **newCollection)
+{
+	release();
+	collection = newCollection;
+	if (!collection)
+		return;
+
+	buildAll(collection);
+	nodeData = nodes.data();
+	primitiveData = primitives.data();
+}
+
+void BVH::build(IHitable *const *list, SceneArena &arena)
+{
+	release();
+	if (!list)
+		return;
+
+	buildAll(list);
+	Node *arenaNodes = arena.createArray<Node>(nodes.size(), SceneArena::Category::NODE);
+	IHitable **arenaPrimitives = arena.createArray<IHitable *>(primitives.size(), SceneArena::Category::NODE);
+	std::uninitialized_copy(nodes.begin(), nodes.end(), arenaNodes);
+	std::uninitialized_copy(primitives.begin(), primitives.end(), arenaPrimitives);
+	nodeData = arenaNodes;
+	primitiveData = arenaPrimitives;
+	std::vector<Node>().swap(nodes);
+	std::vector<IHitable *>().swap(primitives);
+}
+
+bool BVH::hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const
+{
+	if (nbNodes == 0)
+		return (false);
+	float closest = maxTime;
+	return (hitSubtree(0, ray, minTime, closest, record));
+}
+
+// Nodes missed by the whole packet are rejected with a single interval
+// test, the others test every ray still in the packet at once. Each ray
+// gets the closest hit it would get alone, only the order of the children
+// follows the common direction of the packet. Once a single ray is left in
+// a subtree it finishes it alone.
+uint32_t BVH::hitPacket(const RayPacket &packet, float minTime, float maxTime, HitRecord *records) const
+{
+	if (nbNodes == 0)
+		return (0);
+	if (!packet.isCoherent)
+		return (IHitable::hitPacket(packet, minTime, maxTime, records));
+
+	struct StackEntry
+	{
+		uint32_t node;
+		uint32_t mask;
+	};
+	StackEntry stack[MAX_DEPTH];
+	uint32_t stackSize = 0;
+	uint32_t current = 0;
+	uint32_t mask = packet.activeMask;
+
+	alignas(16) float closest[RayPacket::SIZE];
+	for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+		closest[lane] = maxTime;
+
+	HitRecord tmpRecord;
+	uint32_t hitMask = 0;
+	uint32_t nbVisits = 0;
+	while (true)
+	{
+		const Node &node = nodeData[current];
+		// Counted per ray like hitSubtree, so the stats compare with and
+		// without packets.
+		nbVisits += getLaneCount(mask);
+		if (intersectsPacket(node.box, packet, minTime, maxTime))
+			mask = intersectLanes(node.box, packet, minTime, closest, mask);
+		else
+			mask = 0;
+
+		if (mask != 0 && (mask & (mask - 1)) == 0)
+		{
+			uint32_t lane = getLowestLane(mask);
+			nbVisits -= 1; // hitSubtree counts this node again
+			if (hitSubtree(current, packet.rays[lane], minTime, closest[lane], records[lane]))
+				hitMask |= mask;
+		}
+		else if (mask != 0 && node.count > 0)
+		{
+			for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+			{
+				if (!(mask & (1u << lane)))
+					continue;
+				for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+				{
+					if (primitiveData[i]->hit(packet.rays[lane], minTime, closest[lane], tmpRecord))
+					{
+						hitMask |= 1u << lane;
+						closest[lane] = tmpRecord.t;
+						records[lane] = tmpRecord;
+					}
+				}
+			}
+		}
+		else if (mask != 0)
+		{
+			if (packet.isDirectionNegative[node.axis])
+			{
+				stack[stackSize++] = StackEntry{ current + 1, mask };
+				current = node.offset;
+			}
+			else
+			{
+				stack[stackSize++] = StackEntry{ node.offset, mask };
+				current = current + 1;
+			}
+			continue;
+		}
+
+		if (stackSize == 0)
+			break;
+		stackSize--;
+		current = stack[stackSize].node;
+		mask = stack[stackSize].mask;
+	}
+	if (RenderStats *stats = RenderStats::getThreadStats())
+		stats->nodeVisits += nbVisits;
+	return (hitMask);
+}
+
+// The depth first layout keeps a subtree contiguous, so starting from its
+// root with an empty stack visits nothing else.
+bool BVH::hitSubtree(uint32_t root, const Ray &ray, float minTime, float &closest, HitRecord &record) const
+{
+	glm::vec3 invDirection = 1.0f / ray.getDirection();
+	bool isDirectionNegative[3] = { invDirection.x < 0, invDirection.y < 0, invDirection.z < 0 };
+
+	uint32_t stack[MAX_DEPTH];
+	uint32_t stackSize = 0;
+	uint32_t current = root;
+
+	HitRecord tmpRecord;
+	bool hasHitAnything = false;
+	uint32_t nbVisits = 0;
+	while (true)
+	{
+		const Node &node = nodeData[current];
+		nbVisits += 1;
+		if (node.box.hit(ray, invDirection, minTime, closest))
+		{
+			if (node.count > 0)
+			{
+				for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+				{
+					if (primitiveData[i]->hit(ray, minTime, closest, tmpRecord))
+					{
+						hasHitAnything = true;
+						closest = tmpRecord.t;
+						record = tmpRecord;
+					}
+				}
+			}
+			else
+			{
+				// Visit the child closest to the ray origin first so that
+				// closest gets small early and prunes the far child.
+				if (isDirectionNegative[node.axis])
+				{
+					stack[stackSize++] = current + 1;
+					current = node.offset;
+				}
+				else
+				{
+					stack[stackSize++] = node.offset;
+					current = current + 1;
+				}
+				continue;
+			}
+		}
+		if (stackSize == 0)
+			break;
+		current = stack[--stackSize];
+	}
+	if (RenderStats *stats = RenderStats::getThreadStats())
+		stats->nodeVisits += nbVisits;
+	return (hasHitAnything);
+}
+
+bool BVH::boundingBox(AABB &box) const
+{
+	if (nbNodes == 0)
+		return (false);
+	box = nodeData[0].box;
+	return (true);
+}
+
+void BVH::release()
+{
+	if (collection)
+	{
+		for (size_t i = 0; collection[i] != nullptr; i++)
+		{
+			delete collection[i];
+		}
+		delete[] collection;
+		collection = nullptr;
+	}
+	nodes.clear();
+	primitives.clear();
+	nodeData = nullptr;
+	primitiveData = nullptr;
+	nbNodes = 0;
+}
+
+void BVH::buildAll(IHitable *const *list)
+{
+	std::vector<BuildPrimitive> buildPrimitives;
+	for (size_t i = 0; list[i] != nullptr; i++)
+	{
+		BuildPrimitive primitive;
+		if (!list[i]->boundingBox(primitive.box))
+			throw std::runtime_error("Unable to insert an unbounded hitable in the BVH.");
+		primitive.centroid = primitive.box.getCenter();
+		primitive.hitable = list[i];
+		buildPrimitives.push_back(primitive);
+	}
+	if (buildPrimitives.empty())
+		return;
+
+	nodes.reserve(2 * buildPrimitives.size());
+	primitives.reserve(buildPrimitives.size());
+	buildNode(buildPrimitives, 0, static_cast<uint32_t>(buildPrimitives.size()), 0);
+	nbNodes = static_cast<uint32_t>(nodes.size());
+	LOG_MSG("BVH built with %zu nodes for %zu primitives.", nodes.size(), primitives.size());
+}
+
+uint32_t BVH::buildNode(std::vector<BuildPrimitive> &buildPrimitives, uint32_t begin, uint32_t end, uint32_t depth)
+{
+	uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+
+	AABB box;
+	AABB centroidBox;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		box.grow(buildPrimitives[i].box);
+		centroidBox.grow(buildPrimitives[i].centroid);
+	}
+	nodes[nodeIndex].box = box;
+
+	uint32_t count = end - begin;
+	if (count == 1 || depth + 1 >= MAX_DEPTH)
+	{
+		makeLeaf(nodeIndex, buildPrimitives, begin, end);
+		return (nodeIndex);
+	}
+
+	glm::vec3 extent = centroidBox.max - centroidBox.min;
+	uint16_t axis = 0;
+	if (extent.y > extent.x)
+		axis = 1;
+	if (extent.z > extent[axis])
+		axis = 2;
+
+	if (extent[axis] <= 0)
+	{
+		// Every centroid is at the same place, no split can help.
+		if (count <= UINT16_MAX)
+		{
+			makeLeaf(nodeIndex, buildPrimitives, begin, end);
+			return (nodeIndex);
+		}
+	}
+
+	uint32_t mid = begin;
+	if (extent[axis] > 0)
+	{
+		struct Bin
+		{
+			AABB box;
+			uint32_t count = 0;
+		};
+
+		Bin bins[NBR_BINS];
+		float scale = NBR_BINS / extent[axis];
+		auto binIndex = [&](const BuildPrimitive &primitive)
+		{
+			uint32_t index = static_cast<uint32_t>((primitive.centroid[axis] - centroidBox.min[axis]) * scale);
+			return (index < NBR_BINS ? index : NBR_BINS - 1);
+		};
+
+		for (uint32_t i = begin; i < end; i++)
+		{
+			Bin &bin = bins[binIndex(buildPrimitives[i])];
+			bin.box.grow(buildPrimitives[i].box);
+			bin.count += 1;
+		}
+
+		// Sweep from the right to get the area and count of every right
+		// partition, then from the left to evaluate each split plane.
+		float rightArea[NBR_BINS];
+		uint32_t rightCount[NBR_BINS];
+		AABB accumulated;
+		uint32_t accumulatedCount = 0;
+		for (uint32_t i = NBR_BINS - 1; i > 0; i--)
+		{
+			accumulated.grow(bins[i].box);
+			accumulatedCount += bins[i].count;
+			rightArea[i] = accumulated.getSurfaceArea();
+			rightCount[i] = accumulatedCount;
+		}
+
+		float bestCost = FLT_MAX;
+		uint32_t bestSplit = 0;
+		accumulated = AABB();
+		accumulatedCount = 0;
+		for (uint32_t i = 0; i < NBR_BINS - 1; i++)
+		{
+			accumulated.grow(bins[i].box);
+			accumulatedCount += bins[i].count;
+			if (accumulatedCount == 0 || rightCount[i + 1] == 0)
+				continue;
+			float cost = accumulated.getSurfaceArea() * accumulatedCount + rightArea[i + 1] * rightCount[i + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = i;
+			}
+		}
+
+		float area = box.getSurfaceArea();
+		float splitCost = TRAVERSAL_COST + INTERSECTION_COST * (area > 0 ? bestCost / area : 0);
+		float leafCost = INTERSECTION_COST * count;
+		if (count <= MAX_PRIMITIVES_PER_LEAF && leafCost <= splitCost)
+		{
+			makeLeaf(nodeIndex, buildPrimitives, begin, end);
+			return (nodeIndex);
+		}
+
+		if (bestCost < FLT_MAX)
+		{
+			auto it = std::partition(buildPrimitives.begin() + begin, buildPrimitives.begin() + end,
+				[&](const BuildPrimitive &primitive) { return (binIndex(primitive) <= bestSplit); });
+			mid = static_cast<uint32_t>(it - buildPrimitives.begin());
+		}
+	}
+
+	// A child too large to be halved down to leaves that fit a Node before
+	// MAX_DEPTH is split by median instead.
+	uint64_t capacity = getSubtreeCapacity(depth + 1);
+	if (mid - begin > capacity || end - mid > capacity)
+		mid = begin;
+
+	if (mid == begin || mid == end)
+	{
+		mid = begin + count / 2;
+		std::nth_element(buildPrimitives.begin() + begin, buildPrimitives.begin() + mid, buildPrimitives.begin() + end,
+			[axis](const BuildPrimitive &a, const BuildPrimitive &b) { return (a.centroid[axis] < b.centroid[axis]); });
+	}
+
+	buildNode(buildPrimitives, begin, mid, depth + 1);
+	uint32_t secondChild = buildNode(buildPrimitives, mid, end, depth + 1);
+	nodes[nodeIndex].offset = secondChild;
+	nodes[nodeIndex].axis = axis;
+	return (nodeIndex);
+}
+
+// Most primitives a node at depth can hold when every node below it splits
+// by median, so that the leaves at MAX_DEPTH still fit Node::count.
+uint64_t BVH::getSubtreeCapacity(uint32_t depth)
+{
+	uint32_t nbLevels = MAX_DEPTH - 1 - depth;
+	return (nbLevels >= 32 ? UINT64_MAX : static_cast<uint64_t>(UINT16_MAX) << nbLevels);
+}
+
+void BVH::makeLeaf(uint32_t nodeIndex, const std::vector<BuildPrimitive> &buildPrimitives, uint32_t begin, uint32_t end)
+{
+	nodes[nodeIndex].offset = static_cast<uint32_t>(primitives.size());
+	nodes[nodeIndex].count = static_cast<uint16_t>(end - begin);
+	for (uint32_t i = begin; i < end; i++)
+	{
+		primitives.push_back(buildPrimitives[i].hitable);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "AABB.h"
+#include "IHitable.h"
+#include "Ray.h"
+
+class SceneArena;
+
+// Bounding volume hierarchy built with the surface area heuristic.
+// Drop-in replacement for HitableCollection: it takes ownership of the same
+// null-terminated IHitable array and answers closest-hit queries. It can
+// also be built over a list living in a SceneArena, its nodes then go to
+// the arena too.
+class BVH : public IHitable
+{
+	static constexpr uint32_t NBR_BINS = 16;
+	static constexpr uint32_t MAX_PRIMITIVES_PER_LEAF = 4;
+	static constexpr uint32_t MAX_DEPTH = 64;
+	static constexpr float TRAVERSAL_COST = 1.0f;
+	static constexpr float INTERSECTION_COST = 1.0f;
+
+	// Nodes are stored depth first: the first child of an interior node is
+	// always the next node, offset gives the second one.
+	struct Node
+	{
+		AABB box;
+		uint32_t offset = 0; // first primitive for a leaf, second child otherwise
+		uint16_t count = 0; // 0 for interior nodes
+		uint16_t axis = 0;
+	};
+
+	struct BuildPrimitive
+	{
+		AABB box;
+		glm::vec3 centroid;
+		IHitable *hitable;
+	};
+
+public:
+	BVH() = default;
+	BVH(const BVH &ref) = delete;
+	BVH &operator=(const BVH &ref) = delete;
+	~BVH();
+
+	void takeOwnershipOf(IHitable **newCollection);
+	// The list stays owned by the caller, arena must outlive the BVH.
+	void build(IHitable *const *list, SceneArena &arena);
+	bool hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const override;
+	bool boundingBox(AABB &box) const override;
+	uint32_t hitPacket(const RayPacket &packet, float minTime, float maxTime, HitRecord *records) const override;
+
+private:
+	IHitable **collection = nullptr;
+
+	// Point either into the vectors below or into the arena.
+	const Node *nodeData = nullptr;
+	IHitable *const *primitiveData = nullptr;
+	uint32_t nbNodes = 0;
+
+	std::vector<Node> nodes;
+	std::vector<IHitable *> primitives;
+
+	void release();
+	// Closest hit below root nearer than closest, which is lowered.
+	bool hitSubtree(uint32_t root, const Ray &ray, float minTime, float &closest, HitRecord &record) const;
+	void buildAll(IHitable *const *list);
+	uint32_t buildNode(std::vector<BuildPrimitive> &buildPrimitives, uint32_t begin, uint32_t end, uint32_t depth);
+	static uint64_t getSubtreeCapacity(uint32_t depth);
+	void makeLeaf(uint32_t nodeIndex, const std::vector<BuildPrimitive> &buildPrimitives, uint32_t begin, uint32_t end);
+};
\ No newline at end of file
@@ -4,18 +4,29 @@
 
 #include <math.h>
 
-#include "ctmRand.h"
-
 namespace
 {
-	glm::vec3 randomInUnitDisk()
+	// Concentric mapping of the unit square onto the disk (Shirley and
+	// Chiu), it keeps neighbouring samples close to each other.
+	glm::vec2 uniformInDisk(const glm::vec2 &u)
 	{
-		glm::vec3 p;
-		do
+		glm::vec2 offset = 2.0f * u - glm::vec2(1, 1);
+		if (offset.x == 0 && offset.y == 0)
+			return (glm::vec2(0, 0));
+
+		float radius;
+		float theta;
+		if (fabsf(offset.x) > fabsf(offset.y))
+		{
+			radius = offset.x;
+			theta = glm::pi<float>() / 4 * (offset.y / offset.x);
+		}
+		else
 		{
-			p = 2.0f * glm::vec3(ctmRand(), ctmRand(), 0) - glm::vec3(1, 1, 0);
-		} while (glm::dot(p, p) >= 1);
-		return (p);
+			radius = offset.y;
+			theta = glm::pi<float>() / 2 - glm::pi<float>() / 4 * (offset.x / offset.y);
+		}
+		return (radius * glm::vec2(cosf(theta), sinf(theta)));
 	}
 }
 
@@ -38,9 +49,9 @@ Camera::Camera(glm::vec3 lookFrom, glm::vec3 lookAt, glm::vec3 up, float vfov, f
 	vertical = focusDist * 2 * halfHeight * v;
 }
 
-Ray Camera::getRay(const float s, const float t) const
+Ray Camera::getRay(const float s, const float t, const glm::vec2 &lens) const
 {
-	glm::vec3 rd = lensRadius * randomInUnitDisk();
+	glm::vec2 rd = lensRadius * uniformInDisk(lens);
 	glm::vec3 offset = u * rd.x + v * rd.y;
 	return (Ray(origin + offset, lowerLeft + s * horizontal + t * vertical - origin - offset));
 }
\ No newline at end of file
@@ -20,5 +20,6 @@ class Camera
 public:
 	Camera(glm::vec3 lookFrom, glm::vec3 lookAt, glm::vec3 up, float vfov, float aspect, float aperture, float focusDist);
 
-	Ray getRay(const float s, const float t) const;
+	// lens is a uniform point of the unit square, warped onto the aperture.
+	Ray getRay(const float s, const float t, const glm::vec2 &lens) const;
 };
\ No newline at end of file
@@ -0,0 +1,448 @@
+#include "Denoiser.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <stdexcept>
+
+#include "PackedSpheres.h"
+#include "PathTracing.h"
+#include "ThreadPool.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+# define DENOISER_X86
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  define TARGET_AVX2
+# else
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+# endif
+#endif
+
+// The AVX2 kernel must not be fused into FMAs or it would stop matching the
+// scalar one bit for bit.
+#if defined(__clang__)
+# pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+# pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace
+{
+	constexpr uint32_t PADDING = 2u << (Denoiser::MAX_ITERATIONS - 1);
+	constexpr uint32_t TAP_COUNT = 24;
+	// 1D B-spline weights 3/8, 1/4, 1/16, the center tap is not in the list.
+	constexpr float CENTER_WEIGHT = 0.375f * 0.375f;
+	constexpr float DEPTH_EPSILON = 1e-4f;
+	constexpr float LUMINANCE_EPSILON = 1e-6f;
+	// Albedo channels below it are left out of the demodulation, dividing
+	// by them would only amplify the noise.
+	constexpr float MIN_ALBEDO = 0.01f;
+	constexpr float NEG_LOG2E = -1.44269504f;
+	// Weight of the variance against the squared change made by the filter
+	// in the final blend, lower values keep more of the noisy picture.
+	constexpr float BLEND_VARIANCE_SCALE = 0.5f;
+
+	struct Tap
+	{
+		ptrdiff_t offset;
+		float weight;
+		float depthScale; // depthPhi times the distance to the center in pixels
+	};
+
+	struct FilterPass
+	{
+		const float *color[3];
+		const float *variance;
+		float *outColor[3];
+		float *outVariance;
+		const float *normal[3];
+		const float *depth;
+		const float *depthGradient;
+		ptrdiff_t stride;
+		float colorPhi;
+		Tap taps[TAP_COUNT];
+	};
+
+	// Weights of the 3x3 gaussian that smooths the variance of the center.
+	const float VARIANCE_BLUR[3] = { 0.25f, 0.5f, 0.25f };
+
+	float luminance(float r, float g, float b)
+	{
+		return (0.2126f * r + 0.7152f * g + 0.0722f * b);
+	}
+
+	// e^-x for x >= 0, exact enough for weights and the same in both
+	// kernels, unlike expf. The result is flushed to 2^-126 past 87.
+	float expNegative(float x)
+	{
+		float t = x * NEG_LOG2E;
+		t = t > -126.0f ? t : -126.0f;
+		float whole = floorf(t);
+		float f = t - whole;
+		float p = ((((0.001333355f * f + 0.009618129f) * f + 0.05550357f) * f + 0.2402265f) * f + 0.6931472f) * f + 1.0f;
+		uint32_t bits = static_cast<uint32_t>(static_cast<int32_t>(whole) + 127) << 23;
+		float scale;
+		memcpy(&scale, &bits, sizeof(scale));
+		return (p * scale);
+	}
+
+	typedef void (*FilterKernel)(const FilterPass &pass, size_t begin, uint32_t count);
+
+	void filterScalar(const FilterPass &pass, size_t begin, uint32_t count)
+	{
+		for (size_t i = begin; i < begin + count; i++)
+		{
+			float nx = pass.normal[0][i];
+			float ny = pass.normal[1][i];
+			float nz = pass.normal[2][i];
+			float depth = pass.depth[i];
+			float depthGradient = pass.depthGradient[i];
+			float r = pass.color[0][i];
+			float g = pass.color[1][i];
+			float b = pass.color[2][i];
+			float variance = pass.variance[i];
+
+			float blurred = 0;
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dx = -1; dx <= 1; dx++)
+					blurred += VARIANCE_BLUR[dy + 1] * VARIANCE_BLUR[dx + 1] * pass.variance[i + dy * pass.stride + dx];
+			float sigma = pass.colorPhi * sqrtf(blurred) + LUMINANCE_EPSILON;
+			float centerLuminance = luminance(r, g, b);
+
+			float sumWeight = CENTER_WEIGHT;
+			float sumR = CENTER_WEIGHT * r;
+			float sumG = CENTER_WEIGHT * g;
+			float sumB = CENTER_WEIGHT * b;
+			float sumVariance = CENTER_WEIGHT * CENTER_WEIGHT * variance;
+			for (const Tap &tap : pass.taps)
+			{
+				size_t j = i + tap.offset;
+				float cosine = nx * pass.normal[0][j] + ny * pass.normal[1][j] + nz * pass.normal[2][j];
+				float normalWeight = cosine > 0 ? cosine : 0;
+				for (int k = 0; k < 7; k++)
+					normalWeight *= normalWeight;
+				float tapR = pass.color[0][j];
+				float tapG = pass.color[1][j];
+				float tapB = pass.color[2][j];
+				float depthDistance = fabsf(depth - pass.depth[j]) / (tap.depthScale * depthGradient + DEPTH_EPSILON);
+				float luminanceDistance = fabsf(centerLuminance - luminance(tapR, tapG, tapB)) / sigma;
+				float weight = tap.weight * normalWeight * expNegative(depthDistance + luminanceDistance);
+				sumWeight += weight;
+				sumR += weight * tapR;
+				sumG += weight * tapG;
+				sumB += weight * tapB;
+				sumVariance += weight * weight * pass.variance[j];
+			}
+
+			float invWeight = 1 / sumWeight;
+			pass.outColor[0][i] = sumR * invWeight;
+			pass.outColor[1][i] = sumG * invWeight;
+			pass.outColor[2][i] = sumB * invWeight;
+			pass.outVariance[i] = sumVariance * (invWeight * invWeight);
+		}
+	}
+
+#ifdef DENOISER_X86
+	TARGET_AVX2
+	__m256 luminanceAVX2(__m256 r, __m256 g, __m256 b)
+	{
+		return (_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.2126f), r), _mm256_mul_ps(_mm256_set1_ps(0.7152f), g)),
+			_mm256_mul_ps(_mm256_set1_ps(0.0722f), b)));
+	}
+
+	TARGET_AVX2
+	__m256 expNegativeAVX2(__m256 x)
+	{
+		__m256 t = _mm256_max_ps(_mm256_mul_ps(x, _mm256_set1_ps(NEG_LOG2E)), _mm256_set1_ps(-126.0f));
+		__m256 whole = _mm256_floor_ps(t);
+		__m256 f = _mm256_sub_ps(t, whole);
+		__m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.001333355f), f), _mm256_set1_ps(0.009618129f));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.05550357f));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.2402265f));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.6931472f));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+		__m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(whole), _mm256_set1_epi32(127)), 23);
+		return (_mm256_mul_ps(p, _mm256_castsi256_ps(bits)));
+	}
+
+	// Eight pixels of a row at a time, the rest goes to the scalar kernel.
+	TARGET_AVX2
+	void filterAVX2(const FilterPass &pass, size_t begin, uint32_t count)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+		const __m256 centerWeight = _mm256_set1_ps(CENTER_WEIGHT);
+		const __m256 colorPhi = _mm256_set1_ps(pass.colorPhi);
+
+		size_t i = begin;
+		for (; i + 8 <= begin + count; i += 8)
+		{
+			__m256 nx = _mm256_loadu_ps(pass.normal[0] + i);
+			__m256 ny = _mm256_loadu_ps(pass.normal[1] + i);
+			__m256 nz = _mm256_loadu_ps(pass.normal[2] + i);
+			__m256 depth = _mm256_loadu_ps(pass.depth + i);
+			__m256 depthGradient = _mm256_loadu_ps(pass.depthGradient + i);
+			__m256 r = _mm256_loadu_ps(pass.color[0] + i);
+			__m256 g = _mm256_loadu_ps(pass.color[1] + i);
+			__m256 b = _mm256_loadu_ps(pass.color[2] + i);
+			__m256 variance = _mm256_loadu_ps(pass.variance + i);
+
+			__m256 blurred = zero;
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					__m256 weight = _mm256_set1_ps(VARIANCE_BLUR[dy + 1] * VARIANCE_BLUR[dx + 1]);
+					blurred = _mm256_add_ps(blurred, _mm256_mul_ps(weight, _mm256_loadu_ps(pass.variance + i + dy * pass.stride + dx)));
+				}
+			}
+			__m256 sigma = _mm256_add_ps(_mm256_mul_ps(colorPhi, _mm256_sqrt_ps(blurred)), _mm256_set1_ps(LUMINANCE_EPSILON));
+			__m256 centerLuminance = luminanceAVX2(r, g, b);
+
+			__m256 sumWeight = centerWeight;
+			__m256 sumR = _mm256_mul_ps(centerWeight, r);
+			__m256 sumG = _mm256_mul_ps(centerWeight, g);
+			__m256 sumB = _mm256_mul_ps(centerWeight, b);
+			__m256 sumVariance = _mm256_mul_ps(_mm256_set1_ps(CENTER_WEIGHT * CENTER_WEIGHT), variance);
+			for (const Tap &tap : pass.taps)
+			{
+				size_t j = i + tap.offset;
+				__m256 cosine = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_loadu_ps(pass.normal[0] + j)),
+					_mm256_mul_ps(ny, _mm256_loadu_ps(pass.normal[1] + j))), _mm256_mul_ps(nz, _mm256_loadu_ps(pass.normal[2] + j)));
+				__m256 normalWeight = _mm256_max_ps(cosine, zero);
+				for (int k = 0; k < 7; k++)
+					normalWeight = _mm256_mul_ps(normalWeight, normalWeight);
+				__m256 tapR = _mm256_loadu_ps(pass.color[0] + j);
+				__m256 tapG = _mm256_loadu_ps(pass.color[1] + j);
+				__m256 tapB = _mm256_loadu_ps(pass.color[2] + j);
+				__m256 depthDistance = _mm256_div_ps(_mm256_andnot_ps(signMask, _mm256_sub_ps(depth, _mm256_loadu_ps(pass.depth + j))),
+					_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tap.depthScale), depthGradient), _mm256_set1_ps(DEPTH_EPSILON)));
+				__m256 luminanceDistance = _mm256_div_ps(_mm256_andnot_ps(signMask,
+					_mm256_sub_ps(centerLuminance, luminanceAVX2(tapR, tapG, tapB))), sigma);
+				__m256 weight = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(tap.weight), normalWeight),
+					expNegativeAVX2(_mm256_add_ps(depthDistance, luminanceDistance)));
+				sumWeight = _mm256_add_ps(sumWeight, weight);
+				sumR = _mm256_add_ps(sumR, _mm256_mul_ps(weight, tapR));
+				sumG = _mm256_add_ps(sumG, _mm256_mul_ps(weight, tapG));
+				sumB = _mm256_add_ps(sumB, _mm256_mul_ps(weight, tapB));
+				sumVariance = _mm256_add_ps(sumVariance, _mm256_mul_ps(_mm256_mul_ps(weight, weight), _mm256_loadu_ps(pass.variance + j)));
+			}
+
+			__m256 invWeight = _mm256_div_ps(_mm256_set1_ps(1.0f), sumWeight);
+			_mm256_storeu_ps(pass.outColor[0] + i, _mm256_mul_ps(sumR, invWeight));
+			_mm256_storeu_ps(pass.outColor[1] + i, _mm256_mul_ps(sumG, invWeight));
+			_mm256_storeu_ps(pass.outColor[2] + i, _mm256_mul_ps(sumB, invWeight));
+			_mm256_storeu_ps(pass.outVariance + i, _mm256_mul_ps(sumVariance, _mm256_mul_ps(invWeight, invWeight)));
+		}
+		filterScalar(pass, i, static_cast<uint32_t>(begin + count - i));
+	}
+#endif
+
+	FilterKernel getKernel()
+	{
+#ifdef DENOISER_X86
+		static const FilterKernel kernel = static_cast<int>(PackedSpheres::getSupportedSimdLevel())
+			>= static_cast<int>(PackedSpheres::SimdLevel::AVX2) ? &filterAVX2 : &filterScalar;
+		return (kernel);
+#else
+		return (&filterScalar);
+#endif
+	}
+}
+
+constexpr uint32_t Denoiser::MAX_ITERATIONS;
+
+Denoiser::Denoiser(ThreadPool &pool)
+	: pool(pool)
+{
+}
+
+void Denoiser::setSettings(const Settings &newSettings)
+{
+	settings = newSettings;
+	if (settings.nbIterations > MAX_ITERATIONS)
+		settings.nbIterations = MAX_ITERATIONS;
+}
+
+const glm::vec3 *Denoiser::denoise(PathTracing &pathTracing)
+{
+	const glm::vec3 *pic = pathTracing.getPic();
+	PathTracing::Guides pathGuides;
+	if (!pathTracing.getGuides(pathGuides))
+		throw std::runtime_error("Unable to denoise without the guide buffers of the path tracing.");
+	return (denoise(pic, pathGuides, static_cast<uint32_t>(pathTracing.getWidth()), static_cast<uint32_t>(pathTracing.getHeight())));
+}
+
+const glm::vec3 *Denoiser::denoise(const glm::vec3 *newPicture, const PathTracing::Guides &newGuides, uint32_t newWidth, uint32_t newHeight)
+{
+	resize(newWidth, newHeight);
+	picture = newPicture;
+	guides = newGuides;
+
+	runPass(Phase::PREPARE);
+	source = COLOR_R;
+	for (uint32_t i = 0; i < settings.nbIterations; i++)
+	{
+		step = 1u << i;
+		runPass(Phase::FILTER);
+		source = source == COLOR_R ? COLOR_R_2 : COLOR_R;
+	}
+	runPass(Phase::FINISH);
+	picture = nullptr;
+	return (output.data());
+}
+
+void Denoiser::resize(uint32_t newWidth, uint32_t newHeight)
+{
+	if (newWidth == width && newHeight == height)
+		return;
+	width = newWidth;
+	height = newHeight;
+	// Rows start on a multiple of 8 floats, as the padding does.
+	stride = (width + 2 * PADDING + 7) & ~7u;
+	for (std::vector<float> &plane : planes)
+		plane.assign(static_cast<size_t>(stride) * (height + 2 * PADDING), 0.0f);
+	output.assign(static_cast<size_t>(width) * height, glm::vec3(0, 0, 0));
+}
+
+void Denoiser::runPass(Phase newPhase)
+{
+	phase = newPhase;
+	nextRow.store(0, std::memory_order_relaxed);
+	pool.dispatch([this](uint32_t) { this->processRows(); });
+	pool.wait();
+}
+
+void Denoiser::processRows()
+{
+	uint32_t y;
+	while ((y = nextRow.fetch_add(1, std::memory_order_relaxed)) < height)
+	{
+		switch (phase)
+		{
+		case Phase::PREPARE:
+			prepareRow(y);
+			break;
+		case Phase::FILTER:
+			filterRow(y);
+			break;
+		default:
+			finishRow(y);
+			break;
+		}
+	}
+}
+
+// The variance is the one of the luminance of the color, divided by the
+// albedo along with it.
+void Denoiser::prepareRow(uint32_t y)
+{
+	for (uint32_t x = 0; x < width; x++)
+	{
+		uint32_t pixel = x + y * width;
+		size_t i = getIndex(x, y);
+		glm::vec3 albedo = getDemodulationAlbedo(guides.albedos[pixel]);
+		glm::vec3 illumination = picture[pixel] / albedo;
+		float albedoLuminance = luminance(albedo.r, albedo.g, albedo.b);
+		planes[COLOR_R][i] = illumination.r;
+		planes[COLOR_G][i] = illumination.g;
+		planes[COLOR_B][i] = illumination.b;
+		planes[VARIANCE][i] = guides.variances[pixel] / (albedoLuminance * albedoLuminance);
+		planes[NORMAL_X][i] = guides.normals[pixel].x;
+		planes[NORMAL_Y][i] = guides.normals[pixel].y;
+		planes[NORMAL_Z][i] = guides.normals[pixel].z;
+		planes[DEPTH][i] = guides.depths[pixel];
+		planes[DEPTH_GRADIENT][i] = getDepthGradient(x, y);
+	}
+}
+
+void Denoiser::filterRow(uint32_t y)
+{
+	static const float WEIGHTS[3] = { 0.375f, 0.25f, 0.0625f };
+	uint32_t destination = source == COLOR_R ? COLOR_R_2 : COLOR_R;
+	FilterPass pass;
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		pass.color[c] = planes[source + c].data();
+		pass.outColor[c] = planes[destination + c].data();
+		pass.normal[c] = planes[NORMAL_X + c].data();
+	}
+	pass.variance = planes[source + VARIANCE - COLOR_R].data();
+	pass.outVariance = planes[destination + VARIANCE - COLOR_R].data();
+	pass.depth = planes[DEPTH].data();
+	pass.depthGradient = planes[DEPTH_GRADIENT].data();
+	pass.stride = stride;
+	pass.colorPhi = settings.colorPhi;
+	uint32_t nbTaps = 0;
+	for (int dy = -2; dy <= 2; dy++)
+	{
+		for (int dx = -2; dx <= 2; dx++)
+		{
+			if (dx == 0 && dy == 0)
+				continue;
+			Tap &tap = pass.taps[nbTaps++];
+			tap.offset = (dy * pass.stride + dx) * static_cast<ptrdiff_t>(step);
+			tap.weight = WEIGHTS[dx < 0 ? -dx : dx] * WEIGHTS[dy < 0 ? -dy : dy];
+			tap.depthScale = settings.depthPhi * static_cast<float>(step) * sqrtf(static_cast<float>(dx * dx + dy * dy));
+		}
+	}
+	getKernel()(pass, getIndex(0, y), width);
+}
+
+// A filtered pixel further from the noisy one than its standard deviation
+// is mostly bias, such as a highlight or a small light smeared over its
+// surroundings, and the noisy pixel takes over in proportion.
+void Denoiser::finishRow(uint32_t y)
+{
+	for (uint32_t x = 0; x < width; x++)
+	{
+		uint32_t pixel = x + y * width;
+		size_t i = getIndex(x, y);
+		glm::vec3 illumination(planes[source][i], planes[source + 1][i], planes[source + 2][i]);
+		glm::vec3 filtered = illumination * getDemodulationAlbedo(guides.albedos[pixel]);
+		const glm::vec3 &noisy = picture[pixel];
+		float difference = luminance(filtered.r, filtered.g, filtered.b) - luminance(noisy.r, noisy.g, noisy.b);
+		float bias = difference * difference;
+		float noisyWeight = bias > 0 ? bias / (bias + BLEND_VARIANCE_SCALE * guides.variances[pixel]) : 0;
+		output[pixel] = filtered + noisyWeight * (noisy - filtered);
+	}
+}
+
+size_t Denoiser::getIndex(uint32_t x, uint32_t y) const
+{
+	return (static_cast<size_t>(y + PADDING) * stride + x + PADDING);
+}
+
+// Depth change per pixel, taken on the flatter side along each axis so that
+// the pixels on a silhouette do not get the gradient of the jump. Missed
+// neighbors are ignored.
+float Denoiser::getDepthGradient(uint32_t x, uint32_t y) const
+{
+	uint32_t pixel = x + y * width;
+	float depth = guides.depths[pixel];
+	float gradient = 0;
+	for (uint32_t axis = 0; axis < 2; axis++)
+	{
+		bool hasPrevious = axis == 0 ? x > 0 : y > 0;
+		bool hasNext = axis == 0 ? x + 1 < width : y + 1 < height;
+		uint32_t offset = axis == 0 ? 1 : width;
+		float flattest = -1;
+		if (hasPrevious && guides.depths[pixel - offset] > 0)
+			flattest = fabsf(depth - guides.depths[pixel - offset]);
+		if (hasNext && guides.depths[pixel + offset] > 0)
+		{
+			float difference = fabsf(depth - guides.depths[pixel + offset]);
+			flattest = flattest < 0 || difference < flattest ? difference : flattest;
+		}
+		if (flattest > 0)
+			gradient += flattest;
+	}
+	return (gradient);
+}
+
+glm::vec3 Denoiser::getDemodulationAlbedo(const glm::vec3 &albedo)
+{
+	return (glm::vec3(albedo.r < MIN_ALBEDO ? 1 : albedo.r, albedo.g < MIN_ALBEDO ? 1 : albedo.g, albedo.b < MIN_ALBEDO ? 1 : albedo.b));
+}
\ No newline at end of file
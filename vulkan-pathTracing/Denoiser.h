@@ -0,0 +1,109 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "PathTracing.h"
+
+class ThreadPool;
+
+// Edge-avoiding a-trous wavelet filter guided by the first hit of the camera
+// rays, the spatial part of SVGF. The color is divided by the albedo so the
+// filter only blurs the lighting, then every iteration applies a 5x5 B-spline
+// kernel whose taps are spread twice as far as in the previous one and are
+// weighted down across normal, depth and luminance edges. The luminance
+// edges are scaled by the standard deviation of the noise, which the filter
+// propagates along the color. The result is finally blended back toward
+// the noisy picture wherever the filter moved a pixel further than its
+// variance explains.
+//
+// Like the Tonemapper, the rows are spread over the given pool and filtered
+// with scalar or AVX2 kernels that give the same result.
+class Denoiser
+{
+public:
+	// The padding of the planes covers the taps of the last iteration.
+	static constexpr uint32_t MAX_ITERATIONS = 5;
+
+	struct Settings
+	{
+		uint32_t nbIterations = MAX_ITERATIONS;
+		// Larger values blur more across luminance and depth changes.
+		float colorPhi = 4;
+		float depthPhi = 1;
+	};
+
+	Denoiser(ThreadPool &pool);
+
+	void setSettings(const Settings &newSettings);
+	const Settings &getSettings() const { return (settings); }
+
+	// Filters the current picture of pathTracing, whose guide buffers must
+	// have been enabled at startRendering. Blocks until the output is ready.
+	const glm::vec3 *denoise(PathTracing &pathTracing);
+	// Same for any picture and guides of width * height pixels, bottom row
+	// first like the picture of a PathTracing.
+	const glm::vec3 *denoise(const glm::vec3 *picture, const PathTracing::Guides &guides, uint32_t width, uint32_t height);
+
+	const glm::vec3 *getOutput() const { return (output.data()); }
+
+private:
+	enum Plane
+	{
+		COLOR_R,
+		COLOR_G,
+		COLOR_B,
+		VARIANCE,
+		// Second set of the ping pong between iterations.
+		COLOR_R_2,
+		COLOR_G_2,
+		COLOR_B_2,
+		VARIANCE_2,
+		NORMAL_X,
+		NORMAL_Y,
+		NORMAL_Z,
+		DEPTH,
+		DEPTH_GRADIENT,
+		PLANE_COUNT
+	};
+
+	enum class Phase
+	{
+		PREPARE,
+		FILTER,
+		FINISH
+	};
+
+	ThreadPool &pool;
+	Settings settings;
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// Planes are width * height with PADDING pixels of zeros on every side,
+	// whose zero normal keeps them out of the filter.
+	uint32_t stride = 0;
+	std::vector<float> planes[PLANE_COUNT];
+	std::vector<glm::vec3> output;
+
+	// State of the pass running on the pool.
+	const glm::vec3 *picture = nullptr;
+	PathTracing::Guides guides = {};
+	Phase phase = Phase::PREPARE;
+	uint32_t step = 1;
+	uint32_t source = 0; // COLOR_R or COLOR_R_2
+	std::atomic<uint32_t> nextRow = { 0 };
+
+	void resize(uint32_t newWidth, uint32_t newHeight);
+	void runPass(Phase newPhase);
+	void processRows();
+	void prepareRow(uint32_t y);
+	void filterRow(uint32_t y);
+	void finishRow(uint32_t y);
+	size_t getIndex(uint32_t x, uint32_t y) const;
+	float getDepthGradient(uint32_t x, uint32_t y) const;
+	static glm::vec3 getDemodulationAlbedo(const glm::vec3 &albedo);
+};
\ No newline at end of file
@@ -2,14 +2,13 @@
 
 #include <glm/glm.hpp>
 
-class IMaterial;
-class IHitable;
+#include <stdint.h>
 
 struct HitRecord
 {
 	float t;
 	glm::vec3 p;
 	glm::vec3 normal;
-	const IMaterial *material;
-	IHitable *hit;
+	uint32_t materialId; // index in the MaterialTable of the scene
+	uint32_t objectId; // see IHitable::getObjectId
 };
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "HitableCollection.h"
 
+#include "AABB.h"
 #include "HitRecord.h"
+#include "Sphere.h"
 
 void HitableCollection::takeOwnershipOf(IHitable **newCollection)
 {
@@ -12,7 +14,44 @@ void HitableCollection::takeOwnershipOf(IHitable **newCollection)
 		}
 		delete[] collection;
 	}
+	spheres.clear();
+	references.clear();
 	collection = newCollection;
+	others = collection;
+	if (!collection)
+		return;
+
+	size_t remaining = 0;
+	for (size_t i = 0; collection[i] != nullptr; i++)
+	{
+		Sphere *sphere = dynamic_cast<Sphere *>(collection[i]);
+		if (sphere)
+		{
+			spheres.add(sphere->getCenter(), sphere->getRadius(), sphere->getMaterialId(), sphere->getObjectId());
+			delete sphere;
+		}
+		else
+			collection[remaining++] = collection[i];
+	}
+	collection[remaining] = nullptr;
+}
+
+void HitableCollection::build(IHitable *const *list)
+{
+	takeOwnershipOf(nullptr);
+	if (!list)
+		return;
+
+	for (size_t i = 0; list[i] != nullptr; i++)
+	{
+		const Sphere *sphere = dynamic_cast<const Sphere *>(list[i]);
+		if (sphere)
+			spheres.add(sphere->getCenter(), sphere->getRadius(), sphere->getMaterialId(), sphere->getObjectId());
+		else
+			references.push_back(list[i]);
+	}
+	references.push_back(nullptr);
+	others = references.data();
 }
 
 bool HitableCollection::hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const
@@ -20,15 +59,35 @@ bool HitableCollection::hit(const Ray& ray, const float minTime, const float max
 	HitRecord tmpRecord;
 	float closest = maxTime;
 	bool hasHitAnything = false;
-	for (size_t i = 0; collection[i] != nullptr; i++)
+	if (spheres.hit(ray, minTime, closest, tmpRecord))
+	{
+		hasHitAnything = true;
+		closest = tmpRecord.t;
+		record = tmpRecord;
+	}
+	for (size_t i = 0; others && others[i] != nullptr; i++)
 	{
-		if (collection[i]->hit(ray, minTime, closest, tmpRecord))
+		if (others[i]->hit(ray, minTime, closest, tmpRecord))
 		{
 			hasHitAnything = true;
 			closest = tmpRecord.t;
 			record = tmpRecord;
-			record.hit = collection[i];
 		}
 	}
 	return (hasHitAnything);
+}
+
+bool HitableCollection::boundingBox(AABB &box) const
+{
+	AABB tmpBox;
+	box = AABB();
+	if (spheres.boundingBox(tmpBox))
+		box.grow(tmpBox);
+	for (size_t i = 0; others && others[i] != nullptr; i++)
+	{
+		if (!others[i]->boundingBox(tmpBox))
+			return (false);
+		box.grow(tmpBox);
+	}
+	return (true);
 }
\ No newline at end of file
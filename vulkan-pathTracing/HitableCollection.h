@@ -1,13 +1,28 @@
 #pragma once
 
+#include <vector>
+
 #include "IHitable.h"
+#include "PackedSpheres.h"
 #include "Ray.h"
 
 class HitableCollection : public IHitable
 {
 	IHitable **collection = nullptr;
+	PackedSpheres spheres;
+	// Null-terminated, either collection or references.data().
+	IHitable *const *others = nullptr;
+	std::vector<IHitable *> references;
 
 public:
+	// Spheres are moved into the packed SIMD store, every other hitable
+	// stays in the null-terminated list.
 	void takeOwnershipOf(IHitable **newCollection);
+	// Same without taking ownership, for lists living in a SceneArena: the
+	// spheres are copied and the other hitables referenced.
+	void build(IHitable *const *list);
 	bool hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const override;
+	bool boundingBox(AABB &box) const override;
+
+	PackedSpheres &getSpheres() { return (spheres); }
 };
\ No newline at end of file
@@ -0,0 +1,15 @@
+#include "IHitable.h"
+
+#include "HitRecord.h"
+#include "RayPacket.h"
+
+uint32_t IHitable::hitPacket(const RayPacket &packet, float minTime, float maxTime, HitRecord *records) const
+{
+	uint32_t hitMask = 0;
+	for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+	{
+		if ((packet.activeMask & (1u << lane)) && hit(packet.rays[lane], minTime, maxTime, records[lane]))
+			hitMask |= 1u << lane;
+	}
+	return (hitMask);
+}
\ No newline at end of file
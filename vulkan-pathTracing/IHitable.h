@@ -1,11 +1,30 @@
 #pragma once
 
+#include <stdint.h>
+
 class Ray;
-class Material;
+struct AABB;
 struct HitRecord;
+struct RayPacket;
 
 class IHitable
 {
 public:
+	virtual ~IHitable() = default;
+
 	virtual bool hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const = 0;
+	virtual bool boundingBox(AABB &box) const = 0;
+	// Closest hit of every active ray of the packet, records holds
+	// RayPacket::SIZE entries. Returns the mask of the rays that hit. By
+	// default the rays are traced one by one.
+	virtual uint32_t hitPacket(const RayPacket &packet, float minTime, float maxTime, HitRecord *records) const;
+
+	// Identifies the hitable in the AOVs of a PathTracing, every hit copies
+	// it to HitRecord::objectId. PackedSpheres reports the id of each sphere
+	// instead and Instance its own over the one of its geometry.
+	uint32_t getObjectId() const { return (objectId); }
+	void setObjectId(uint32_t id) { objectId = id; }
+
+private:
+	uint32_t objectId = 0;
 };
\ No newline at end of file
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <stdint.h>
+
 struct PixelBlock;
 
 class IPixelBlockQueueOwner
 {
 public:
 	virtual bool queueCanContinue() = 0;
-	virtual void fillPixelBlock(PixelBlock &block) = 0;
+	// Describes block number blockIndex. Called concurrently by every worker,
+	// returns false once blockIndex is past the last block of the render.
+	virtual bool fillPixelBlock(uint32_t blockIndex, PixelBlock &block) = 0;
 };
\ No newline at end of file
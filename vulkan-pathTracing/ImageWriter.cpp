@@ -0,0 +1,205 @@
+#include "ImageWriter.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+	bool hasExtension(const std::string &path, const char *extension)
+	{
+		size_t length = strlen(extension);
+		if (path.size() < length)
+			return (false);
+		for (size_t i = 0; i < length; i++)
+		{
+			char c = path[path.size() - length + i];
+			if (c >= 'A' && c <= 'Z')
+				c = c - 'A' + 'a';
+			if (c != extension[i])
+				return (false);
+		}
+		return (true);
+	}
+
+	// EXR is little endian whatever the host is.
+	void appendBytes(std::vector<uint8_t> &out, uint64_t value, uint32_t size)
+	{
+		for (uint32_t i = 0; i < size; i++)
+			out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+	}
+
+	void appendFloat(std::vector<uint8_t> &out, float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		appendBytes(out, bits, 4);
+	}
+
+	void appendString(std::vector<uint8_t> &out, const char *str)
+	{
+		out.insert(out.end(), str, str + strlen(str) + 1);
+	}
+
+	void appendAttribute(std::vector<uint8_t> &out, const char *name, const char *type, uint32_t size)
+	{
+		appendString(out, name);
+		appendString(out, type);
+		appendBytes(out, size, 4);
+	}
+}
+
+bool ImageWriter::getFormatFromPath(const std::string &path, Format &format)
+{
+	if (hasExtension(path, ".ppm"))
+		format = Format::PPM;
+	else if (hasExtension(path, ".pfm"))
+		format = Format::PFM;
+	else if (hasExtension(path, ".exr"))
+		format = Format::EXR;
+	else
+		return (false);
+	return (true);
+}
+
+void ImageWriter::write(const std::string &path, Format format, const glm::vec3 *pic, uint32_t width, uint32_t height)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+		throw std::runtime_error("Unable to open " + path + " for writing.");
+
+	switch (format)
+	{
+	case Format::PPM:
+		writePPM(file, pic, width, height);
+		break;
+	case Format::PFM:
+		writePFM(file, pic, width, height);
+		break;
+	case Format::EXR:
+		writeEXR(file, pic, width, height);
+		break;
+	}
+
+	bool isValid = !ferror(file);
+	if (fclose(file) != 0 || !isValid)
+		throw std::runtime_error("Failed to write " + path + ".");
+}
+
+void ImageWriter::writePPM(FILE *file, const glm::vec3 *pic, uint32_t width, uint32_t height)
+{
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+	std::vector<uint8_t> row(width * 3);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const glm::vec3 *line = pic + (height - y - 1) * width;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				float value = std::min(std::max(line[x][c], 0.0f), 1.0f);
+				row[x * 3 + c] = static_cast<uint8_t>(value * 255.99f);
+			}
+		}
+		fwrite(row.data(), 1, row.size(), file);
+	}
+}
+
+// PFM rows go bottom to top, which is the order of the picture already. The
+// negative scale marks little endian data.
+void ImageWriter::writePFM(FILE *file, const glm::vec3 *pic, uint32_t width, uint32_t height)
+{
+	fprintf(file, "PF\n%u %u\n-1.0\n", width, height);
+
+	std::vector<uint8_t> row;
+	row.reserve(width * 12);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		row.clear();
+		for (uint32_t x = 0; x < width; x++)
+		{
+			for (uint32_t c = 0; c < 3; c++)
+				appendFloat(row, pic[x + y * width][c]);
+		}
+		fwrite(row.data(), 1, row.size(), file);
+	}
+}
+
+// Single part scanline OpenEXR without compression, one scanline per block
+// and three FLOAT channels stored in alphabetical order (B, G, R).
+void ImageWriter::writeEXR(FILE *file, const glm::vec3 *pic, uint32_t width, uint32_t height)
+{
+	static const char *channelNames[3] = { "B", "G", "R" };
+	static const uint32_t channelComponents[3] = { 2, 1, 0 };
+	static const uint32_t PIXEL_TYPE_FLOAT = 2;
+
+	std::vector<uint8_t> header;
+	appendBytes(header, 20000630, 4); // magic number
+	appendBytes(header, 2, 4); // version 2, scanline image
+
+	appendAttribute(header, "channels", "chlist", 3 * 18 + 1);
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		appendString(header, channelNames[c]);
+		appendBytes(header, PIXEL_TYPE_FLOAT, 4);
+		appendBytes(header, 0, 4); // pLinear and reserved bytes
+		appendBytes(header, 1, 4); // x sampling
+		appendBytes(header, 1, 4); // y sampling
+	}
+	header.push_back(0);
+
+	appendAttribute(header, "compression", "compression", 1);
+	header.push_back(0); // NO_COMPRESSION
+
+	for (const char *window : { "dataWindow", "displayWindow" })
+	{
+		appendAttribute(header, window, "box2i", 16);
+		appendBytes(header, 0, 4);
+		appendBytes(header, 0, 4);
+		appendBytes(header, width - 1, 4);
+		appendBytes(header, height - 1, 4);
+	}
+
+	appendAttribute(header, "lineOrder", "lineOrder", 1);
+	header.push_back(0); // INCREASING_Y
+
+	appendAttribute(header, "pixelAspectRatio", "float", 4);
+	appendFloat(header, 1);
+
+	appendAttribute(header, "screenWindowCenter", "v2f", 8);
+	appendFloat(header, 0);
+	appendFloat(header, 0);
+
+	appendAttribute(header, "screenWindowWidth", "float", 4);
+	appendFloat(header, 1);
+
+	header.push_back(0); // end of header
+
+	uint32_t dataSize = width * 3 * 4;
+	uint64_t offset = header.size() + static_cast<uint64_t>(height) * 8;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		appendBytes(header, offset, 8);
+		offset += 8 + dataSize;
+	}
+	fwrite(header.data(), 1, header.size(), file);
+
+	std::vector<uint8_t> block;
+	block.reserve(8 + dataSize);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const glm::vec3 *line = pic + (height - y - 1) * width;
+		block.clear();
+		appendBytes(block, y, 4);
+		appendBytes(block, dataSize, 4);
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+				appendFloat(block, line[x][channelComponents[c]]);
+		}
+		fwrite(block.data(), 1, block.size(), file);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+// Writes a PathTracing picture to disk. The picture is stored bottom row
+// first, as PathTracing::getPic returns it. PPM is clamped to [0, 1] and
+// quantized to 8 bits like the viewer does, PFM and EXR keep the raw 32-bit
+// floats.
+class ImageWriter
+{
+public:
+	enum class Format
+	{
+		PPM,
+		PFM,
+		EXR
+	};
+
+	// Picks the format from the file extension, returns false if unknown.
+	static bool getFormatFromPath(const std::string &path, Format &format);
+
+	// Throws std::runtime_error if the file can not be written.
+	static void write(const std::string &path, Format format, const glm::vec3 *pic, uint32_t width, uint32_t height);
+
+private:
+	static void writePPM(FILE *file, const glm::vec3 *pic, uint32_t width, uint32_t height);
+	static void writePFM(FILE *file, const glm::vec3 *pic, uint32_t width, uint32_t height);
+	static void writeEXR(FILE *file, const glm::vec3 *pic, uint32_t width, uint32_t height);
+};
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "Instance.h"
+
+#include <math.h>
+
+#include <stdexcept>
+#include <utility>
+
+#include "HitRecord.h"
+
+Instance::Instance(std::shared_ptr<const IHitable> geometry, const glm::mat3 &linear, const glm::vec3 &translation, uint32_t materialId)
+	: geometry(std::move(geometry)), materialId(materialId), translation(translation)
+{
+	if (glm::determinant(linear) == 0)
+		throw std::runtime_error("Unable to instance geometry with a singular transform.");
+	worldToObject = glm::inverse(linear);
+	normalToWorld = glm::transpose(worldToObject);
+
+	AABB local;
+	if (!this->geometry->boundingBox(local))
+		throw std::runtime_error("Unable to instance an unbounded hitable.");
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 p((corner & 1) ? local.max.x : local.min.x,
+			(corner & 2) ? local.max.y : local.min.y,
+			(corner & 4) ? local.max.z : local.min.z);
+		box.grow(linear * p + translation);
+	}
+}
+
+glm::mat3 Instance::rotation(const glm::vec3 &degrees)
+{
+	glm::vec3 angles(glm::radians(degrees.x), glm::radians(degrees.y), glm::radians(degrees.z));
+	float cx = cosf(angles.x), sx = sinf(angles.x);
+	float cy = cosf(angles.y), sy = sinf(angles.y);
+	float cz = cosf(angles.z), sz = sinf(angles.z);
+	// Columns of the matrices, glm is column major.
+	glm::mat3 rotationX(glm::vec3(1, 0, 0), glm::vec3(0, cx, sx), glm::vec3(0, -sx, cx));
+	glm::mat3 rotationY(glm::vec3(cy, 0, -sy), glm::vec3(0, 1, 0), glm::vec3(sy, 0, cy));
+	glm::mat3 rotationZ(glm::vec3(cz, sz, 0), glm::vec3(-sz, cz, 0), glm::vec3(0, 0, 1));
+	return (rotationZ * rotationY * rotationX);
+}
+
+bool Instance::hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const
+{
+	Ray local(worldToObject * (ray.getOrigin() - translation), worldToObject * ray.getDirection());
+	if (!geometry->hit(local, minTime, maxTime, record))
+		return (false);
+
+	record.p = ray.pointAtTime(record.t);
+	record.normal = glm::normalize(normalToWorld * record.normal);
+	if (materialId != MaterialTable::NONE)
+		record.materialId = materialId;
+	record.objectId = getObjectId();
+	return (true);
+}
+
+bool Instance::boundingBox(AABB &box) const
+{
+	box = this->box;
+	return (true);
+}
\ No newline at end of file
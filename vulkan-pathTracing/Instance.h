@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "AABB.h"
+#include "IHitable.h"
+#include "MaterialTable.h"
+
+// Places shared geometry in the world with an affine transform. The
+// geometry, usually a TriangleMesh or a BVH over a group of primitives,
+// keeps its own acceleration structure in object space and is referenced
+// by every instance of it, so a BVH over instances forms the top level of
+// a two-level hierarchy: repeating an object costs one Instance, not a copy
+// of its primitives.
+//
+// Rays are moved to object space without being normalized, so the hit time
+// found by the geometry is also the world space one.
+class Instance : public IHitable
+{
+public:
+	// linear is the object to world rotation and scale, it must be
+	// invertible. A material replaces the one of the geometry,
+	// MaterialTable::NONE keeps it. Throws std::runtime_error on a
+	// singular transform or an unbounded geometry.
+	Instance(std::shared_ptr<const IHitable> geometry, const glm::mat3 &linear, const glm::vec3 &translation, uint32_t materialId = MaterialTable::NONE);
+
+	// Rotation by the given angles in degrees around X, then Y, then Z.
+	static glm::mat3 rotation(const glm::vec3 &degrees);
+
+	const IHitable &getGeometry() const { return (*geometry); }
+
+	bool hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const override;
+	bool boundingBox(AABB &box) const override;
+
+private:
+	std::shared_ptr<const IHitable> geometry;
+	uint32_t materialId;
+	glm::mat3 worldToObject;
+	glm::mat3 normalToWorld; // inverse transpose of the linear part
+	glm::vec3 translation;
+	AABB box;
+};
\ No newline at end of file
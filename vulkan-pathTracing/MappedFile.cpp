@@ -0,0 +1,95 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# define NOMINMAX
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &path)
+{
+	close();
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return (false);
+
+	LARGE_INTEGER fileSize;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return (false);
+	}
+	data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return (false);
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+	fileHandle = file;
+	mappingHandle = mapping;
+	return (true);
+}
+
+void MappedFile::close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle)
+		CloseHandle(fileHandle);
+	data = nullptr;
+	size = 0;
+	fileHandle = nullptr;
+	mappingHandle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string &path)
+{
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return (false);
+
+	struct stat info;
+	void *mapping = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+		mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file.
+	::close(fd);
+	if (mapping == MAP_FAILED)
+		return (false);
+
+	data = static_cast<const uint8_t *>(mapping);
+	size = static_cast<size_t>(info.st_size);
+	return (true);
+}
+
+void MappedFile::close()
+{
+	if (data)
+		munmap(const_cast<uint8_t *>(data), size);
+	data = nullptr;
+	size = 0;
+}
+
+#endif
\ No newline at end of file
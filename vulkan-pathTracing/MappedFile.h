@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// Read-only memory mapping of a whole file, unmapped on destruction.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile &ref) = delete;
+	MappedFile &operator=(const MappedFile &ref) = delete;
+	~MappedFile();
+
+	// Returns false if the file can not be opened or is empty.
+	bool open(const std::string &path);
+	void close();
+
+	const uint8_t *getData() const { return (data); }
+	size_t getSize() const { return (size); }
+
+private:
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void *fileHandle = nullptr;
+	void *mappingHandle = nullptr;
+#endif
+};
\ No newline at end of file
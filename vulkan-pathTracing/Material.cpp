@@ -1,19 +1,29 @@
 #include "Material.h"
 
-#include "ctmRand.h"
+#include <glm/gtc/constants.hpp>
+
+#include <math.h>
+
 #include "HitRecord.h"
+#include "MaterialTable.h"
+#include "RayStream.h"
+#include "Sampler.h"
 
 namespace
 {
-	glm::vec3 randomInUnitSphere()
+	// Direct warps of uniform numbers, every sample point maps to exactly
+	// one direction so the stratification of the sampler carries over.
+	glm::vec3 uniformOnSphere(float u1, float u2)
+	{
+		float z = 1 - 2 * u1;
+		float r = sqrtf(glm::max(0.0f, 1 - z * z));
+		float phi = 2 * glm::pi<float>() * u2;
+		return (glm::vec3(r * cosf(phi), r * sinf(phi), z));
+	}
+
+	glm::vec3 uniformInBall(const glm::vec3 &u)
 	{
-		glm::vec3 p;
-		do {
-			p = 2.0f * glm::vec3(ctmRand(),
-				ctmRand(),
-				ctmRand()) - glm::vec3(1, 1, 1);
-		} while (glm::length(p) >= 1);
-		return (p);
+		return (uniformOnSphere(u.x, u.y) * cbrtf(u.z));
 	}
 
 	glm::vec3 reflect(const glm::vec3& v, const glm::vec3& n)
@@ -40,68 +50,133 @@ namespace
 		r0 = r0 * r0;
 		return (r0 + (1 - r0) * pow(1 - cosine, 5));
 	}
-}
 
-Lambert::Lambert(const glm::vec3& albedo)
-	: albedo(albedo)
-{}
+	// The normal plus a point on the unit sphere gives exactly the cosine
+	// distribution that lambertPdf describes.
+	bool scatterLambert(const Material &material, const HitRecord& hit, const glm::vec3 &u, glm::vec3& attenuation, Ray& scattered)
+	{
+		glm::vec3 direction = hit.normal + uniformOnSphere(u.x, u.y);
+		if (glm::dot(direction, direction) < 1e-8f)
+			direction = hit.normal;
+		scattered = Ray(hit.p, direction);
+		attenuation = material.albedo;
+		return (true);
+	}
+
+	bool scatterMetal(const Material &material, const Ray& in, const HitRecord& hit, const glm::vec3 &u, glm::vec3& attenuation, Ray& scattered)
+	{
+		glm::vec3 reflected = reflect(glm::normalize(in.getDirection()), hit.normal);
+		scattered = Ray(hit.p, reflected + material.parameter * uniformInBall(u));
+		attenuation = material.albedo;
+		return (glm::dot(scattered.getDirection(), hit.normal) > 0);
+	}
+
+	bool scatterDialectric(const Material &material, const Ray& in, const HitRecord& hit, const glm::vec3 &u, glm::vec3& attenuation, Ray& scattered)
+	{
+		float ri = material.parameter;
+		glm::vec3 outwardNormal;
+		glm::vec3 reflected = reflect(in.getDirection(), hit.normal);
+		float ni_over_nt;
+		attenuation = glm::vec3(1, 1, 1);
+		glm::vec3 refracted;
+		float reflectProb;
+		float cosine;
+		if (glm::dot(in.getDirection(), hit.normal) > 0)
+		{
+			outwardNormal = -hit.normal;
+			ni_over_nt = ri;
+			cosine = glm::dot(in.getDirection(), hit.normal) / in.getDirection().length();
+			//cosine = glm::sqrt(1 - _ri * _ri * (1 - cosine * cosine));
+		}
+		else
+		{
+			outwardNormal = hit.normal;
+			ni_over_nt = 1 / ri;
+			cosine = -glm::dot(in.getDirection(), hit.normal) / in.getDirection().length();
+		}
+		if (refract(in.getDirection(), outwardNormal, ni_over_nt, refracted))
+			reflectProb = schlick(cosine, ri);
+		else
+			reflectProb = 1;
+		if (u.x < reflectProb)
+			scattered = Ray(hit.p, reflected);
+		else
+			scattered = Ray(hit.p, refracted);
+		return (true);
+	}
 
-bool Lambert::scatter(const Ray& in, const HitRecord& hit, glm::vec3& attenuation, Ray& scattered) const
+	template <Material::Type TYPE>
+	bool scatterType(const Material &material, const Ray& in, const HitRecord& hit, const glm::vec3 &u, glm::vec3& attenuation, Ray& scattered)
+	{
+		switch (TYPE)
+		{
+		case Material::Type::LAMBERT:
+			return (scatterLambert(material, hit, u, attenuation, scattered));
+		case Material::Type::METAL:
+			return (scatterMetal(material, in, hit, u, attenuation, scattered));
+		case Material::Type::DIALECTRIC:
+			return (scatterDialectric(material, in, hit, u, attenuation, scattered));
+		default:
+			return (false);
+		}
+	}
+}
+
+Material Material::lambert(const glm::vec3 &albedo)
 {
-	glm::vec3 target = hit.p + hit.normal + randomInUnitSphere();
-	scattered = Ray(hit.p, target - hit.p);
-	attenuation = albedo;
-	return (true);
+	return (Material{ Type::LAMBERT, albedo, 0 });
 }
 
-Metal::Metal(const glm::vec3& albedo, const float fuzz)
-	: albedo(albedo), fuzz(fuzz)
+Material Material::metal(const glm::vec3 &albedo, float fuzz)
 {
-	if (fuzz >= 1)
-		this->fuzz = 1;
+	return (Material{ Type::METAL, albedo, fuzz < 1 ? fuzz : 1 });
 }
 
-bool Metal::scatter(const Ray& in, const HitRecord& hit, glm::vec3& attenuation, Ray& scattered) const
+Material Material::dialectric(float ri)
 {
-	glm::vec3 reflected = reflect(glm::normalize(in.getDirection()), hit.normal);
-	scattered = Ray(hit.p, reflected + fuzz * randomInUnitSphere());
-	attenuation = albedo;
-	return (glm::dot(scattered.getDirection(), hit.normal) > 0);
+	return (Material{ Type::DIALECTRIC, glm::vec3(0, 0, 0), ri });
 }
 
-Dialectric::Dialectric(const float ri)
-	: ri(ri)
-{}
+Material Material::emissive(const glm::vec3 &radiance)
+{
+	return (Material{ Type::EMISSIVE, radiance, 0 });
+}
 
-bool Dialectric::scatter(const Ray& in, const HitRecord& hit, glm::vec3& attenuation, Ray& scattered) const
+bool Material::scatter(const Ray& in, const HitRecord& hit, const glm::vec3 &u, glm::vec3& attenuation, Ray& scattered) const
 {
-	glm::vec3 outwardNormal;
-	glm::vec3 reflected = reflect(in.getDirection(), hit.normal);
-	float ni_over_nt;
-	attenuation = glm::vec3(1, 1, 1);
-	glm::vec3 refracted;
-	float reflectProb;
-	float cosine;
-	if (glm::dot(in.getDirection(), hit.normal) > 0)
+	switch (type)
 	{
-		outwardNormal = -hit.normal;
-		ni_over_nt = ri;
-		cosine = glm::dot(in.getDirection(), hit.normal) / in.getDirection().length();
-		//cosine = glm::sqrt(1 - _ri * _ri * (1 - cosine * cosine));
+	case Type::LAMBERT:
+		return (scatterType<Type::LAMBERT>(*this, in, hit, u, attenuation, scattered));
+	case Type::METAL:
+		return (scatterType<Type::METAL>(*this, in, hit, u, attenuation, scattered));
+	case Type::DIALECTRIC:
+		return (scatterType<Type::DIALECTRIC>(*this, in, hit, u, attenuation, scattered));
+	default:
+		return (false);
 	}
-	else
+}
+
+float Material::lambertPdf(const glm::vec3 &normal, const glm::vec3 &direction)
+{
+	float cosine = glm::dot(normal, glm::normalize(direction));
+	return (cosine > 0 ? cosine / glm::pi<float>() : 0);
+}
+
+template <Material::Type TYPE>
+void Material::scatterStream(const MaterialTable &materials, RayStream &stream, const uint32_t *paths, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
 	{
-		outwardNormal = hit.normal;
-		ni_over_nt = 1 / ri;
-		cosine = -glm::dot(in.getDirection(), hit.normal) / in.getDirection().length();
+		uint32_t path = paths[i];
+		const HitRecord &hit = stream.records[path];
+		Ray in = stream.rays[path];
+		stream.isScattered[path] = scatterType<TYPE>(materials[hit.materialId], in, hit,
+			stream.samplers[path].get3D(Sampler::SCATTER), stream.attenuations[path], stream.rays[path]);
 	}
-	if (refract(in.getDirection(), outwardNormal, ni_over_nt, refracted))
-		reflectProb = schlick(cosine, ri);
-	else
-		reflectProb = 1;
-	if (ctmRand() < reflectProb)
-		scattered = Ray(hit.p, reflected);
-	else
-		scattered = Ray(hit.p, refracted);
-	return (true);
-}
\ No newline at end of file
+}
+
+template void Material::scatterStream<Material::Type::LAMBERT>(const MaterialTable &, RayStream &, const uint32_t *, uint32_t);
+template void Material::scatterStream<Material::Type::METAL>(const MaterialTable &, RayStream &, const uint32_t *, uint32_t);
+template void Material::scatterStream<Material::Type::DIALECTRIC>(const MaterialTable &, RayStream &, const uint32_t *, uint32_t);
+template void Material::scatterStream<Material::Type::EMISSIVE>(const MaterialTable &, RayStream &, const uint32_t *, uint32_t);
\ No newline at end of file
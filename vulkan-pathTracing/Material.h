@@ -2,42 +2,53 @@
 
 #include <glm/glm.hpp>
 
-#include "Ray.h"
-#include "IHitable.h"
-
-class IMaterial
-{
-public:
-	virtual	bool scatter(const Ray& in, const HitRecord& hit, glm::vec3& attenuation, Ray& scattered) const = 0;
-};
-
-class Lambert : public IMaterial
-{
-	glm::vec3 albedo;
-
-public:
-	Lambert(const glm::vec3& albedo);
-	
-	bool scatter(const Ray& in, const HitRecord& hit, glm::vec3& attenuation, Ray& scattered) const override;
-};
+#include <stdint.h>
 
-class Metal : public IMaterial
-{
-	glm::vec3 albedo;
-	float fuzz;
-
-public:
-	Metal(const glm::vec3& albedo, const float fuzz);
+#include "Ray.h"
 
-	bool scatter(const Ray& in, const HitRecord& hit, glm::vec3& attenuation, Ray& scattered) const override;
-};
+class MaterialTable;
+struct HitRecord;
+struct RayStream;
 
-class Dialectric : public IMaterial
+// Plain material parameters, stored by value in a MaterialTable and
+// referenced from the primitives by their index in it. Scattering switches
+// on the type tag instead of going through a vtable, so the few bytes of
+// every material a frame touches stay in cache.
+struct Material
 {
-	float ri;
-
-public:
-	Dialectric(const float ri);
-
-	bool scatter(const Ray& in, const HitRecord& hit, glm::vec3& attenuation, Ray& scattered) const override;
+	// Also used by the wavefront integrator to group hits before running
+	// the batched scatter kernel of each type.
+	enum class Type : uint32_t
+	{
+		LAMBERT,
+		METAL,
+		DIALECTRIC,
+		EMISSIVE,
+		COUNT
+	};
+
+	Type type;
+	glm::vec3 albedo; // emitted radiance of an Emissive, unused by Dialectric
+	float parameter; // fuzz of a Metal, refraction index of a Dialectric
+
+	static Material lambert(const glm::vec3 &albedo);
+	// The fuzz is clamped to 1.
+	static Material metal(const glm::vec3 &albedo, float fuzz);
+	static Material dialectric(float ri);
+	// Emits the same radiance on both sides and in every direction, absorbs
+	// every ray.
+	static Material emissive(const glm::vec3 &radiance);
+
+	// u holds the uniform numbers of the Sampler::SCATTER dimensions: a
+	// Lambert warps the first two to a direction, a Metal all three to its
+	// fuzz, a Dialectric picks reflection or refraction with the first one.
+	bool scatter(const Ray& in, const HitRecord& hit, const glm::vec3 &u, glm::vec3& attenuation, Ray& scattered) const;
+	// Solid angle density of the scattered directions of a Lambert, they
+	// are cosine distributed around the normal.
+	static float lambertPdf(const glm::vec3 &normal, const glm::vec3 &direction);
+
+	// Scatters stream.rays[path] for each path of the list. Every path must
+	// have hit a material of type TYPE, which is resolved at compile time.
+	template <Type TYPE>
+	static void scatterStream(const MaterialTable &materials, RayStream &stream, const uint32_t *paths, uint32_t count);
 };
\ No newline at end of file
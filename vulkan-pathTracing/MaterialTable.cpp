@@ -0,0 +1,45 @@
+#include "MaterialTable.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <string>
+
+constexpr uint32_t MaterialTable::NONE;
+
+namespace
+{
+	uint32_t getBits(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return (bits);
+	}
+}
+
+uint32_t MaterialTable::add(const Material &material)
+{
+	uint32_t type = static_cast<uint32_t>(material.type);
+	if (type >= static_cast<uint32_t>(Material::Type::COUNT))
+		throw std::runtime_error("Invalid material type " + std::to_string(type) + ".");
+	if (isnan(material.albedo.x) || isnan(material.albedo.y) || isnan(material.albedo.z) || isnan(material.parameter))
+		throw std::runtime_error("NaN in material of type " + std::to_string(type) + ".");
+
+	// Bit patterns keep the ordering strict, 0 and -0 stay distinct.
+	Key key(type, getBits(material.albedo.x), getBits(material.albedo.y), getBits(material.albedo.z), getBits(material.parameter));
+	auto it = lookup.find(key);
+	if (it != lookup.end())
+		return (it->second);
+
+	uint32_t id = static_cast<uint32_t>(materials.size());
+	materials.push_back(material);
+	lookup[key] = id;
+	return (id);
+}
+
+void MaterialTable::clear()
+{
+	materials.clear();
+	lookup.clear();
+}
\ No newline at end of file
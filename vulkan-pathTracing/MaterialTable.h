@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "Material.h"
+
+// Contiguous store of every material of a scene. Primitives keep the 32 bit
+// id returned by add and the integrator looks it up when shading. Adding a
+// material equal to an existing one, compared bit for bit, returns the
+// existing id.
+class MaterialTable
+{
+public:
+	// Geometry only drawn through instances, which always set a material,
+	// has none of its own.
+	static constexpr uint32_t NONE = 0xffffffff;
+
+	// Throws std::runtime_error for a type outside Material::Type or a NaN
+	// albedo or parameter, which no integrator could shade.
+	uint32_t add(const Material &material);
+	void clear();
+
+	const Material &operator[](uint32_t id) const { return (materials[id]); }
+	uint32_t size() const { return (static_cast<uint32_t>(materials.size())); }
+
+private:
+	using Key = std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, uint32_t>;
+
+	std::vector<Material> materials;
+	std::map<Key, uint32_t> lookup;
+};
\ No newline at end of file
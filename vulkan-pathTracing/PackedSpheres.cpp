@@ -0,0 +1,473 @@
+#include "PackedSpheres.h"
+
+#include <cmath>
+#include <limits>
+
+#include "AABB.h"
+#include "HitRecord.h"
+#include "Ray.h"
+#include "RenderStats.h"
+
+// The SIMD kernels must not be fused into FMAs or they would stop matching
+// the scalar path bit for bit.
+#if defined(__clang__)
+# pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+# pragma GCC optimize("fp-contract=off")
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+# define PACKED_SPHERES_X86
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+#  define TARGET_AVX2
+#  define TARGET_AVX512
+# else
+#  include <cpuid.h>
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+#  define TARGET_AVX512 __attribute__((target("avx512f")))
+# endif
+#endif
+
+namespace
+{
+	const float PADDING_VALUE = std::numeric_limits<float>::quiet_NaN();
+
+#ifdef PACKED_SPHERES_X86
+	void cpuid(int info[4], int leaf, int subleaf)
+	{
+#ifdef _MSC_VER
+		__cpuidex(info, leaf, subleaf);
+#else
+		__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+	}
+
+	uint64_t xgetbv()
+	{
+#ifdef _MSC_VER
+		return (_xgetbv(0));
+#else
+		uint32_t eax;
+		uint32_t edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((static_cast<uint64_t>(edx) << 32) | eax);
+#endif
+	}
+
+	// Picks the lane with the smallest t, the lowest sphere index on ties,
+	// which is what the scalar loop returns with its strict comparison.
+	int32_t reduceLanes(const float *laneT, const int32_t *laneIndex, uint32_t width, float &t)
+	{
+		int32_t best = -1;
+		for (uint32_t i = 0; i < width; i++)
+		{
+			if (laneIndex[i] < 0)
+				continue;
+			if (best < 0 || laneT[i] < t || (laneT[i] == t && laneIndex[i] < best))
+			{
+				best = laneIndex[i];
+				t = laneT[i];
+			}
+		}
+		return (best);
+	}
+#endif
+}
+
+PackedSpheres::PackedSpheres()
+{
+	simdLevel = getSupportedSimdLevel();
+}
+
+PackedSpheres::SimdLevel PackedSpheres::getSupportedSimdLevel()
+{
+#ifdef PACKED_SPHERES_X86
+	static const SimdLevel supported = []()
+	{
+		int info[4];
+		cpuid(info, 0, 0);
+		int maxLeaf = info[0];
+
+		cpuid(info, 1, 0);
+		bool hasSSE2 = (info[3] & (1 << 26)) != 0;
+		bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+		bool hasAVX = (info[2] & (1 << 28)) != 0;
+		if (!hasSSE2)
+			return (SimdLevel::SCALAR);
+		if (!hasOSXSAVE || !hasAVX || maxLeaf < 7)
+			return (SimdLevel::SSE);
+
+		uint64_t xcr0 = xgetbv();
+		cpuid(info, 7, 0);
+		bool hasAVX2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+		bool hasAVX512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+		if (hasAVX512)
+			return (SimdLevel::AVX512);
+		if (hasAVX2)
+			return (SimdLevel::AVX2);
+		return (SimdLevel::SSE);
+	}();
+	return (supported);
+#else
+	return (SimdLevel::SCALAR);
+#endif
+}
+
+const char *PackedSpheres::getSimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::SSE:
+		return ("SSE");
+	case SimdLevel::AVX2:
+		return ("AVX2");
+	case SimdLevel::AVX512:
+		return ("AVX-512");
+	default:
+		return ("scalar");
+	}
+}
+
+void PackedSpheres::add(const glm::vec3 &center, float sphereRadius, uint32_t sphereMaterialId, uint32_t sphereObjectId)
+{
+	if (centerX != ownedCenterX.data())
+	{
+		// Adding to an attached store starts a new owned one.
+		clear();
+	}
+	if (count == ownedCenterX.size())
+	{
+		size_t newSize = ownedCenterX.size() + PADDING;
+		ownedCenterX.resize(newSize, PADDING_VALUE);
+		ownedCenterY.resize(newSize, PADDING_VALUE);
+		ownedCenterZ.resize(newSize, PADDING_VALUE);
+		ownedRadius2.resize(newSize, PADDING_VALUE);
+		ownedRadius.resize(newSize, PADDING_VALUE);
+		ownedMaterialId.resize(newSize, 0);
+		ownedObjectId.resize(newSize, 0);
+	}
+
+	ownedCenterX[count] = center.x;
+	ownedCenterY[count] = center.y;
+	ownedCenterZ[count] = center.z;
+	ownedRadius2[count] = sphereRadius * sphereRadius;
+	ownedRadius[count] = sphereRadius;
+	ownedMaterialId[count] = sphereMaterialId;
+	ownedObjectId[count] = sphereObjectId;
+	count += 1;
+	useOwnedArrays();
+}
+
+void PackedSpheres::clear()
+{
+	count = 0;
+	ownedCenterX.clear();
+	ownedCenterY.clear();
+	ownedCenterZ.clear();
+	ownedRadius2.clear();
+	ownedRadius.clear();
+	ownedMaterialId.clear();
+	ownedObjectId.clear();
+	useOwnedArrays();
+}
+
+void PackedSpheres::attach(uint32_t sphereCount, const float *newCenterX, const float *newCenterY, const float *newCenterZ,
+	const float *newRadius2, const float *newRadius, const uint32_t *newMaterialId, const uint32_t *newObjectId)
+{
+	clear();
+	count = sphereCount;
+	centerX = newCenterX;
+	centerY = newCenterY;
+	centerZ = newCenterZ;
+	radius2 = newRadius2;
+	radius = newRadius;
+	materialId = newMaterialId;
+	objectId = newObjectId;
+}
+
+void PackedSpheres::useOwnedArrays()
+{
+	centerX = ownedCenterX.data();
+	centerY = ownedCenterY.data();
+	centerZ = ownedCenterZ.data();
+	radius2 = ownedRadius2.data();
+	radius = ownedRadius.data();
+	materialId = ownedMaterialId.data();
+	objectId = ownedObjectId.data();
+}
+
+void PackedSpheres::setSimdLevel(SimdLevel level)
+{
+	SimdLevel supported = getSupportedSimdLevel();
+	simdLevel = static_cast<int>(level) > static_cast<int>(supported) ? supported : level;
+}
+
+bool PackedSpheres::hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const
+{
+	float t;
+	int32_t i = closestHit(ray, minTime, maxTime, t);
+	if (i < 0)
+		return (false);
+
+	record.t = t;
+	record.p = ray.pointAtTime(t);
+	record.normal = (record.p - glm::vec3(centerX[i], centerY[i], centerZ[i])) / radius[i];
+	record.materialId = materialId[i];
+	record.objectId = objectId[i];
+	return (true);
+}
+
+bool PackedSpheres::boundingBox(AABB &box) const
+{
+	if (count == 0)
+		return (false);
+	box = AABB();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		glm::vec3 center(centerX[i], centerY[i], centerZ[i]);
+		glm::vec3 extent(radius[i], radius[i], radius[i]);
+		box.grow(AABB(center - extent, center + extent));
+	}
+	return (true);
+}
+
+int32_t PackedSpheres::closestHit(const Ray &ray, const float minTime, const float maxTime, float &t) const
+{
+	if (RenderStats *stats = RenderStats::getThreadStats())
+		stats->primitiveTests += count;
+	switch (simdLevel)
+	{
+	case SimdLevel::AVX512:
+		return (closestHitAVX512(ray, minTime, maxTime, t));
+	case SimdLevel::AVX2:
+		return (closestHitAVX2(ray, minTime, maxTime, t));
+	case SimdLevel::SSE:
+		return (closestHitSSE(ray, minTime, maxTime, t));
+	default:
+		return (closestHitScalar(ray, minTime, maxTime, t));
+	}
+}
+
+// Reference implementation. Every SIMD kernel below mirrors these operations
+// one for one, so keep them in sync (and keep fp contraction off).
+int32_t PackedSpheres::closestHitScalar(const Ray &ray, const float minTime, const float maxTime, float &t) const
+{
+	const glm::vec3 &origin = ray.getOrigin();
+	const glm::vec3 &direction = ray.getDirection();
+	float a = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+
+	int32_t best = -1;
+	float closest = maxTime;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float ocx = origin.x - centerX[i];
+		float ocy = origin.y - centerY[i];
+		float ocz = origin.z - centerZ[i];
+		float b = ocx * direction.x + ocy * direction.y + ocz * direction.z;
+		float c = ocx * ocx + ocy * ocy + ocz * ocz - radius2[i];
+		float discriminant = b * b - a * c;
+		if (discriminant > 0)
+		{
+			float root = std::sqrt(discriminant);
+			float temp1 = (-b - root) / a;
+			float temp2 = (-b + root) / a;
+			float temp = (minTime < temp1 && temp1 < maxTime) ? temp1 : temp2;
+			if (minTime < temp && temp < maxTime && temp < closest)
+			{
+				closest = temp;
+				best = static_cast<int32_t>(i);
+			}
+		}
+	}
+	t = closest;
+	return (best);
+}
+
+#ifdef PACKED_SPHERES_X86
+
+int32_t PackedSpheres::closestHitSSE(const Ray &ray, const float minTime, const float maxTime, float &t) const
+{
+	const glm::vec3 &origin = ray.getOrigin();
+	const glm::vec3 &direction = ray.getDirection();
+	float a = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+
+	const __m128 ox = _mm_set1_ps(origin.x);
+	const __m128 oy = _mm_set1_ps(origin.y);
+	const __m128 oz = _mm_set1_ps(origin.z);
+	const __m128 dx = _mm_set1_ps(direction.x);
+	const __m128 dy = _mm_set1_ps(direction.y);
+	const __m128 dz = _mm_set1_ps(direction.z);
+	const __m128 va = _mm_set1_ps(a);
+	const __m128 vmin = _mm_set1_ps(minTime);
+	const __m128 vmax = _mm_set1_ps(maxTime);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128i step = _mm_set1_epi32(4);
+
+	__m128 bestT = vmax;
+	__m128i bestIndex = _mm_set1_epi32(-1);
+	__m128i index = _mm_setr_epi32(0, 1, 2, 3);
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		__m128 ocx = _mm_sub_ps(ox, _mm_loadu_ps(&centerX[i]));
+		__m128 ocy = _mm_sub_ps(oy, _mm_loadu_ps(&centerY[i]));
+		__m128 ocz = _mm_sub_ps(oz, _mm_loadu_ps(&centerZ[i]));
+		__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+		__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)),
+			_mm_loadu_ps(&radius2[i]));
+		__m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(va, c));
+		__m128 root = _mm_sqrt_ps(discriminant);
+		__m128 minusB = _mm_xor_ps(b, signMask);
+		__m128 temp1 = _mm_div_ps(_mm_sub_ps(minusB, root), va);
+		__m128 temp2 = _mm_div_ps(_mm_add_ps(minusB, root), va);
+
+		__m128 isTemp1Valid = _mm_and_ps(_mm_cmplt_ps(vmin, temp1), _mm_cmplt_ps(temp1, vmax));
+		__m128 temp = _mm_or_ps(_mm_and_ps(isTemp1Valid, temp1), _mm_andnot_ps(isTemp1Valid, temp2));
+		__m128 isCloser = _mm_and_ps(_mm_cmpgt_ps(discriminant, zero),
+			_mm_and_ps(_mm_and_ps(_mm_cmplt_ps(vmin, temp), _mm_cmplt_ps(temp, vmax)), _mm_cmplt_ps(temp, bestT)));
+
+		bestT = _mm_or_ps(_mm_and_ps(isCloser, temp), _mm_andnot_ps(isCloser, bestT));
+		__m128i isCloserInt = _mm_castps_si128(isCloser);
+		bestIndex = _mm_or_si128(_mm_and_si128(isCloserInt, index), _mm_andnot_si128(isCloserInt, bestIndex));
+		index = _mm_add_epi32(index, step);
+	}
+
+	alignas(16) float laneT[4];
+	alignas(16) int32_t laneIndex[4];
+	_mm_store_ps(laneT, bestT);
+	_mm_store_si128(reinterpret_cast<__m128i *>(laneIndex), bestIndex);
+	t = maxTime;
+	return (reduceLanes(laneT, laneIndex, 4, t));
+}
+
+TARGET_AVX2
+int32_t PackedSpheres::closestHitAVX2(const Ray &ray, const float minTime, const float maxTime, float &t) const
+{
+	const glm::vec3 &origin = ray.getOrigin();
+	const glm::vec3 &direction = ray.getDirection();
+	float a = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+
+	const __m256 ox = _mm256_set1_ps(origin.x);
+	const __m256 oy = _mm256_set1_ps(origin.y);
+	const __m256 oz = _mm256_set1_ps(origin.z);
+	const __m256 dx = _mm256_set1_ps(direction.x);
+	const __m256 dy = _mm256_set1_ps(direction.y);
+	const __m256 dz = _mm256_set1_ps(direction.z);
+	const __m256 va = _mm256_set1_ps(a);
+	const __m256 vmin = _mm256_set1_ps(minTime);
+	const __m256 vmax = _mm256_set1_ps(maxTime);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const __m256i step = _mm256_set1_epi32(8);
+
+	__m256 bestT = vmax;
+	__m256i bestIndex = _mm256_set1_epi32(-1);
+	__m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	for (uint32_t i = 0; i < count; i += 8)
+	{
+		__m256 ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(&centerX[i]));
+		__m256 ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(&centerY[i]));
+		__m256 ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(&centerZ[i]));
+		__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+		__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)),
+			_mm256_loadu_ps(&radius2[i]));
+		__m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(va, c));
+		__m256 root = _mm256_sqrt_ps(discriminant);
+		__m256 minusB = _mm256_xor_ps(b, signMask);
+		__m256 temp1 = _mm256_div_ps(_mm256_sub_ps(minusB, root), va);
+		__m256 temp2 = _mm256_div_ps(_mm256_add_ps(minusB, root), va);
+
+		__m256 isTemp1Valid = _mm256_and_ps(_mm256_cmp_ps(vmin, temp1, _CMP_LT_OQ), _mm256_cmp_ps(temp1, vmax, _CMP_LT_OQ));
+		__m256 temp = _mm256_blendv_ps(temp2, temp1, isTemp1Valid);
+		__m256 isCloser = _mm256_and_ps(_mm256_cmp_ps(discriminant, zero, _CMP_GT_OQ),
+			_mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(vmin, temp, _CMP_LT_OQ), _mm256_cmp_ps(temp, vmax, _CMP_LT_OQ)),
+				_mm256_cmp_ps(temp, bestT, _CMP_LT_OQ)));
+
+		bestT = _mm256_blendv_ps(bestT, temp, isCloser);
+		bestIndex = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIndex), _mm256_castsi256_ps(index), isCloser));
+		index = _mm256_add_epi32(index, step);
+	}
+
+	alignas(32) float laneT[8];
+	alignas(32) int32_t laneIndex[8];
+	_mm256_store_ps(laneT, bestT);
+	_mm256_store_si256(reinterpret_cast<__m256i *>(laneIndex), bestIndex);
+	t = maxTime;
+	return (reduceLanes(laneT, laneIndex, 8, t));
+}
+
+TARGET_AVX512
+int32_t PackedSpheres::closestHitAVX512(const Ray &ray, const float minTime, const float maxTime, float &t) const
+{
+	const glm::vec3 &origin = ray.getOrigin();
+	const glm::vec3 &direction = ray.getDirection();
+	float a = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+
+	const __m512 ox = _mm512_set1_ps(origin.x);
+	const __m512 oy = _mm512_set1_ps(origin.y);
+	const __m512 oz = _mm512_set1_ps(origin.z);
+	const __m512 dx = _mm512_set1_ps(direction.x);
+	const __m512 dy = _mm512_set1_ps(direction.y);
+	const __m512 dz = _mm512_set1_ps(direction.z);
+	const __m512 va = _mm512_set1_ps(a);
+	const __m512 vmin = _mm512_set1_ps(minTime);
+	const __m512 vmax = _mm512_set1_ps(maxTime);
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512i step = _mm512_set1_epi32(16);
+
+	__m512 bestT = vmax;
+	__m512i bestIndex = _mm512_set1_epi32(-1);
+	__m512i index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	for (uint32_t i = 0; i < count; i += 16)
+	{
+		__m512 ocx = _mm512_sub_ps(ox, _mm512_loadu_ps(&centerX[i]));
+		__m512 ocy = _mm512_sub_ps(oy, _mm512_loadu_ps(&centerY[i]));
+		__m512 ocz = _mm512_sub_ps(oz, _mm512_loadu_ps(&centerZ[i]));
+		__m512 b = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, dx), _mm512_mul_ps(ocy, dy)), _mm512_mul_ps(ocz, dz));
+		__m512 c = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, ocx), _mm512_mul_ps(ocy, ocy)), _mm512_mul_ps(ocz, ocz)),
+			_mm512_loadu_ps(&radius2[i]));
+		__m512 discriminant = _mm512_sub_ps(_mm512_mul_ps(b, b), _mm512_mul_ps(va, c));
+		__m512 root = _mm512_sqrt_ps(discriminant);
+		__m512 minusB = _mm512_sub_ps(zero, b);
+		__m512 temp1 = _mm512_div_ps(_mm512_sub_ps(minusB, root), va);
+		__m512 temp2 = _mm512_div_ps(_mm512_add_ps(minusB, root), va);
+
+		__mmask16 isTemp1Valid = _mm512_cmp_ps_mask(vmin, temp1, _CMP_LT_OQ) & _mm512_cmp_ps_mask(temp1, vmax, _CMP_LT_OQ);
+		__m512 temp = _mm512_mask_blend_ps(isTemp1Valid, temp2, temp1);
+		__mmask16 isCloser = _mm512_cmp_ps_mask(discriminant, zero, _CMP_GT_OQ)
+			& _mm512_cmp_ps_mask(vmin, temp, _CMP_LT_OQ) & _mm512_cmp_ps_mask(temp, vmax, _CMP_LT_OQ)
+			& _mm512_cmp_ps_mask(temp, bestT, _CMP_LT_OQ);
+
+		bestT = _mm512_mask_blend_ps(isCloser, bestT, temp);
+		bestIndex = _mm512_mask_blend_epi32(isCloser, bestIndex, index);
+		index = _mm512_add_epi32(index, step);
+	}
+
+	alignas(64) float laneT[16];
+	alignas(64) int32_t laneIndex[16];
+	_mm512_store_ps(laneT, bestT);
+	_mm512_store_si512(laneIndex, bestIndex);
+	t = maxTime;
+	return (reduceLanes(laneT, laneIndex, 16, t));
+}
+
+#else
+
+int32_t PackedSpheres::closestHitSSE(const Ray &ray, const float minTime, const float maxTime, float &t) const
+{
+	return (closestHitScalar(ray, minTime, maxTime, t));
+}
+
+int32_t PackedSpheres::closestHitAVX2(const Ray &ray, const float minTime, const float maxTime, float &t) const
+{
+	return (closestHitScalar(ray, minTime, maxTime, t));
+}
+
+int32_t PackedSpheres::closestHitAVX512(const Ray &ray, const float minTime, const float maxTime, float &t) const
+{
+	return (closestHitScalar(ray, minTime, maxTime, t));
+}
+
+#endif
\ No newline at end of file
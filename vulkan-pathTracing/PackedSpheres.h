@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "IHitable.h"
+
+// Structure of arrays sphere store. Spheres are tested 4, 8 or 16 at a time
+// with SSE, AVX2 or AVX-512 depending on what the CPU supports, and only the
+// closest one fills the HitRecord. The scalar path evaluates the exact same
+// operations in the same order so every level returns bit-identical results.
+class PackedSpheres : public IHitable
+{
+public:
+	enum class SimdLevel
+	{
+		SCALAR,
+		SSE,
+		AVX2,
+		AVX512
+	};
+
+	// Arrays are padded up to a multiple of the widest SIMD width.
+	static constexpr uint32_t PADDING = 16;
+
+	PackedSpheres();
+
+	static SimdLevel getSupportedSimdLevel();
+	static const char *getSimdLevelName(SimdLevel level);
+
+	// objectId is reported in HitRecord::objectId for this sphere.
+	void add(const glm::vec3 &center, float radius, uint32_t materialId, uint32_t objectId);
+	void clear();
+	uint32_t size() const { return (count); }
+	glm::vec3 getCenter(uint32_t index) const { return (glm::vec3(centerX[index], centerY[index], centerZ[index])); }
+	float getRadius(uint32_t index) const { return (radius[index]); }
+	uint32_t getMaterialId(uint32_t index) const { return (materialId[index]); }
+	// Id reported for the sphere at index, the one of the store itself is
+	// not used by its hits.
+	using IHitable::getObjectId;
+	uint32_t getObjectId(uint32_t index) const { return (objectId[index]); }
+
+	// Uses arrays owned by someone else, such as a mapped scene cache,
+	// instead of copying them. Each array holds count entries rounded up to
+	// PADDING, with the padding filled like add does, and must outlive the
+	// store.
+	void attach(uint32_t count, const float *centerX, const float *centerY, const float *centerZ,
+		const float *radius2, const float *radius, const uint32_t *materialId, const uint32_t *objectId);
+
+	// The requested level is clamped to what the CPU supports.
+	void setSimdLevel(SimdLevel level);
+	SimdLevel getSimdLevel() const { return (simdLevel); }
+
+	bool hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const override;
+	bool boundingBox(AABB &box) const override;
+
+	// Returns the index of the closest sphere hit in ]minTime, maxTime[ or -1.
+	int32_t closestHit(const Ray &ray, const float minTime, const float maxTime, float &t) const;
+
+private:
+	uint32_t count = 0;
+	SimdLevel simdLevel = SimdLevel::SCALAR;
+
+	// Point either into the owned vectors below or into attached arrays.
+	const float *centerX = nullptr;
+	const float *centerY = nullptr;
+	const float *centerZ = nullptr;
+	const float *radius2 = nullptr;
+	const float *radius = nullptr;
+	const uint32_t *materialId = nullptr;
+	const uint32_t *objectId = nullptr;
+
+	std::vector<float> ownedCenterX;
+	std::vector<float> ownedCenterY;
+	std::vector<float> ownedCenterZ;
+	std::vector<float> ownedRadius2;
+	std::vector<float> ownedRadius;
+	std::vector<uint32_t> ownedMaterialId;
+	std::vector<uint32_t> ownedObjectId;
+
+	void useOwnedArrays();
+	int32_t closestHitScalar(const Ray &ray, const float minTime, const float maxTime, float &t) const;
+	int32_t closestHitSSE(const Ray &ray, const float minTime, const float maxTime, float &t) const;
+	int32_t closestHitAVX2(const Ray &ray, const float minTime, const float maxTime, float &t) const;
+	int32_t closestHitAVX512(const Ray &ray, const float minTime, const float maxTime, float &t) const;
+};
\ No newline at end of file
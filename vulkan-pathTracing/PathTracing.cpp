@@ -1,39 +1,213 @@
 #include "PathTracing.h"
 
+#include <glm/gtc/constants.hpp>
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
 #include <chrono>
+#include <memory>
 #include <string>
 
 #include "Camera.h"
-#include "ctmRand.h"
-#include "HitableCollection.h"
 #include "HitRecord.h"
 #include "IHitable.h"
 #include "LogMessage.h"
 #include "Material.h"
+#include "MaterialTable.h"
 #include "PixelBlock.h"
 #include "Ray.h"
+#include "RayPacket.h"
+#include "RayStream.h"
+#include "Sampler.h"
+#include "SphereLights.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// Sizes the buffer, or releases it when size is 0.
+	template <typename T>
+	void allocateBuffer(std::vector<T> &buffer, size_t size)
+	{
+		if (buffer.size() != size)
+			std::vector<T>(size).swap(buffer);
+	}
+}
+
+constexpr uint32_t PathTracing::MISS_ID;
 
-PathTracing::PathTracing(int width, int height, uint32_t nbSamples, const HitableCollection &collection, const Camera &cam)
-	: width(width), height(height), nbSamples(nbSamples), collection(collection), cam(cam)
-	, queue(*this)
+PathTracing::PathTracing(int width, int height, uint32_t nbSamples, const IHitable &world, const MaterialTable &materials,
+	const SphereLights &lights, const Camera &cam, ThreadPool &pool)
+	: width(width), height(height), nbSamples(nbSamples), world(world), materials(materials), lights(lights), cam(cam)
+	, queue(*this, pool.getThreadCount()), pool(pool)
 {
 	pic = new glm::vec3[width * height];
+	picSum = new glm::vec3[width * height];
+	picSamples = new uint32_t[width * height];
+	picLuminanceSq = new float[width * height];
+	picConverged = new bool[width * height];
 	memset(pic, 0, width * height * sizeof(glm::vec3));
+	memset(picSum, 0, width * height * sizeof(glm::vec3));
+	memset(picSamples, 0, width * height * sizeof(uint32_t));
+	memset(picLuminanceSq, 0, width * height * sizeof(float));
+	memset(picConverged, 0, width * height * sizeof(bool));
+	threadStats.reset(new ThreadStats[pool.getThreadCount()]);
 }
 
 PathTracing::~PathTracing()
 {
+	endRendering();
 	delete[] pic;
+	delete[] picSum;
+	delete[] picSamples;
+	delete[] picLuminanceSq;
+	delete[] picConverged;
+}
+
+void PathTracing::setTileScheduling(TileScheduler::Order order, uint32_t size)
+{
+	tileOrder = order;
+	tileSize = size > 0 ? size : 1;
+}
+
+void PathTracing::setRussianRoulette(bool enabled, uint32_t minDepth)
+{
+	isRouletteEnabled = enabled;
+	rouletteDepth = minDepth;
+}
+
+void PathTracing::setIntegratorMode(IntegratorMode mode)
+{
+	integratorMode = mode;
+}
+
+void PathTracing::setLightSampling(bool enabled)
+{
+	isLightSamplingEnabled = enabled;
+}
+
+void PathTracing::setSky(const glm::vec3 &horizon, const glm::vec3 &zenith)
+{
+	skyHorizon = horizon;
+	skyZenith = zenith;
+}
+
+void PathTracing::setPrimaryPackets(bool enabled)
+{
+	arePrimaryPacketsEnabled = enabled;
+}
+
+void PathTracing::setSampler(Sampler::Type type)
+{
+	samplerType = type;
+}
+
+void PathTracing::setAdaptiveSampling(bool enabled, float threshold, uint32_t minSamples)
+{
+	isAdaptiveEnabled = enabled;
+	noiseThreshold = threshold;
+	adaptiveMinSamples = minSamples > 2 ? minSamples : 2;
+}
+
+void PathTracing::setGuideBuffers(bool enabled)
+{
+	areGuidesEnabled = enabled;
+}
+
+void PathTracing::setAovs(uint32_t mask)
+{
+	aovMask = mask;
+}
+
+const char *PathTracing::getAovName(Aov aov)
+{
+	switch (aov)
+	{
+	case Aov::DEPTH:
+		return ("depth");
+	case Aov::NORMAL:
+		return ("normal");
+	case Aov::ALBEDO:
+		return ("albedo");
+	case Aov::OBJECT_ID:
+		return ("object");
+	default:
+		return ("material");
+	}
+}
+
+// The buffers of inactive AOVs are released, a normal costs 24 bytes per
+// pixel.
+void PathTracing::allocateAovs()
+{
+	size_t size = static_cast<size_t>(width) * height;
+	size_t depthSize = isAovActive(Aov::DEPTH) ? size : 0;
+	size_t normalSize = isAovActive(Aov::NORMAL) ? size : 0;
+	size_t albedoSize = isAovActive(Aov::ALBEDO) ? size : 0;
+	size_t objectSize = isAovActive(Aov::OBJECT_ID) ? size : 0;
+	size_t materialSize = isAovActive(Aov::MATERIAL_ID) ? size : 0;
+	allocateBuffer(depthSum, depthSize);
+	allocateBuffer(aovDepths, depthSize);
+	allocateBuffer(normalSum, normalSize);
+	allocateBuffer(aovNormals, normalSize);
+	allocateBuffer(albedoSum, albedoSize);
+	allocateBuffer(aovAlbedos, albedoSize);
+	allocateBuffer(firstObjectIds, objectSize);
+	allocateBuffer(aovObjectIds, objectSize);
+	allocateBuffer(firstMaterialIds, materialSize);
+	allocateBuffer(aovMaterialIds, materialSize);
+	allocateBuffer(guideVariances, areGuidesActive ? size : 0);
 }
 
 void PathTracing::startRendering()
 {
-	isRunning = true;
-	areThreadStopped = false;
-	for (int i = 0; i < NBR_THREAD; i++)
+	endRendering();
+
+	scheduler.configure(width, height, tileSize, tileOrder);
+	activeIntegratorMode = integratorMode;
+	arePrimaryPacketsActive = arePrimaryPacketsEnabled;
+	activeSamplerType = samplerType;
+	isLightSamplingActive = isLightSamplingEnabled && !lights.isEmpty();
+	isAdaptiveActive = isAdaptiveEnabled && adaptiveMinSamples < nbSamples;
+	areGuidesActive = areGuidesEnabled;
+	activeAovMask = aovMask;
+	if (areGuidesActive)
+		activeAovMask |= getAovBit(Aov::DEPTH) | getAovBit(Aov::NORMAL) | getAovBit(Aov::ALBEDO);
+	allocateAovs();
+	uniformPasses = isAdaptiveActive ? adaptiveMinSamples : nbSamples;
+	if (isAdaptiveActive)
+		sampler.configure(scheduler.getTileCount(), adaptiveMinSamples, nbSamples * MAX_ADAPTIVE_SAMPLE_FACTOR);
+	adaptiveBudget = static_cast<int64_t>(nbSamples - uniformPasses) * width * height;
+	if (nbTileLocks != scheduler.getTileCount())
 	{
-		threads[i] = new std::thread([this]() { this->computePixels(); });
+		nbTileLocks = scheduler.getTileCount();
+		tileLocks.reset(new std::mutex[nbTileLocks]);
+		tileVersions.reset(new std::atomic<uint32_t>[nbTileLocks]);
+		for (uint32_t i = 0; i < nbTileLocks; i++)
+			tileVersions[i].store(0, std::memory_order_relaxed);
 	}
+	memset(pic, 0, width * height * sizeof(glm::vec3));
+	memset(picSum, 0, width * height * sizeof(glm::vec3));
+	memset(picSamples, 0, width * height * sizeof(uint32_t));
+	memset(picLuminanceSq, 0, width * height * sizeof(float));
+	memset(picConverged, 0, width * height * sizeof(bool));
+	std::fill(depthSum.begin(), depthSum.end(), 0.0f);
+	std::fill(normalSum.begin(), normalSum.end(), glm::vec3(0, 0, 0));
+	std::fill(albedoSum.begin(), albedoSum.end(), glm::vec3(0, 0, 0));
+	std::fill(firstObjectIds.begin(), firstObjectIds.end(), MISS_ID);
+	std::fill(firstMaterialIds.begin(), firstMaterialIds.end(), MISS_ID);
+	for (uint32_t i = 0; i < nbTileLocks; i++)
+		tileVersions[i].fetch_add(1, std::memory_order_release);
+	queue.reset(activeAovMask != 0);
+	for (uint32_t i = 0; i < pool.getThreadCount(); i++)
+		threadStats[i].stats = RenderStats();
+	retrieveSeconds = 0;
+
+	isRunning = true;
+	areThreadStopped = false;
+	pool.dispatch([this](uint32_t threadIndex) { this->computePixels(threadIndex); });
 	startTime = std::chrono::steady_clock::now();
 }
 
@@ -43,42 +217,23 @@ void PathTracing::endRendering()
 	if (!areThreadStopped)
 	{
 		LOG_MSG("Stopping thread.");
-		for (size_t i = 0; i < NBR_THREAD; i++)
-		{
-			if (threads[i]->joinable())
-				threads[i]->join();
-			delete threads[i];
-		}
+		pool.wait();
+		areThreadStopped = true;
 	}
 }
 
+// The workers accumulate their blocks themselves, only the end of the
+// render is left to notice here.
 void PathTracing::retreiveThreadResult()
 {
 	if (areThreadStopped)
 		return;
 
-	PixelBlock block;
-	PixelBlockQueue::ReturnType ret;
-	while ((ret = queue.getPixelBlockToDraw(&block)) == PixelBlockQueue::ReturnType::SUCCESS)
-	{
-		for (uint32_t i = 0; i < block.length; i++)
-		{
-			pic[block.startingPixel + i] = (pic[block.startingPixel + i] * static_cast<float>(block.nbSample) + block.buffer[i])
-				/ static_cast<float>(block.nbSample + 1);
-		}
-
-#ifdef _DEBUG
-		if (block.nbSample > renderedSamples)
-		{
-			LOG_MSG("%de sample image rendered", renderedSamples + 1);
-			renderedSamples += 1;
-		}
-#endif
-	}
-
-	if (!isRunning && !areThreadStopped && ret == PixelBlockQueue::ReturnType::RENDERING_FINISHED)
+	auto retrieveStart = std::chrono::steady_clock::now();
+	if (queue.isFinished())
 	{
-		LOG_MSG("%de sample image rendered", renderedSamples + 1);
+		isRunning = false;
+		LOG_MSG("%u blocks rendered", queue.getCompletedBlockCount());
 
 #ifdef _DEBUG
 		auto endTime = std::chrono::steady_clock::now();
@@ -90,92 +245,695 @@ void PathTracing::retreiveThreadResult()
 		LOG_MSG("Rendering finished in %uhours %uminutes %useconds", hours, minutes, seconds);
 #endif
 
-		for (size_t i = 0; i < NBR_THREAD; i++)
-		{
-			if (threads[i]->joinable())
-				threads[i]->join();
-			delete threads[i];
-		}
+		pool.wait();
 		areThreadStopped = true;
 	}
+	retrieveSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - retrieveStart).count();
+}
+
+void PathTracing::waitForResult(uint32_t timeoutMs)
+{
+	if (!areThreadStopped && pool.waitFor(timeoutMs))
+		retreiveThreadResult();
 }
 
-const glm::vec3 *PathTracing::getPic() const
+RenderStats PathTracing::getStats() const
 {
+	RenderStats total;
+	for (uint32_t i = 0; i < pool.getThreadCount(); i++)
+	{
+		std::lock_guard<std::mutex> lock(threadStats[i].locker);
+		total.add(threadStats[i].stats);
+	}
+	total.retrieveSeconds = retrieveSeconds;
+	return (total);
+}
+
+const glm::vec3 *PathTracing::getPic()
+{
+	for (uint32_t i = 0; i < nbTileLocks; i++)
+		resolveTile(i);
 	return (pic);
 }
 
+bool PathTracing::getGuides(Guides &guides) const
+{
+	if (!areGuidesActive)
+		return (false);
+	guides.normals = aovNormals.data();
+	guides.albedos = aovAlbedos.data();
+	guides.depths = aovDepths.data();
+	guides.variances = guideVariances.data();
+	return (true);
+}
+
+bool PathTracing::getAovs(Aovs &aovs) const
+{
+	aovs.depths = isAovActive(Aov::DEPTH) ? aovDepths.data() : nullptr;
+	aovs.normals = isAovActive(Aov::NORMAL) ? aovNormals.data() : nullptr;
+	aovs.albedos = isAovActive(Aov::ALBEDO) ? aovAlbedos.data() : nullptr;
+	aovs.objectIds = isAovActive(Aov::OBJECT_ID) ? aovObjectIds.data() : nullptr;
+	aovs.materialIds = isAovActive(Aov::MATERIAL_ID) ? aovMaterialIds.data() : nullptr;
+	return (activeAovMask != 0);
+}
+
+uint32_t PathTracing::getDirtyTiles(ReadState &state, std::vector<DirtyTile> &dirtyTiles)
+{
+	prepareRead(state);
+	uint32_t nbDirty = 0;
+	DirtyTile dirtyTile;
+	for (uint32_t i = 0; i < nbTileLocks; i++)
+	{
+		if (readDirtyTile(state, i, dirtyTile))
+		{
+			dirtyTiles.push_back(dirtyTile);
+			nbDirty += 1;
+		}
+	}
+	return (nbDirty);
+}
+
+// A fresh version vector never matches, versions start at 1.
+void PathTracing::prepareRead(ReadState &state) const
+{
+	if (state.tileVersions.size() != nbTileLocks)
+		state.tileVersions.assign(nbTileLocks, 0);
+}
+
+bool PathTracing::readDirtyTile(ReadState &state, uint32_t tileIndex, DirtyTile &dirtyTile)
+{
+	if (tileVersions[tileIndex].load(std::memory_order_acquire) == state.tileVersions[tileIndex])
+		return (false);
+
+	state.tileVersions[tileIndex] = resolveTile(tileIndex);
+	dirtyTile.tileIndex = tileIndex;
+	dirtyTile.rect = scheduler.getTile(tileIndex);
+	dirtyTile.data = pic + dirtyTile.rect.x + dirtyTile.rect.y * width;
+	return (true);
+}
+
+uint32_t PathTracing::resolveTile(uint32_t tileIndex)
+{
+	const TileScheduler::Tile &tile = scheduler.getTile(tileIndex);
+	std::lock_guard<std::mutex> lock(tileLocks[tileIndex]);
+	for (uint32_t y = tile.y; y < tile.y + tile.height; y++)
+	{
+		for (uint32_t x = tile.x; x < tile.x + tile.width; x++)
+		{
+			uint32_t pixel = x + y * width;
+			if (picSamples[pixel] == 0)
+				continue;
+			float invSamples = 1 / static_cast<float>(picSamples[pixel]);
+			pic[pixel] = picSum[pixel] * invSamples;
+			if (activeAovMask == 0)
+				continue;
+
+			if (isAovActive(Aov::DEPTH))
+				aovDepths[pixel] = depthSum[pixel] * invSamples;
+			if (isAovActive(Aov::NORMAL))
+				aovNormals[pixel] = normalSum[pixel] * invSamples;
+			if (isAovActive(Aov::ALBEDO))
+				aovAlbedos[pixel] = albedoSum[pixel] * invSamples;
+			if (isAovActive(Aov::OBJECT_ID))
+				aovObjectIds[pixel] = firstObjectIds[pixel];
+			if (isAovActive(Aov::MATERIAL_ID))
+				aovMaterialIds[pixel] = firstMaterialIds[pixel];
+			if (!areGuidesActive)
+				continue;
+			float luminance = computeLuminance(pic[pixel]);
+			guideVariances[pixel] = picSamples[pixel] < 2 ? luminance * luminance : computeMeanVariance(pixel);
+		}
+	}
+	return (tileVersions[tileIndex].load(std::memory_order_relaxed));
+}
+
 bool PathTracing::queueCanContinue()
 {
 	return (isRunning);
 }
 
-void PathTracing::fillPixelBlock(PixelBlock &block)
+// The first uniformPasses samples go over the tiles in scheduler order.
+// With adaptive sampling the rest of the budget is handed out by the
+// sampler, tile by tile, by remaining error.
+bool PathTracing::fillPixelBlock(uint32_t blockIndex, PixelBlock &block)
 {
-	if (cs >= nbSamples || !isRunning)
+	uint32_t tileCount = scheduler.getTileCount();
+	uint32_t tileIndex;
+	uint32_t sample;
+	if (blockIndex < uniformPasses * tileCount)
 	{
-		isRunning = false;
-		return ;
+		sample = blockIndex / tileCount;
+		tileIndex = blockIndex % tileCount;
 	}
+	else if (!isAdaptiveActive || adaptiveBudget.load(std::memory_order_relaxed) <= 0 || !sampler.pickTile(tileIndex, sample))
+		return (false);
 
-	block.startingPixel = cx + cy * width;
-	block.length = PixelBlock::NBR_PIXELS_PER_BLOCK;
-	block.nbSample = cs;
-	cy = cy + (cx + block.length) / width;
-	cx = (cx + block.length) % width;
-	if (cy >= static_cast<uint32_t>(height))
+	const TileScheduler::Tile &tile = scheduler.getTile(tileIndex);
+	block.x = tile.x;
+	block.y = tile.y;
+	block.blockWidth = tile.width;
+	block.blockHeight = tile.height;
+	block.nbSample = sample;
+	block.tileIndex = tileIndex;
+	block.hasSkippedPixels = sample >= uniformPasses;
+	if (block.hasSkippedPixels)
 	{
-		block.length = width * height - block.startingPixel;
-		cx = 0;
-		cy = 0;
-		cs += 1;
+		uint32_t nbTraced = 0;
+		{
+			std::lock_guard<std::mutex> lock(tileLocks[tileIndex]);
+			for (uint32_t y = 0; y < tile.height; y++)
+			{
+				const bool *converged = picConverged + tile.x + (tile.y + y) * width;
+				for (uint32_t x = 0; x < tile.width; x++)
+				{
+					block.isPixelSkipped[x + y * tile.width] = converged[x];
+					nbTraced += converged[x] ? 0 : 1;
+				}
+			}
+		}
+		adaptiveBudget.fetch_sub(nbTraced, std::memory_order_relaxed);
 	}
+	return (true);
 }
 
-void PathTracing::computePixels()
+void PathTracing::computePixels(uint32_t threadIndex)
 {
 	PixelBlock *block;
-	LOG_MSG("Thread %p started.", __threadid);
-	while (queue.getPixelBlockToProcess(&block) != PixelBlockQueue::ReturnType::RENDERING_FINISHED)
+	Sampler pathSampler(activeSamplerType, nbSamples);
+	std::unique_ptr<RayStream> stream;
+	if (activeIntegratorMode == IntegratorMode::WAVEFRONT)
+	{
+		stream.reset(new RayStream());
+		std::fill(stream->samplers, stream->samplers + RayStream::CAPACITY, pathSampler);
+	}
+
+	// The hitables count into stats through the thread local pointer.
+	RenderStats stats;
+	RenderStats::setThreadStats(&stats);
+
+	LOG_MSG("Thread %u started.", threadIndex);
+	auto queueStart = std::chrono::steady_clock::now();
+	while (queue.getPixelBlockToProcess(threadIndex, &block) == PixelBlockQueue::ReturnType::SUCCESS)
+	{
+		auto queueEnd = std::chrono::steady_clock::now();
+		stats.queueSeconds += std::chrono::duration<double>(queueEnd - queueStart).count();
+		if (stream)
+			computeBlockWavefront(*block, *stream, stats);
+		else
+			computeBlock(*block, pathSampler, stats);
+		accumulateBlock(*block);
+		queueStart = std::chrono::steady_clock::now();
+		queue.releaseProcessedPixelBlock();
+		publishStats(threadIndex, stats);
+	}
+	stats.queueSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - queueStart).count();
+	publishStats(threadIndex, stats);
+	RenderStats::setThreadStats(nullptr);
+	LOG_MSG("Thread %u stopped.", threadIndex);
+}
+
+// Moves the counters of the worker to its slot, once per block so the
+// counting itself stays on plain thread local adds.
+void PathTracing::publishStats(uint32_t threadIndex, RenderStats &stats)
+{
 	{
-		if (!block)
-			continue;
+		std::lock_guard<std::mutex> lock(threadStats[threadIndex].locker);
+		threadStats[threadIndex].stats.add(stats);
+	}
+	stats = RenderStats();
+}
 
-		for (uint32_t i = 0; i < block->length; i++)
+// Two workers only share a tile when the whole image was handed out while
+// one of them was still on it, so the lock is almost never contended.
+void PathTracing::accumulateBlock(const PixelBlock &block)
+{
+	float tileErrorSq = 0;
+	uint32_t nbPixels = 0;
+	bool isTileConverged = true;
+	{
+		std::lock_guard<std::mutex> lock(tileLocks[block.tileIndex]);
+		for (uint32_t y = 0; y < block.blockHeight; y++)
 		{
-			int cx = (block->startingPixel + i) % width;
-			int cy = (block->startingPixel + i) / width;
+			uint32_t row = block.x + (block.y + y) * width;
+			for (uint32_t x = 0; x < block.blockWidth; x++)
+			{
+				uint32_t pixel = row + x;
+				uint32_t i = x + y * block.blockWidth;
+				if (block.hasSkippedPixels && block.isPixelSkipped[i])
+					continue;
 
-			float u = (static_cast<float>(cx) + ctmRand()) / static_cast<float>(width);
-			float v = (static_cast<float>(cy) + ctmRand()) / static_cast<float>(height);
-			Ray ray = cam.getRay(u, v);
+				picSum[pixel] += block.buffer[i];
+				picSamples[pixel] += 1;
+				if (activeAovMask != 0)
+				{
+					if (isAovActive(Aov::DEPTH))
+						depthSum[pixel] += block.aovs->depths[i];
+					if (isAovActive(Aov::NORMAL))
+						normalSum[pixel] += block.aovs->normals[i];
+					if (isAovActive(Aov::ALBEDO))
+						albedoSum[pixel] += block.aovs->albedos[i];
+					// Every pixel gets sample 0, whatever the order the
+					// blocks come back in.
+					if (isAovActive(Aov::OBJECT_ID) && block.nbSample == 0)
+						firstObjectIds[pixel] = block.aovs->objectIds[i];
+					if (isAovActive(Aov::MATERIAL_ID) && block.nbSample == 0)
+						firstMaterialIds[pixel] = block.aovs->materialIds[i];
+				}
+				if (!isAdaptiveActive && !areGuidesActive)
+					continue;
 
-			glm::vec3 color = computeColor(ray, collection, 0);
-			block->buffer[i] = color;
+				float luminance = computeLuminance(block.buffer[i]);
+				picLuminanceSq[pixel] += luminance * luminance;
+				if (!isAdaptiveActive)
+					continue;
+				float error = computeRelativeError(pixel);
+				picConverged[pixel] = picSamples[pixel] >= adaptiveMinSamples && error < noiseThreshold;
+				if (!picConverged[pixel])
+				{
+					isTileConverged = false;
+					tileErrorSq += error < 1 ? error * error : 1;
+					nbPixels += 1;
+				}
+			}
 		}
-		queue.releaseProcessedPixelBlock(block);
+		tileVersions[block.tileIndex].fetch_add(1, std::memory_order_release);
 	}
-	LOG_MSG("Thread %p stopped.", __threadid);
+	if (isAdaptiveActive)
+		sampler.updateTile(block.tileIndex, nbPixels > 0 ? sqrtf(tileErrorSq / nbPixels) : 0, isTileConverged);
+}
+
+float PathTracing::computeMeanVariance(uint32_t pixel) const
+{
+	uint32_t n = picSamples[pixel];
+	float mean = computeLuminance(picSum[pixel]) / static_cast<float>(n);
+	float variance = (picLuminanceSq[pixel] - static_cast<float>(n) * mean * mean) / static_cast<float>(n - 1);
+	if (variance < 0)
+		variance = 0;
+	return (variance / static_cast<float>(n));
+}
+
+// Relative standard error of the mean luminance of the pixel, the epsilon
+// keeps dark pixels from never converging.
+float PathTracing::computeRelativeError(uint32_t pixel) const
+{
+	uint32_t n = picSamples[pixel];
+	if (n < 2)
+		return (FLT_MAX);
+
+	float mean = computeLuminance(picSum[pixel]) / static_cast<float>(n);
+	return (sqrtf(computeMeanVariance(pixel)) / (mean + NOISE_EPSILON));
 }
 
-glm::vec3 PathTracing::computeColor(const Ray &ray, const IHitable &world, int depth)
+float PathTracing::computeLuminance(const glm::vec3 &color)
 {
-	HitRecord record;
-	if (world.hit(ray, 0.001f, 100.0f, record))
+	return (0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b);
+}
+
+// Scanline blocks can pass the end of a row, cx then goes on at the start
+// of the next ones.
+Ray PathTracing::generateCameraRay(uint32_t cx, uint32_t cy, uint32_t nbSample, Sampler &pathSampler) const
+{
+	cy += cx / static_cast<uint32_t>(width);
+	cx %= static_cast<uint32_t>(width);
+	pathSampler.startSample(cx, cy, nbSample);
+	glm::vec2 jitter = pathSampler.get2D(Sampler::PIXEL);
+	float u = (static_cast<float>(cx) + jitter.x) / static_cast<float>(width);
+	float v = (static_cast<float>(cy) + jitter.y) / static_cast<float>(height);
+	return (cam.getRay(u, v, pathSampler.get2D(Sampler::LENS)));
+}
+
+void PathTracing::computeBlock(PixelBlock &block, Sampler &pathSampler, RenderStats &stats) const
+{
+	if (arePrimaryPacketsActive)
 	{
-		Ray scattered;
-		glm::vec3 attenuation;
-		if (depth < MAX_DEPTH && record.material->scatter(ray, record, attenuation, scattered))
+		computeBlockPackets(block, pathSampler, stats);
+		return;
+	}
+
+	for (uint32_t y = 0; y < block.blockHeight; y++)
+	{
+		for (uint32_t x = 0; x < block.blockWidth; x++)
 		{
-			return (attenuation * computeColor(scattered, world, depth + 1));
+			if (block.hasSkippedPixels && block.isPixelSkipped[x + y * block.blockWidth])
+				continue;
+			uint32_t i = x + y * block.blockWidth;
+			Ray ray = generateCameraRay(block.x + x, block.y + y, block.nbSample, pathSampler);
+			HitRecord record;
+			stats.cameraRays += 1;
+			bool isHit = world.hit(ray, 0.001f, 100.0f, record);
+			recordAovs(block, i, ray, isHit, record);
+			block.buffer[i] = continuePath(ray, isHit, record, pathSampler, stats);
+		}
+	}
+}
+
+// Every pixel keeps its own sampler, started the same way as in
+// computeBlock, so the image does not change.
+void PathTracing::computeBlockPackets(PixelBlock &block, const Sampler &pathSampler, RenderStats &stats) const
+{
+	RayPacket packet;
+	Sampler samplers[RayPacket::SIZE];
+	std::fill(samplers, samplers + RayPacket::SIZE, pathSampler);
+	HitRecord records[RayPacket::SIZE];
+	uint32_t pixels[RayPacket::SIZE];
+	for (uint32_t y0 = 0; y0 < block.blockHeight; y0 += RayPacket::WIDTH)
+	{
+		for (uint32_t x0 = 0; x0 < block.blockWidth; x0 += RayPacket::WIDTH)
+		{
+			packet.clear();
+			for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+			{
+				uint32_t x = x0 + lane % RayPacket::WIDTH;
+				uint32_t y = y0 + lane / RayPacket::WIDTH;
+				pixels[lane] = x + y * block.blockWidth;
+				if (x >= block.blockWidth || y >= block.blockHeight || (block.hasSkippedPixels && block.isPixelSkipped[pixels[lane]]))
+					continue;
+				packet.set(lane, generateCameraRay(block.x + x, block.y + y, block.nbSample, samplers[lane]));
+			}
+			if (packet.activeMask == 0)
+				continue;
+
+			packet.prepare();
+			uint32_t hitMask = world.hitPacket(packet, 0.001f, 100.0f, records);
+			for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+			{
+				if (!(packet.activeMask & (1u << lane)))
+					continue;
+				bool isHit = (hitMask & (1u << lane)) != 0;
+				stats.cameraRays += 1;
+				recordAovs(block, pixels[lane], packet.rays[lane], isHit, records[lane]);
+				block.buffer[pixels[lane]] = continuePath(packet.rays[lane], isHit, records[lane], samplers[lane], stats);
+			}
+		}
+	}
+}
+
+// Each path keeps its own sampler and reads the same dimensions as
+// continuePath, so both modes render the exact same image.
+void PathTracing::computeBlockWavefront(PixelBlock &block, RayStream &stream, RenderStats &stats) const
+{
+	typedef void (*ScatterKernel)(const MaterialTable &materials, RayStream &stream, const uint32_t *paths, uint32_t count);
+	static const ScatterKernel kernels[static_cast<uint32_t>(Material::Type::COUNT)] =
+	{
+		&Material::scatterStream<Material::Type::LAMBERT>,
+		&Material::scatterStream<Material::Type::METAL>,
+		&Material::scatterStream<Material::Type::DIALECTRIC>,
+		&Material::scatterStream<Material::Type::EMISSIVE>
+	};
+
+	stream.nbActive = 0;
+	for (uint32_t y = 0; y < block.blockHeight; y++)
+	{
+		for (uint32_t x = 0; x < block.blockWidth; x++)
+		{
+			uint32_t cx = block.x + x;
+			uint32_t cy = block.y + y;
+			uint32_t path = x + y * block.blockWidth;
+			if (block.hasSkippedPixels && block.isPixelSkipped[path])
+				continue;
+
+			stream.rays[path] = generateCameraRay(cx, cy, block.nbSample, stream.samplers[path]);
+			stream.throughputs[path] = glm::vec3(1, 1, 1);
+			stream.bsdfPdfs[path] = 0;
+			block.buffer[path] = glm::vec3(0, 0, 0);
+			stream.active[stream.nbActive++] = path;
+		}
+	}
+	if (arePrimaryPacketsActive)
+		tracePrimaryPackets(block, stream);
+	stats.cameraRays += stream.nbActive;
+
+	for (int depth = 0; stream.nbActive > 0; depth++)
+	{
+		// Closest hit for every active path. Escaped paths take the sky
+		// color, the others are counted per material class.
+		if (depth > 0)
+			stats.secondaryRays += stream.nbActive;
+		uint32_t counts[static_cast<uint32_t>(Material::Type::COUNT)] = {};
+		uint32_t nbHit = 0;
+		for (uint32_t i = 0; i < stream.nbActive; i++)
+		{
+			uint32_t path = stream.active[i];
+			HitRecord &record = stream.records[path];
+			bool isHit = depth == 0 && arePrimaryPacketsActive ? stream.isHit[path] != 0
+				: world.hit(stream.rays[path], 0.001f, 100.0f, record);
+			if (depth == 0)
+				recordAovs(block, path, stream.rays[path], isHit, record);
+			if (!isHit)
+			{
+				block.buffer[path] += stream.throughputs[path] * computeSkyColor(stream.rays[path]);
+				stats.addPathLength(depth);
+				continue;
+			}
+			const Material &material = materials[record.materialId];
+			if (material.type == Material::Type::EMISSIVE)
+			{
+				float weight = getEmissionWeight(stream.rays[path], record, stream.bsdfPdfs[path]);
+				block.buffer[path] += stream.throughputs[path] * material.albedo * weight;
+				stats.addPathLength(depth);
+				continue;
+			}
+			if (depth >= MAX_DEPTH)
+			{
+				stats.addPathLength(depth);
+				continue;
+			}
+
+			record.normal = getShadingNormal(stream.rays[path], material, record);
+			Material::Type type = material.type;
+			stream.materialTypes[path] = type;
+			stream.samplers[path].startBounce(depth);
+			counts[static_cast<uint32_t>(type)] += 1;
+			stream.active[nbHit++] = path;
+		}
+
+		// Counting sort of the hits by material class, then one kernel call
+		// per class.
+		uint32_t offsets[static_cast<uint32_t>(Material::Type::COUNT)];
+		uint32_t offset = 0;
+		for (uint32_t type = 0; type < static_cast<uint32_t>(Material::Type::COUNT); type++)
+		{
+			offsets[type] = offset;
+			offset += counts[type];
+		}
+		for (uint32_t i = 0; i < nbHit; i++)
+		{
+			uint32_t path = stream.active[i];
+			stream.sorted[offsets[static_cast<uint32_t>(stream.materialTypes[path])]++] = path;
+		}
+		offset = 0;
+		for (uint32_t type = 0; type < static_cast<uint32_t>(Material::Type::COUNT); type++)
+		{
+			if (counts[type] > 0)
+				kernels[type](materials, stream, stream.sorted + offset, counts[type]);
+			offset += counts[type];
+		}
+
+		// Absorbed paths and paths killed by the roulette keep what they
+		// gathered so far and leave the stream.
+		stream.nbActive = 0;
+		for (uint32_t i = 0; i < nbHit; i++)
+		{
+			uint32_t path = stream.sorted[i];
+			if (!stream.isScattered[path])
+			{
+				stats.addPathLength(depth);
+				continue;
+			}
+			stream.bsdfPdfs[path] = 0;
+			if (isLightSamplingActive && stream.materialTypes[path] == Material::Type::LAMBERT)
+			{
+				const HitRecord &record = stream.records[path];
+				block.buffer[path] += stream.throughputs[path]
+					* sampleDirectLight(record, materials[record.materialId], stream.samplers[path], stats);
+				stream.bsdfPdfs[path] = Material::lambertPdf(record.normal, stream.rays[path].getDirection());
+			}
+			stream.throughputs[path] *= stream.attenuations[path];
+			if (!survivesRoulette(depth, stream.throughputs[path], stream.samplers[path]))
+			{
+				stats.addPathLength(depth);
+				continue;
+			}
+			stream.active[stream.nbActive++] = path;
 		}
-		else
-			return (glm::vec3(0, 0, 0));
 	}
-	else
+}
+
+// Camera rays of the block traced as packets, with their hits stored in
+// the stream for the first bounce.
+void PathTracing::tracePrimaryPackets(const PixelBlock &block, RayStream &stream) const
+{
+	RayPacket packet;
+	HitRecord records[RayPacket::SIZE];
+	uint32_t paths[RayPacket::SIZE];
+	for (uint32_t y0 = 0; y0 < block.blockHeight; y0 += RayPacket::WIDTH)
 	{
-		glm::vec3 direction = glm::normalize(ray.getDirection());
-		float t = 0.5f * (direction.y + 1);
-		return ((1 - t) * glm::vec3(1, 1, 1) + t * glm::vec3(0.5, 0.7, 1));
+		for (uint32_t x0 = 0; x0 < block.blockWidth; x0 += RayPacket::WIDTH)
+		{
+			packet.clear();
+			for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+			{
+				uint32_t x = x0 + lane % RayPacket::WIDTH;
+				uint32_t y = y0 + lane / RayPacket::WIDTH;
+				paths[lane] = x + y * block.blockWidth;
+				if (x >= block.blockWidth || y >= block.blockHeight || (block.hasSkippedPixels && block.isPixelSkipped[paths[lane]]))
+					continue;
+				packet.set(lane, stream.rays[paths[lane]]);
+			}
+			if (packet.activeMask == 0)
+				continue;
+
+			packet.prepare();
+			uint32_t hitMask = world.hitPacket(packet, 0.001f, 100.0f, records);
+			for (uint32_t lane = 0; lane < RayPacket::SIZE; lane++)
+			{
+				if (!(packet.activeMask & (1u << lane)))
+					continue;
+				stream.isHit[paths[lane]] = (hitMask & (1u << lane)) != 0;
+				stream.records[paths[lane]] = records[lane];
+			}
+		}
 	}
+}
+
+// Surfaces that do not tint what they reflect, and the sky, have a white
+// albedo so the denoiser leaves their color as is. Every field is written
+// whichever AOVs are active, accumulateBlock only reads the active ones.
+void PathTracing::recordAovs(PixelBlock &block, uint32_t i, const Ray &cameraRay, bool isHit, const HitRecord &hit) const
+{
+	if (activeAovMask == 0)
+		return;
+	if (!isHit)
+	{
+		block.aovs->depths[i] = 0;
+		block.aovs->normals[i] = glm::vec3(0, 0, 0);
+		block.aovs->albedos[i] = glm::vec3(1, 1, 1);
+		block.aovs->objectIds[i] = MISS_ID;
+		block.aovs->materialIds[i] = MISS_ID;
+		return;
+	}
+	const Material &material = materials[hit.materialId];
+	bool isTinted = material.type == Material::Type::LAMBERT || material.type == Material::Type::METAL;
+	block.aovs->depths[i] = hit.t * glm::length(cameraRay.getDirection());
+	block.aovs->normals[i] = getShadingNormal(cameraRay, material, hit);
+	block.aovs->albedos[i] = isTinted ? material.albedo : glm::vec3(1, 1, 1);
+	block.aovs->objectIds[i] = hit.objectId;
+	block.aovs->materialIds[i] = hit.materialId;
+}
+
+glm::vec3 PathTracing::continuePath(const Ray &cameraRay, bool isHit, const HitRecord &cameraHit, Sampler &pathSampler,
+	RenderStats &stats) const
+{
+	Ray ray = cameraRay;
+	HitRecord record = cameraHit;
+	glm::vec3 throughput(1, 1, 1);
+	glm::vec3 radiance(0, 0, 0);
+	float bsdfPdf = 0;
+	int depth = 0;
+	for (; ; depth++)
+	{
+		if (depth > 0)
+		{
+			stats.secondaryRays += 1;
+			isHit = world.hit(ray, 0.001f, 100.0f, record);
+		}
+		if (!isHit)
+		{
+			radiance += throughput * computeSkyColor(ray);
+			break;
+		}
+
+		const Material &material = materials[record.materialId];
+		if (material.type == Material::Type::EMISSIVE)
+		{
+			radiance += throughput * material.albedo * getEmissionWeight(ray, record, bsdfPdf);
+			break;
+		}
+
+		if (depth >= MAX_DEPTH)
+			break;
+		record.normal = getShadingNormal(ray, material, record);
+		pathSampler.startBounce(depth);
+		Ray scattered;
+		glm::vec3 attenuation;
+		if (!material.scatter(ray, record, pathSampler.get3D(Sampler::SCATTER), attenuation, scattered))
+			break;
+		bsdfPdf = 0;
+		if (isLightSamplingActive && material.type == Material::Type::LAMBERT)
+		{
+			radiance += throughput * sampleDirectLight(record, material, pathSampler, stats);
+			bsdfPdf = Material::lambertPdf(record.normal, scattered.getDirection());
+		}
+		throughput *= attenuation;
+		ray = scattered;
+
+		if (!survivesRoulette(depth, throughput, pathSampler))
+			break;
+	}
+	stats.addPathLength(depth);
+	return (radiance);
+}
+
+glm::vec3 PathTracing::getShadingNormal(const Ray &ray, const Material &material, const HitRecord &hit)
+{
+	if (material.type != Material::Type::DIALECTRIC && glm::dot(ray.getDirection(), hit.normal) > 0)
+		return (-hit.normal);
+	return (hit.normal);
+}
+
+// Called after the scatter of bounce depth. Survivors are reweighted so the
+// estimator stays unbiased.
+bool PathTracing::survivesRoulette(int depth, glm::vec3 &throughput, const Sampler &pathSampler) const
+{
+	if (!isRouletteEnabled || static_cast<uint32_t>(depth) + 1 < rouletteDepth)
+		return (true);
+
+	float survival = glm::max(throughput.x, glm::max(throughput.y, throughput.z));
+	if (survival > MAX_ROULETTE_SURVIVAL)
+		survival = MAX_ROULETTE_SURVIVAL;
+	if (pathSampler.get1D(Sampler::ROULETTE) >= survival)
+		return (false);
+	throughput /= survival;
+	return (true);
+}
+
+glm::vec3 PathTracing::sampleDirectLight(const HitRecord &hit, const Material &material, const Sampler &pathSampler,
+	RenderStats &stats) const
+{
+	SphereLights::Sample sample;
+	if (!lights.sample(hit.p, pathSampler.get3D(Sampler::LIGHT), sample))
+		return (glm::vec3(0, 0, 0));
+	float cosine = glm::dot(hit.normal, sample.direction);
+	if (cosine <= 0)
+		return (glm::vec3(0, 0, 0));
+
+	HitRecord occluder;
+	stats.shadowRays += 1;
+	if (world.hit(Ray(hit.p, sample.direction), 0.001f, sample.distance * (1 - SHADOW_EPSILON), occluder))
+		return (glm::vec3(0, 0, 0));
+
+	float bsdfPdf = cosine / glm::pi<float>();
+	glm::vec3 bsdf = material.albedo / glm::pi<float>();
+	return (bsdf * sample.radiance * (cosine * powerHeuristic(sample.pdf, bsdfPdf) / sample.pdf));
+}
+
+float PathTracing::getEmissionWeight(const Ray &ray, const HitRecord &hit, float bsdfPdf) const
+{
+	if (bsdfPdf <= 0)
+		return (1);
+	return (powerHeuristic(bsdfPdf, lights.pdf(ray.getOrigin(), hit)));
+}
+
+float PathTracing::powerHeuristic(float pdf, float otherPdf)
+{
+	float a = pdf * pdf;
+	float b = otherPdf * otherPdf;
+	return (a + b > 0 ? a / (a + b) : 0);
+}
+
+glm::vec3 PathTracing::computeSkyColor(const Ray &ray) const
+{
+	glm::vec3 direction = glm::normalize(ray.getDirection());
+	float t = 0.5f * (direction.y + 1);
+	return ((1 - t) * skyHorizon + t * skyZenith);
 }
\ No newline at end of file
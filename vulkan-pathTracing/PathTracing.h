@@ -1,36 +1,200 @@
 #pragma once
 
-#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
 
+#include "AdaptiveSampler.h"
 #include "IPixelBlockQueueOwner.h"
 #include "PixelBlockQueue.h"
+#include "RenderStats.h"
+#include "Sampler.h"
+#include "TileScheduler.h"
 
 class Camera;
-class HitableCollection;
 class IHitable;
+class MaterialTable;
 class Ray;
+class SphereLights;
+class ThreadPool;
+struct HitRecord;
+struct Material;
+struct PixelBlock;
+struct RayStream;
 
 class PathTracing : public IPixelBlockQueueOwner
 {
-	static constexpr int NBR_THREAD = 2;
 	static constexpr int MAX_DEPTH = 50;
+	static constexpr uint32_t DEFAULT_TILE_SIZE = 16;
+	static constexpr float MAX_ROULETTE_SURVIVAL = 0.95f;
+	static constexpr float DEFAULT_NOISE_THRESHOLD = 0.02f;
+	static constexpr uint32_t DEFAULT_MIN_ADAPTIVE_SAMPLES = 8;
+	static constexpr uint32_t MAX_ADAPTIVE_SAMPLE_FACTOR = 8;
+	static constexpr float NOISE_EPSILON = 0.05f;
+	// Shadow rays stop this fraction of their length before the light.
+	static constexpr float SHADOW_EPSILON = 1e-3f;
 public:
-	PathTracing(int width, int heigth, uint32_t nbSamples,
-		const HitableCollection &collection, const Camera &cam);
+	static constexpr uint32_t DEFAULT_ROULETTE_DEPTH = 8;
+
+	// PER_PATH traces every path of a block to the end before starting the
+	// next one. WAVEFRONT advances all the paths of a block one bounce at a
+	// time and runs the scatter of each material class as one batch.
+	enum class IntegratorMode
+	{
+		PER_PATH,
+		WAVEFRONT
+	};
+
+	// Arbitrary output variables, read from the first hit of the camera
+	// rays. Depth, normal and albedo are averaged over the samples of a
+	// pixel, the ids are the ones of its first sample.
+	enum class Aov : uint32_t
+	{
+		DEPTH, // distance from the camera, 0 for a miss
+		NORMAL, // shading normal, zero for a miss
+		ALBEDO, // white for a miss and the surfaces that do not tint, see recordAovs
+		OBJECT_ID, // see IHitable::getObjectId
+		MATERIAL_ID,
+		COUNT
+	};
+	static constexpr uint32_t MISS_ID = 0xffffffff;
+
+	// materials holds every material id the hit records of world can set,
+	// lights the emissive spheres of world.
+	PathTracing(int width, int heigth, uint32_t nbSamples, const IHitable &world, const MaterialTable &materials,
+		const SphereLights &lights, const Camera &cam, ThreadPool &pool);
 	~PathTracing();
 
+	// Takes effect at the next startRendering.
+	void setTileScheduling(TileScheduler::Order order, uint32_t tileSize);
+	// Paths longer than minDepth bounces are randomly terminated with a
+	// probability driven by their throughput, survivors are reweighted.
+	// Starting earlier saves rays but adds more noise than it saves time on
+	// the sky lit scenes, the default only trims the long tails.
+	void setRussianRoulette(bool enabled, uint32_t minDepth = DEFAULT_ROULETTE_DEPTH);
+	// Takes effect at the next startRendering.
+	void setIntegratorMode(IntegratorMode mode);
+	// At every Lambert bounce a shadow ray is traced toward one of the
+	// lights and combined with the scattered ray by multiple importance
+	// sampling with the power heuristic. Takes effect at the next
+	// startRendering, ignored without lights.
+	void setLightSampling(bool enabled);
+	// Gradient lighting the rays that escape the scene, from the horizon
+	// color to the zenith color.
+	void setSky(const glm::vec3 &horizon, const glm::vec3 &zenith);
+	// Camera rays of each RayPacket::WIDTH square of pixels are traced as
+	// one packet, the bounces one ray at a time. Takes effect at the next
+	// startRendering.
+	void setPrimaryPackets(bool enabled);
+	// Generator of the pixel, lens, scatter, light and roulette numbers,
+	// see Sampler. Takes effect at the next startRendering.
+	void setSampler(Sampler::Type type);
+	// Every pixel first gets minSamples samples, then the rest of the
+	// nbSamples per pixel budget goes to the tiles with the largest relative
+	// standard error, up to MAX_ADAPTIVE_SAMPLE_FACTOR * nbSamples per tile.
+	// Pixels whose error is below noiseThreshold stop being sampled.
+	// Takes effect at the next startRendering.
+	void setAdaptiveSampling(bool enabled, float noiseThreshold = DEFAULT_NOISE_THRESHOLD,
+		uint32_t minSamples = DEFAULT_MIN_ADAPTIVE_SAMPLES);
+	// Fills the depth, normal and albedo AOVs and the variance of every
+	// pixel, to guide a Denoiser. The buffers are only allocated while
+	// enabled. Takes effect at the next startRendering.
+	void setGuideBuffers(bool enabled);
+	// Mask of getAovBit of the AOVs to fill, the others are not allocated
+	// nor written. Takes effect at the next startRendering.
+	void setAovs(uint32_t mask);
+	static uint32_t getAovBit(Aov aov) { return (1u << static_cast<uint32_t>(aov)); }
+	static const char *getAovName(Aov aov);
+
 	void startRendering();
 	void endRendering();
+	// False once every sample was rendered and retrieved, or after endRendering.
+	bool isRendering() const { return (!areThreadStopped); }
 
+	// Notices the end of the render, the picture itself is filled by the
+	// workers as they go.
 	void retreiveThreadResult();
-	const glm::vec3 *getPic() const;
+	// Sleeps until the render ends or timeoutMs elapsed, then retrieves.
+	void waitForResult(uint32_t timeoutMs);
+	// Normalizes the accumulated sums into the returned picture. Safe to
+	// call while the workers are running.
+	const glm::vec3 *getPic();
+
+	// Per pixel buffers laid out like the picture. Misses have a zero
+	// normal and depth and a white albedo; variance is the one of the mean
+	// luminance, the squared luminance until two samples are in.
+	struct Guides
+	{
+		const glm::vec3 *normals;
+		const glm::vec3 *albedos;
+		const float *depths; // distance from the camera
+		const float *variances;
+	};
+
+	// Guides as of the last resolve of the picture, by getPic or a tile
+	// read. False when the guide buffers were not enabled at startRendering.
+	bool getGuides(Guides &guides) const;
+
+	// Null for the AOVs that were not requested, except those the guides
+	// need.
+	struct Aovs
+	{
+		const float *depths;
+		const glm::vec3 *normals;
+		const glm::vec3 *albedos;
+		const uint32_t *objectIds;
+		const uint32_t *materialIds;
+	};
+
+	// AOVs as of the last resolve of the picture, like the guides. False
+	// when none were filled by the last startRendering.
+	bool getAovs(Aovs &aovs) const;
+
+	// Counters of the last startRendering, up to the last block each worker
+	// finished. Safe to call while the workers are running, from the thread
+	// that calls retreiveThreadResult.
+	RenderStats getStats() const;
+
+	int getWidth() const { return (width); }
+	int getHeight() const { return (height); }
+	// Tiles of the last startRendering, zero before the first one.
+	uint32_t getTileCount() const { return (nbTileLocks); }
+	const TileScheduler::Tile &getTile(uint32_t tileIndex) const { return (scheduler.getTile(tileIndex)); }
+
+	// Tile versions a consumer of the picture saw at its last read. Every
+	// consumer keeps its own, so each one only moves what changed for it.
+	struct ReadState
+	{
+		std::vector<uint32_t> tileVersions;
+	};
+
+	// Normalized pixels of a tile, data points to its first pixel and rows
+	// are getWidth() pixels apart, bottom row first like the picture.
+	struct DirtyTile
+	{
+		uint32_t tileIndex;
+		TileScheduler::Tile rect;
+		const glm::vec3 *data;
+	};
+
+	// Resolves the tiles that changed since the last read of this state,
+	// appends them to dirtyTiles and returns how many there were. The data
+	// stays valid until the tile changes again and is resolved by a new read.
+	uint32_t getDirtyTiles(ReadState &state, std::vector<DirtyTile> &dirtyTiles);
+	// Same as getDirtyTiles for a single tile, for consumers that spread the
+	// tiles over several threads. Distinct tiles can be read concurrently
+	// once prepareRead was called on the state.
+	void prepareRead(ReadState &state) const;
+	bool readDirtyTile(ReadState &state, uint32_t tileIndex, DirtyTile &dirtyTile);
 
 	bool queueCanContinue() override;
-	void fillPixelBlock(PixelBlock &block) override;
-	void computePixels();
+	bool fillPixelBlock(uint32_t blockIndex, PixelBlock &block) override;
+	void computePixels(uint32_t threadIndex);
 
 private:
-	bool isRunning = false;
+	std::atomic<bool> isRunning = { false };
 	bool areThreadStopped = true;
 
 	const int width;
@@ -39,18 +203,114 @@ private:
 
 	std::chrono::time_point<std::chrono::steady_clock> startTime;
 
-	const HitableCollection &collection;
+	const IHitable &world;
+	const MaterialTable &materials;
+	const SphereLights &lights;
 	const Camera &cam;
 
+	bool isLightSamplingEnabled = true;
+	bool isLightSamplingActive = false;
+	glm::vec3 skyHorizon = glm::vec3(1, 1, 1);
+	glm::vec3 skyZenith = glm::vec3(0.5f, 0.7f, 1);
+
+	// Workers add their radiance to picSum and picSamples under the lock of
+	// the tile, pic only holds the normalized copy built by the reads.
 	glm::vec3 *pic;
+	glm::vec3 *picSum;
+	uint32_t *picSamples;
+	float *picLuminanceSq; // sum of the squared luminance of the samples, for adaptive sampling and the guides
+	bool *picConverged;
+	std::unique_ptr<std::mutex[]> tileLocks;
+	// Bumped on every accumulated block and on restart, never goes back.
+	std::unique_ptr<std::atomic<uint32_t>[]> tileVersions;
+	uint32_t nbTileLocks = 0;
+
+	TileScheduler scheduler;
+	TileScheduler::Order tileOrder = TileScheduler::Order::HILBERT;
+	uint32_t tileSize = DEFAULT_TILE_SIZE;
+
+	bool isRouletteEnabled = true;
+	uint32_t rouletteDepth = DEFAULT_ROULETTE_DEPTH;
+
+	IntegratorMode integratorMode = IntegratorMode::PER_PATH;
+	IntegratorMode activeIntegratorMode = IntegratorMode::PER_PATH;
+
+	bool arePrimaryPacketsEnabled = true;
+	bool arePrimaryPacketsActive = true;
+
+	Sampler::Type samplerType = Sampler::Type::SOBOL;
+	Sampler::Type activeSamplerType = Sampler::Type::SOBOL;
+
+	bool areGuidesEnabled = false;
+	bool areGuidesActive = false;
+	uint32_t aovMask = 0;
+	// Requested AOVs plus those the guides need.
+	uint32_t activeAovMask = 0;
+	// Sums and first ids next to picSum, their resolved copies next to pic.
+	// Empty unless their AOV is active.
+	std::vector<float> depthSum;
+	std::vector<glm::vec3> normalSum;
+	std::vector<glm::vec3> albedoSum;
+	std::vector<uint32_t> firstObjectIds;
+	std::vector<uint32_t> firstMaterialIds;
+	std::vector<float> aovDepths;
+	std::vector<glm::vec3> aovNormals;
+	std::vector<glm::vec3> aovAlbedos;
+	std::vector<uint32_t> aovObjectIds;
+	std::vector<uint32_t> aovMaterialIds;
+	std::vector<float> guideVariances;
+
+	bool isAdaptiveEnabled = false;
+	float noiseThreshold = DEFAULT_NOISE_THRESHOLD;
+	uint32_t adaptiveMinSamples = DEFAULT_MIN_ADAPTIVE_SAMPLES;
+	bool isAdaptiveActive = false;
+	uint32_t uniformPasses = 0;
+	// Pixel samples left for the adaptive passes, skipped pixels do not use
+	// any of it.
+	std::atomic<int64_t> adaptiveBudget = { 0 };
+	AdaptiveSampler sampler;
 
-	uint32_t cx = 0;
-	uint32_t cy = 0;
-	uint32_t cs = 0;
-	uint32_t renderedSamples = 0;
+	// One per worker, only locked by its worker once per block and by
+	// getStats.
+	struct alignas(64) ThreadStats
+	{
+		std::mutex locker;
+		RenderStats stats;
+	};
+	std::unique_ptr<ThreadStats[]> threadStats;
+	double retrieveSeconds = 0;
 
 	PixelBlockQueue queue;
-	std::thread *threads[NBR_THREAD];
+	ThreadPool &pool;
 
-	glm::vec3 computeColor(const Ray &ray, const IHitable &world, int depth);
+	uint32_t resolveTile(uint32_t tileIndex);
+	void allocateAovs();
+	bool isAovActive(Aov aov) const { return ((activeAovMask & getAovBit(aov)) != 0); }
+	void accumulateBlock(const PixelBlock &block);
+	// Variance of the mean luminance of a pixel with at least 2 samples.
+	float computeMeanVariance(uint32_t pixel) const;
+	float computeRelativeError(uint32_t pixel) const;
+	static float computeLuminance(const glm::vec3 &color);
+	Ray generateCameraRay(uint32_t cx, uint32_t cy, uint32_t nbSample, Sampler &pathSampler) const;
+	void publishStats(uint32_t threadIndex, RenderStats &stats);
+	void computeBlock(PixelBlock &block, Sampler &pathSampler, RenderStats &stats) const;
+	void computeBlockPackets(PixelBlock &block, const Sampler &pathSampler, RenderStats &stats) const;
+	void computeBlockWavefront(PixelBlock &block, RayStream &stream, RenderStats &stats) const;
+	void tracePrimaryPackets(const PixelBlock &block, RayStream &stream) const;
+	void recordAovs(PixelBlock &block, uint32_t i, const Ray &cameraRay, bool isHit, const HitRecord &hit) const;
+	// Normal of the hit turned toward the ray, since meshes are hit from
+	// both sides, except for Dialectric which tells entering from leaving
+	// by the outward normal.
+	static glm::vec3 getShadingNormal(const Ray &ray, const Material &material, const HitRecord &hit);
+	// Radiance of a path once its camera ray was traced.
+	glm::vec3 continuePath(const Ray &cameraRay, bool isHit, const HitRecord &cameraHit, Sampler &pathSampler, RenderStats &stats) const;
+	bool survivesRoulette(int depth, glm::vec3 &throughput, const Sampler &pathSampler) const;
+	// Light sampled from a Lambert hit, weighted for the combination with
+	// the scattered ray.
+	glm::vec3 sampleDirectLight(const HitRecord &hit, const Material &material, const Sampler &pathSampler, RenderStats &stats) const;
+	// Weight of the radiance of an emissive surface reached by a ray
+	// scattered with bsdfPdf, 0 when the bounce did not sample the lights.
+	float getEmissionWeight(const Ray &ray, const HitRecord &hit, float bsdfPdf) const;
+	static float powerHeuristic(float pdf, float otherPdf);
+	glm::vec3 computeSkyColor(const Ray &ray) const;
 };
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+// PCG32 random number generator (pcg-random.org), a 16 bytes state for the
+// scene setup and the tools. The renderer reads its numbers from a Sampler,
+// addressed by pixel, sample and dimension.
+class Pcg32
+{
+	static constexpr uint64_t MULTIPLIER = 6364136223846793005ULL;
+
+	uint64_t state = 0x853c49e6748fea9bULL;
+	uint64_t increment = 0xda3e39cb94b95bdbULL;
+
+public:
+	Pcg32() = default;
+	Pcg32(uint64_t initState, uint64_t sequence)
+	{
+		seed(initState, sequence);
+	}
+
+	void seed(uint64_t initState, uint64_t sequence)
+	{
+		state = 0;
+		increment = (sequence << 1) | 1;
+		nextUInt();
+		state += initState;
+		nextUInt();
+	}
+
+	uint32_t nextUInt()
+	{
+		uint64_t oldState = state;
+		state = oldState * MULTIPLIER + increment;
+		uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18) ^ oldState) >> 27);
+		uint32_t rot = static_cast<uint32_t>(oldState >> 59);
+		return ((xorShifted >> rot) | (xorShifted << ((~rot + 1) & 31)));
+	}
+
+	// Uniform float in [0, 1) with the full 24 bits of mantissa.
+	float nextFloat()
+	{
+		return (static_cast<float>(nextUInt() >> 8) * (1.0f / 16777216.0f));
+	}
+};
\ No newline at end of file
@@ -4,19 +4,37 @@
 
 #include <stdint.h>
 
-class PixelBlockQueue;
+struct PixelBlockAovs;
 
+// Rectangle of the image rendered for one sample. The buffer is row major
+// with blockWidth pixels per row.
 struct PixelBlock
 {
-	static constexpr uint32_t NBR_PIXELS_PER_BLOCK = 512;
+	static constexpr uint32_t MAX_PIXELS_PER_BLOCK = 1024;
 
-	uint32_t startingPixel = 0;
-	uint32_t length = 0;
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t blockWidth = 0;
+	uint32_t blockHeight = 0;
 	uint32_t nbSample = 0;
-	glm::vec3 buffer[NBR_PIXELS_PER_BLOCK] = {};
+	uint32_t tileIndex = 0;
+	// Set by adaptive sampling for the pixels that already converged, they
+	// are neither traced nor accumulated.
+	bool hasSkippedPixels = false;
+	bool isPixelSkipped[MAX_PIXELS_PER_BLOCK] = {};
+	glm::vec3 buffer[MAX_PIXELS_PER_BLOCK] = {};
+	// Owned by the worker of the PixelBlockQueue holding the block, null
+	// unless the PathTracing fills AOVs.
+	PixelBlockAovs *aovs = nullptr;
+};
 
-private:
-	friend class PixelBlockQueue;
-	bool isWaitingForHarvest = false;
-	bool isProcessed = false;
+// First hit of the camera ray of every pixel of a block, kept apart so the
+// blocks stay small when no AOV is requested.
+struct PixelBlockAovs
+{
+	float depths[PixelBlock::MAX_PIXELS_PER_BLOCK] = {};
+	glm::vec3 normals[PixelBlock::MAX_PIXELS_PER_BLOCK] = {};
+	glm::vec3 albedos[PixelBlock::MAX_PIXELS_PER_BLOCK] = {};
+	uint32_t objectIds[PixelBlock::MAX_PIXELS_PER_BLOCK] = {};
+	uint32_t materialIds[PixelBlock::MAX_PIXELS_PER_BLOCK] = {};
 };
\ No newline at end of file
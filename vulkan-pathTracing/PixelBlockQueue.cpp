@@ -1,62 +1,60 @@
 #include "PixelBlockQueue.h"
 
-PixelBlockQueue::PixelBlockQueue(IPixelBlockQueueOwner &owner)
+PixelBlockQueue::PixelBlockQueue(IPixelBlockQueueOwner &owner, uint32_t nbWorkers)
 	: owner(owner)
-{}
-
-PixelBlockQueue::ReturnType PixelBlockQueue::getPixelBlockToProcess(PixelBlock **block)
 {
-	*block = nullptr;
-	ReturnType ret = ReturnType::NO_BLOCK_AVAILABLE;
-	
-	locker.lock();
-	if (!owner.queueCanContinue())
+	for (uint32_t i = 0; i < nbWorkers; i++)
 	{
-		locker.unlock();
-		return (ReturnType::RENDERING_FINISHED);
+		workers.emplace_back(new Worker());
 	}
-	for (size_t i = 0; i < NBR_BLOCKS; i++)
-	{
-		if (!blocks[i].isWaitingForHarvest && !blocks[i].isProcessed)
-		{
-			*block = &blocks[i];
-			owner.fillPixelBlock(blocks[i]);
-			blocks[i].isProcessed = true;
-			ret = ReturnType::SUCCESS;
-			break;
-		}
-	}
-	locker.unlock();
-	return (ret);
 }
 
-void PixelBlockQueue::releaseProcessedPixelBlock(PixelBlock *block)
+void PixelBlockQueue::reset(bool hasAovs)
 {
-	locker.lock();
-	block->isProcessed = false;
-	block->isWaitingForHarvest = true;
-	locker.unlock();
+	nextBlock.store(0, std::memory_order_relaxed);
+	nbCompletedBlocks.store(0, std::memory_order_relaxed);
+	for (std::unique_ptr<Worker> &worker : workers)
+	{
+		if (!hasAovs)
+			worker->aovs.reset();
+		else if (!worker->aovs)
+			worker->aovs.reset(new PixelBlockAovs());
+		worker->block.aovs = worker->aovs.get();
+		worker->isFinished.store(false, std::memory_order_release);
+	}
 }
 
-PixelBlockQueue::ReturnType PixelBlockQueue::getPixelBlockToDraw(PixelBlock *block)
+PixelBlockQueue::ReturnType PixelBlockQueue::getPixelBlockToProcess(uint32_t workerIndex, PixelBlock **block)
 {
-	bool isJobProcessing = false;
+	Worker &worker = *workers[workerIndex];
+	*block = nullptr;
 
-	locker.lock();
-	for (int16_t i = 0; i < NBR_BLOCKS; i++)
+	if (owner.queueCanContinue())
 	{
-		if (blocks[i].isWaitingForHarvest)
+		uint32_t index = nextBlock.fetch_add(1, std::memory_order_relaxed);
+		if (owner.fillPixelBlock(index, worker.block))
 		{
-			memcpy(block, &blocks[i], sizeof(PixelBlock));
-			blocks[i].isWaitingForHarvest = false;
-			locker.unlock();
+			*block = &worker.block;
 			return (ReturnType::SUCCESS);
 		}
-		else if (blocks[i].isProcessed)
-			isJobProcessing = true;
 	}
-	locker.unlock();
-	if (isJobProcessing)
-		return (ReturnType::NO_BLOCK_AVAILABLE);
+
+	// Publishes everything this worker accumulated.
+	worker.isFinished.store(true, std::memory_order_release);
 	return (ReturnType::RENDERING_FINISHED);
+}
+
+void PixelBlockQueue::releaseProcessedPixelBlock()
+{
+	nbCompletedBlocks.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool PixelBlockQueue::isFinished() const
+{
+	for (const std::unique_ptr<Worker> &worker : workers)
+	{
+		if (!worker->isFinished.load(std::memory_order_acquire))
+			return (false);
+	}
+	return (true);
 }
\ No newline at end of file
@@ -2,37 +2,56 @@
 
 #include <glm/glm.hpp>
 
-#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 #include "IPixelBlockQueueOwner.h"
 #include "PixelBlock.h"
 
+// Hands out pixel blocks to the workers with a single atomic counter. The
+// workers accumulate their blocks themselves, so nothing goes back to the
+// consumer but a count of completed blocks: each worker refills the same
+// block and only says when it is done.
 class PixelBlockQueue
 {
 public:
-	static constexpr uint16_t NBR_BLOCKS = 4;
-
 	enum class ReturnType
 	{
 		SUCCESS,
-		NO_BLOCK_AVAILABLE,
 		RENDERING_FINISHED
 	};
 
-	PixelBlockQueue(IPixelBlockQueueOwner &owner);
+	PixelBlockQueue(IPixelBlockQueueOwner &owner, uint32_t nbWorkers);
+
+	// Must only be called while no worker is running. With hasAovs every
+	// block handed out has a PixelBlockAovs attached.
+	void reset(bool hasAovs);
 
-	ReturnType getPixelBlockToProcess(PixelBlock **block);
-	void releaseProcessedPixelBlock(PixelBlock *block);
+	// Worker side, workerIndex selects the block of the calling worker. The
+	// block is refilled by the next call, release it once accumulated.
+	ReturnType getPixelBlockToProcess(uint32_t workerIndex, PixelBlock **block);
+	void releaseProcessedPixelBlock();
 
-	ReturnType getPixelBlockToDraw(PixelBlock *block);
+	// Consumer side, safe to call while the workers are running.
+	uint32_t getCompletedBlockCount() const { return (nbCompletedBlocks.load(std::memory_order_relaxed)); }
+	// Every worker ran out of blocks, so everything they rendered is
+	// accumulated.
+	bool isFinished() const;
 
 private:
+	struct Worker
+	{
+		PixelBlock block;
+		std::unique_ptr<PixelBlockAovs> aovs;
 
-#define INC(a) a + 1 < NBR_BLOCKS ? a + 1 : 0 
+		alignas(64) std::atomic<bool> isFinished = { true };
+	};
 
 	IPixelBlockQueueOwner &owner;
 
-	PixelBlock blocks[NBR_BLOCKS];
+	alignas(64) std::atomic<uint32_t> nextBlock = { 0 };
+	alignas(64) std::atomic<uint32_t> nbCompletedBlocks = { 0 };
 
-	std::mutex locker;
+	std::vector<std::unique_ptr<Worker>> workers;
 };
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "RayPacket.h"
+
+#include <float.h>
+
+#include <cmath>
+
+constexpr uint32_t RayPacket::WIDTH;
+constexpr uint32_t RayPacket::SIZE;
+constexpr uint32_t RayPacket::MIN_RAYS;
+
+void RayPacket::prepare()
+{
+	minOrigin = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	maxOrigin = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	minInvDirection = minOrigin;
+	maxInvDirection = maxOrigin;
+	isCoherent = true;
+
+	uint32_t nbRays = 0;
+	for (uint32_t lane = 0; lane < SIZE; lane++)
+	{
+		if (!(activeMask & (1u << lane)))
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				origins[a][lane] = 0;
+				invDirections[a][lane] = 0;
+			}
+			continue;
+		}
+
+		const glm::vec3 &origin = rays[lane].getOrigin();
+		glm::vec3 invDirection = 1.0f / rays[lane].getDirection();
+		for (int a = 0; a < 3; a++)
+		{
+			if (nbRays == 0)
+				isDirectionNegative[a] = invDirection[a] < 0;
+			if ((invDirection[a] < 0) != isDirectionNegative[a] || std::isinf(invDirection[a]))
+				isCoherent = false;
+			origins[a][lane] = origin[a];
+			invDirections[a][lane] = invDirection[a];
+		}
+		minOrigin = glm::min(minOrigin, origin);
+		maxOrigin = glm::max(maxOrigin, origin);
+		minInvDirection = glm::min(minInvDirection, invDirection);
+		maxInvDirection = glm::max(maxInvDirection, invDirection);
+		nbRays++;
+	}
+	if (nbRays < MIN_RAYS)
+		isCoherent = false;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include "Ray.h"
+
+// Camera rays of a square of WIDTH x WIDTH neighbouring pixels, traced
+// together through a BVH. The rays are kept as Ray for the primitives and
+// as structure of arrays for the box tests, one SIMD lane per ray.
+struct RayPacket
+{
+	static constexpr uint32_t WIDTH = 4;
+	static constexpr uint32_t SIZE = WIDTH * WIDTH;
+	// Packets with fewer rays are traced one ray at a time.
+	static constexpr uint32_t MIN_RAYS = 4;
+
+	Ray rays[SIZE];
+	uint32_t activeMask = 0; // bit i is set when rays[i] is traced
+
+	// Filled by prepare, inactive lanes hold zeros and must be masked out.
+	alignas(16) float origins[3][SIZE];
+	alignas(16) float invDirections[3][SIZE];
+	// Bounds over the active rays, for the interval test of whole nodes.
+	glm::vec3 minOrigin;
+	glm::vec3 maxOrigin;
+	glm::vec3 minInvDirection;
+	glm::vec3 maxInvDirection;
+	bool isDirectionNegative[3];
+	// False when the rays do not share the sign of every direction
+	// component, when one of them is parallel to an axis or when there are
+	// too few of them.
+	bool isCoherent = false;
+
+	void clear() { activeMask = 0; }
+	void set(uint32_t lane, const Ray &ray)
+	{
+		rays[lane] = ray;
+		activeMask |= 1u << lane;
+	}
+	// To call once every ray is set.
+	void prepare();
+};
\ No newline at end of file
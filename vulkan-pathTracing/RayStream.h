@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include "HitRecord.h"
+#include "Material.h"
+#include "PixelBlock.h"
+#include "Ray.h"
+#include "Sampler.h"
+
+// Structure of arrays state of every path of a pixel block, used by the
+// wavefront integrator. Entries are indexed by the pixel of the path inside
+// its block; active and sorted only hold indices so the bulky per-path data
+// never moves while paths are compacted or grouped by material.
+struct RayStream
+{
+	static constexpr uint32_t CAPACITY = PixelBlock::MAX_PIXELS_PER_BLOCK;
+
+	Ray rays[CAPACITY];
+	HitRecord records[CAPACITY];
+	glm::vec3 throughputs[CAPACITY];
+	glm::vec3 attenuations[CAPACITY];
+	float bsdfPdfs[CAPACITY]; // of the last bounce, see PathTracing::getEmissionWeight
+	Sampler samplers[CAPACITY];
+	Material::Type materialTypes[CAPACITY];
+	uint8_t isScattered[CAPACITY];
+	// Only set for the camera rays traced as packets.
+	uint8_t isHit[CAPACITY];
+
+	uint32_t active[CAPACITY];
+	uint32_t sorted[CAPACITY];
+	uint32_t nbActive = 0;
+};
\ No newline at end of file
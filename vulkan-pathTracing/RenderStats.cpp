@@ -0,0 +1,46 @@
+#include "RenderStats.h"
+
+constexpr uint32_t RenderStats::PATH_LENGTH_BUCKETS;
+
+thread_local RenderStats *RenderStats::threadStats = nullptr;
+
+void RenderStats::add(const RenderStats &other)
+{
+	cameraRays += other.cameraRays;
+	secondaryRays += other.secondaryRays;
+	shadowRays += other.shadowRays;
+	primitiveTests += other.primitiveTests;
+	nodeVisits += other.nodeVisits;
+	for (uint32_t i = 0; i < PATH_LENGTH_BUCKETS; i++)
+		pathLengths[i] += other.pathLengths[i];
+	queueSeconds += other.queueSeconds;
+	retrieveSeconds += other.retrieveSeconds;
+}
+
+void RenderStats::print(FILE *file, double seconds) const
+{
+	constexpr double MEGA = 1e6;
+	uint64_t nbRays = getRayCount();
+	fprintf(file, "Rays: %.3f M camera, %.3f M secondary, %.3f M shadow, %.3f M rays/s\n", cameraRays / MEGA,
+		secondaryRays / MEGA, shadowRays / MEGA, seconds > 0 ? nbRays / seconds / MEGA : 0);
+	if (nbRays > 0)
+	{
+		fprintf(file, "Per ray: %.1f BVH nodes visited, %.1f primitives tested\n", static_cast<double>(nodeVisits) / nbRays,
+			static_cast<double>(primitiveTests) / nbRays);
+	}
+
+	uint64_t nbPaths = 0;
+	for (uint32_t i = 0; i < PATH_LENGTH_BUCKETS; i++)
+		nbPaths += pathLengths[i];
+	if (nbPaths > 0)
+	{
+		fprintf(file, "Bounces per path:");
+		for (uint32_t i = 0; i < PATH_LENGTH_BUCKETS; i++)
+		{
+			if (pathLengths[i] > 0)
+				fprintf(file, " %u%s %.1f%%", i, i + 1 == PATH_LENGTH_BUCKETS ? "+" : "", 100.0 * pathLengths[i] / nbPaths);
+		}
+		fprintf(file, "\n");
+	}
+	fprintf(file, "Time in the block queue %.3f s over all workers, retrieving results %.3f s\n", queueSeconds, retrieveSeconds);
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Counters of the work of the render threads. Every worker increments its
+// own copy with plain adds and hands it to the PathTracing after each block,
+// which sums the copies on request, so the counting threads never share a
+// cache line or an atomic.
+struct RenderStats
+{
+	// Paths of more bounces are counted in the last bucket.
+	static constexpr uint32_t PATH_LENGTH_BUCKETS = 16;
+
+	uint64_t cameraRays = 0;
+	uint64_t secondaryRays = 0; // scattered rays
+	uint64_t shadowRays = 0;
+	uint64_t primitiveTests = 0; // spheres and triangles
+	uint64_t nodeVisits = 0; // BVH nodes, of the scene and of the meshes
+	uint64_t pathLengths[PATH_LENGTH_BUCKETS] = {}; // paths by number of bounces
+	// Summed over the workers.
+	double queueSeconds = 0; // getting blocks from and handing them back to the PixelBlockQueue
+	// On the thread that retrieves the results.
+	double retrieveSeconds = 0;
+
+	void add(const RenderStats &other);
+	void addPathLength(uint32_t bounces) { pathLengths[bounces < PATH_LENGTH_BUCKETS ? bounces : PATH_LENGTH_BUCKETS - 1] += 1; }
+	uint64_t getRayCount() const { return (cameraRays + secondaryRays + shadowRays); }
+	// Summary of a render that took seconds.
+	void print(FILE *file, double seconds) const;
+
+	// Counters of the calling thread, null unless it renders. The hitables
+	// add their node visits and primitive tests there.
+	static RenderStats *getThreadStats() { return (threadStats); }
+	static void setThreadStats(RenderStats *stats) { threadStats = stats; }
+
+private:
+	static thread_local RenderStats *threadStats;
+};
\ No newline at end of file
@@ -0,0 +1,501 @@
+#include "Sampler.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "Pcg32.h"
+
+constexpr uint32_t Sampler::PIXEL;
+constexpr uint32_t Sampler::LENS;
+constexpr uint32_t Sampler::CAMERA_DIMENSIONS;
+constexpr uint32_t Sampler::SCATTER;
+constexpr uint32_t Sampler::ROULETTE;
+constexpr uint32_t Sampler::LIGHT;
+constexpr uint32_t Sampler::BOUNCE_DIMENSIONS;
+
+namespace
+{
+	constexpr float ONE_MINUS_EPSILON = 0.99999994f;
+	constexpr uint32_t SOBOL_DIMENSIONS = 4;
+	constexpr uint32_t MAX_HALTON_DIMENSIONS = 128;
+	// Every pixel of BLUE_NOISE draws the same scrambled sequence.
+	constexpr uint32_t BLUE_NOISE_SEED = 0x2545f491u;
+
+	// Integer hash with a low bias (Wellons, "Prospecting for hash functions").
+	uint32_t mix(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return (x);
+	}
+
+	uint32_t hashCombine(uint32_t seed, uint32_t value)
+	{
+		return (mix(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2))));
+	}
+
+	float toFloat(uint32_t bits)
+	{
+		return (static_cast<float>(bits >> 8) * (1.0f / 16777216.0f));
+	}
+
+	uint32_t reverseBits(uint32_t x)
+	{
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+		x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+		x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+		x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+		return (x);
+	}
+
+	// Owen scrambling of the bits of x from the highest one down, as a hash
+	// (Burley, "Practical Hash-based Owen Scrambling").
+	uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+	{
+		x = reverseBits(x);
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return (reverseBits(x));
+	}
+
+	// Random permutation of [0, length) indexed by seed (Kensler,
+	// "Correlated Multi-Jittered Sampling").
+	uint32_t permute(uint32_t i, uint32_t length, uint32_t seed)
+	{
+		uint32_t w = length - 1;
+		w |= w >> 1;
+		w |= w >> 2;
+		w |= w >> 4;
+		w |= w >> 8;
+		w |= w >> 16;
+		do
+		{
+			i ^= seed;
+			i *= 0xe170893du;
+			i ^= seed >> 16;
+			i ^= (i & w) >> 4;
+			i ^= seed >> 8;
+			i *= 0x0929eb3fu;
+			i ^= seed >> 23;
+			i ^= (i & w) >> 1;
+			i *= 1 | seed >> 27;
+			i *= 0x6935fa69u;
+			i ^= (i & w) >> 11;
+			i *= 0x74dcb303u;
+			i ^= (i & w) >> 2;
+			i *= 0x9e501cc3u;
+			i ^= (i & w) >> 2;
+			i *= 0xc860a3dfu;
+			i &= w;
+			i ^= i >> 5;
+		} while (i >= length);
+		return ((i + seed) % length);
+	}
+
+	// Direction numbers of the first 4 Sobol dimensions (Joe and Kuo), the
+	// first one being the van der Corput sequence, read a byte of index at a
+	// time. Only the low 24 bits of the scrambled index are used: for the
+	// first 2^24 samples of a pixel the bits above only depend on zeros, the
+	// constant they add is a digital shift the Owen scramble of the value
+	// absorbs.
+	class SobolMatrices
+	{
+	public:
+		SobolMatrices()
+		{
+			static const uint32_t degrees[SOBOL_DIMENSIONS] = { 0, 1, 2, 3 };
+			static const uint32_t polynomials[SOBOL_DIMENSIONS] = { 0, 0, 1, 1 };
+			static const uint32_t initials[SOBOL_DIMENSIONS][3] = { {}, { 1 }, { 1, 3 }, { 1, 3, 1 } };
+
+			uint32_t directions[SOBOL_DIMENSIONS][INDEX_BITS];
+			for (uint32_t bit = 0; bit < INDEX_BITS; bit++)
+				directions[0][bit] = 1u << (31 - bit);
+			for (uint32_t d = 1; d < SOBOL_DIMENSIONS; d++)
+			{
+				uint32_t s = degrees[d];
+				uint32_t *v = directions[d];
+				for (uint32_t bit = 0; bit < INDEX_BITS; bit++)
+				{
+					if (bit < s)
+					{
+						v[bit] = initials[d][bit] << (31 - bit);
+						continue;
+					}
+					v[bit] = v[bit - s] ^ (v[bit - s] >> s);
+					for (uint32_t k = 1; k < s; k++)
+					{
+						if ((polynomials[d] >> (s - 1 - k)) & 1)
+							v[bit] ^= v[bit - k];
+					}
+				}
+			}
+
+			for (uint32_t d = 0; d < SOBOL_DIMENSIONS; d++)
+			{
+				for (uint32_t byte = 0; byte < INDEX_BYTES; byte++)
+				{
+					for (uint32_t value = 0; value < 256; value++)
+					{
+						uint32_t x = 0;
+						for (uint32_t bit = 0; bit < 8; bit++)
+						{
+							if (value & (1u << bit))
+								x ^= directions[d][byte * 8 + bit];
+						}
+						tables[d][byte][value] = x;
+					}
+				}
+			}
+		}
+
+		uint32_t sample(uint32_t index, uint32_t dimension) const
+		{
+			const uint32_t (*table)[256] = tables[dimension];
+			return (table[0][index & 0xff] ^ table[1][(index >> 8) & 0xff] ^ table[2][(index >> 16) & 0xff]);
+		}
+
+	private:
+		static constexpr uint32_t INDEX_BYTES = 3;
+		static constexpr uint32_t INDEX_BITS = INDEX_BYTES * 8;
+
+		uint32_t tables[SOBOL_DIMENSIONS][INDEX_BYTES][256];
+	};
+
+	struct HaltonPrimes
+	{
+		uint32_t primes[MAX_HALTON_DIMENSIONS];
+
+		HaltonPrimes()
+		{
+			uint32_t count = 0;
+			for (uint32_t n = 2; count < MAX_HALTON_DIMENSIONS; n++)
+			{
+				bool isPrime = true;
+				for (uint32_t i = 0; i < count && primes[i] * primes[i] <= n; i++)
+				{
+					if (n % primes[i] == 0)
+					{
+						isPrime = false;
+						break;
+					}
+				}
+				if (isPrime)
+					primes[count++] = n;
+			}
+		}
+	};
+
+	// Toroidal 64x64 blue noise ranks built by void and cluster (Ulichney),
+	// stored as values in (0, 1) spread evenly.
+	class BlueNoiseMask
+	{
+	public:
+		static constexpr uint32_t SIDE = 64;
+		static constexpr uint32_t SIZE = SIDE * SIDE;
+
+		BlueNoiseMask()
+		{
+			static constexpr float SIGMA = 1.5f;
+			// The 64x64 mask settles after about 150 swaps.
+			static constexpr uint32_t MAX_SWAPS = SIZE;
+			for (uint32_t dy = 0; dy < SIDE; dy++)
+			{
+				for (uint32_t dx = 0; dx < SIDE; dx++)
+				{
+					float x = static_cast<float>(std::min(dx, SIDE - dx));
+					float y = static_cast<float>(std::min(dy, SIDE - dy));
+					kernel[dx + dy * SIDE] = expf(-(x * x + y * y) / (2 * SIGMA * SIGMA));
+				}
+			}
+
+			// Initial pattern: a tenth of the cells at random, then the
+			// tightest cluster is moved to the largest void until it stays,
+			// or MAX_SWAPS times should the moves cycle instead.
+			Pcg32 rng(SIZE, 1);
+			uint32_t nbPoints = 0;
+			while (nbPoints < SIZE / 10)
+			{
+				uint32_t cell = rng.nextUInt() % SIZE;
+				if (!isSet[cell])
+				{
+					togglePoint(cell);
+					nbPoints++;
+				}
+			}
+			for (uint32_t swap = 0; swap < MAX_SWAPS; swap++)
+			{
+				uint32_t cluster = findExtreme(true);
+				togglePoint(cluster);
+				uint32_t hole = findExtreme(false);
+				togglePoint(hole);
+				if (hole == cluster)
+					break;
+			}
+
+			bool prototype[SIZE];
+			std::copy(isSet, isSet + SIZE, prototype);
+			float prototypeEnergy[SIZE];
+			std::copy(energy, energy + SIZE, prototypeEnergy);
+
+			// Points of the prototype are ranked by removing the tightest
+			// clusters, the other cells by filling the largest voids.
+			uint32_t ranks[SIZE];
+			for (uint32_t rank = nbPoints; rank > 0; rank--)
+			{
+				uint32_t cluster = findExtreme(true);
+				togglePoint(cluster);
+				ranks[cluster] = rank - 1;
+			}
+			std::copy(prototype, prototype + SIZE, isSet);
+			std::copy(prototypeEnergy, prototypeEnergy + SIZE, energy);
+			for (uint32_t rank = nbPoints; rank < SIZE; rank++)
+			{
+				uint32_t hole = findExtreme(false);
+				togglePoint(hole);
+				ranks[hole] = rank;
+			}
+
+			for (uint32_t cell = 0; cell < SIZE; cell++)
+				values[cell] = (static_cast<float>(ranks[cell]) + 0.5f) / SIZE;
+		}
+
+		float get(uint32_t x, uint32_t y) const { return (values[(x % SIDE) + (y % SIDE) * SIDE]); }
+
+	private:
+		float kernel[SIZE];
+		float energy[SIZE] = {};
+		bool isSet[SIZE] = {};
+		float values[SIZE];
+
+		void togglePoint(uint32_t cell)
+		{
+			isSet[cell] = !isSet[cell];
+			float sign = isSet[cell] ? 1.0f : -1.0f;
+			uint32_t cx = cell % SIDE;
+			uint32_t cy = cell / SIDE;
+			for (uint32_t y = 0; y < SIDE; y++)
+			{
+				const float *row = kernel + ((y - cy) & (SIDE - 1)) * SIDE;
+				for (uint32_t x = 0; x < SIDE; x++)
+					energy[x + y * SIDE] += sign * row[(x - cx) & (SIDE - 1)];
+			}
+		}
+
+		// Set cell of highest energy, or free cell of lowest energy.
+		uint32_t findExtreme(bool isCluster) const
+		{
+			uint32_t best = 0;
+			bool isFound = false;
+			for (uint32_t cell = 0; cell < SIZE; cell++)
+			{
+				if (isSet[cell] != isCluster)
+					continue;
+				if (!isFound || (isCluster ? energy[cell] > energy[best] : energy[cell] < energy[best]))
+				{
+					best = cell;
+					isFound = true;
+				}
+			}
+			return (best);
+		}
+	};
+
+	const SobolMatrices sobolMatrices;
+	const HaltonPrimes haltonPrimes;
+
+	// Only built by the first BLUE_NOISE sample, it takes a few tens of
+	// milliseconds.
+	const BlueNoiseMask &getBlueNoiseMask()
+	{
+		static const BlueNoiseMask mask;
+		return (mask);
+	}
+}
+
+Sampler::Sampler(Type type, uint32_t nbSamples)
+	: type(type), nbSamples(nbSamples > 0 ? nbSamples : 1)
+{
+}
+
+void Sampler::startSample(uint32_t newX, uint32_t newY, uint32_t newSample)
+{
+	x = newX;
+	y = newY;
+	sample = newSample;
+	pixelSeed = mix(x + mix(y + 0x9e3779b9u));
+	base = 0;
+}
+
+float Sampler::get1D(uint32_t offset) const
+{
+	float value;
+	get(base + offset, 1, &value);
+	return (value);
+}
+
+glm::vec2 Sampler::get2D(uint32_t offset) const
+{
+	float values[2];
+	get(base + offset, 2, values);
+	return (glm::vec2(values[0], values[1]));
+}
+
+glm::vec3 Sampler::get3D(uint32_t offset) const
+{
+	float values[3];
+	get(base + offset, 3, values);
+	return (glm::vec3(values[0], values[1], values[2]));
+}
+
+const char *Sampler::getTypeName(Type type)
+{
+	switch (type)
+	{
+	case Type::STRATIFIED:
+		return ("stratified");
+	case Type::SOBOL:
+		return ("sobol");
+	case Type::HALTON:
+		return ("halton");
+	case Type::BLUE_NOISE:
+		return ("bluenoise");
+	default:
+		return ("random");
+	}
+}
+
+void Sampler::get(uint32_t dimension, uint32_t count, float *values) const
+{
+	switch (type)
+	{
+	case Type::STRATIFIED:
+	{
+		uint32_t i = 0;
+		if (count >= 2)
+		{
+			glm::vec2 xy = getStratified2D(dimension);
+			values[i++] = xy.x;
+			values[i++] = xy.y;
+		}
+		for (; i < count; i++)
+			values[i] = getStratified(dimension + i);
+		break;
+	}
+	case Type::SOBOL:
+		getSobol(dimension, count, pixelSeed, values);
+		break;
+	case Type::HALTON:
+		for (uint32_t i = 0; i < count; i++)
+			values[i] = getHalton(dimension + i);
+		break;
+	case Type::BLUE_NOISE:
+		getSobol(dimension, count, BLUE_NOISE_SEED, values);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			float value = values[i] + getBlueNoiseOffset(dimension + i);
+			if (value >= 1)
+				value -= 1;
+			values[i] = std::min(value, ONE_MINUS_EPSILON);
+		}
+		break;
+	default:
+		for (uint32_t i = 0; i < count; i++)
+			values[i] = getRandom(dimension + i);
+		break;
+	}
+}
+
+float Sampler::getRandom(uint32_t dimension) const
+{
+	return (toFloat(hashCombine(hashCombine(pixelSeed, sample), dimension)));
+}
+
+// Sample i of a round falls in stratum permute(i) of nbSamples, shuffled
+// differently for every dimension and round.
+float Sampler::getStratified(uint32_t dimension) const
+{
+	uint32_t round = sample / nbSamples;
+	uint32_t seed = hashCombine(hashCombine(pixelSeed, dimension), round);
+	uint32_t stratum = permute(sample % nbSamples, nbSamples, seed);
+	float jitter = toFloat(hashCombine(seed, sample));
+	return (std::min((static_cast<float>(stratum) + jitter) / nbSamples, ONE_MINUS_EPSILON));
+}
+
+// Same with square cells, on the largest grid the budget fills.
+glm::vec2 Sampler::getStratified2D(uint32_t dimension) const
+{
+	uint32_t side = static_cast<uint32_t>(sqrtf(static_cast<float>(nbSamples)));
+	if (side < 1)
+		side = 1;
+	uint32_t nbCells = side * side;
+	uint32_t round = sample / nbCells;
+	uint32_t seed = hashCombine(hashCombine(pixelSeed, dimension), round);
+	uint32_t cell = permute(sample % nbCells, nbCells, seed);
+	uint32_t jitter = hashCombine(seed, sample);
+	float u = (static_cast<float>(cell % side) + toFloat(jitter)) / side;
+	float v = (static_cast<float>(cell / side) + toFloat(mix(jitter))) / side;
+	return (glm::vec2(std::min(u, ONE_MINUS_EPSILON), std::min(v, ONE_MINUS_EPSILON)));
+}
+
+// Dimensions are grouped by 4, every group shuffles the sample index with
+// its own seed so the groups are not correlated with each other.
+void Sampler::getSobol(uint32_t dimension, uint32_t count, uint32_t seed, float *values) const
+{
+	uint32_t group = dimension / SOBOL_DIMENSIONS;
+	uint32_t groupSeed = hashCombine(seed, group);
+	uint32_t index = nestedUniformScramble(sample, groupSeed);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if ((dimension + i) / SOBOL_DIMENSIONS != group)
+		{
+			group = (dimension + i) / SOBOL_DIMENSIONS;
+			groupSeed = hashCombine(seed, group);
+			index = nestedUniformScramble(sample, groupSeed);
+		}
+		uint32_t component = (dimension + i) % SOBOL_DIMENSIONS;
+		uint32_t bits = sobolMatrices.sample(index, component);
+		values[i] = toFloat(nestedUniformScramble(bits, hashCombine(groupSeed, component)));
+	}
+}
+
+// Radical inverse in the prime base of the dimension with every digit
+// permuted by a seed hashed from the digits above it (Owen scrambling), so
+// the high dimensions are neither correlated with each other nor the same
+// in every pixel. The digits past the last one of the index are scrambled
+// zeros, uniformly spread below the last digit.
+float Sampler::getHalton(uint32_t dimension) const
+{
+	if (dimension >= MAX_HALTON_DIMENSIONS)
+		return (getRandom(dimension));
+
+	uint32_t primeBase = haltonPrimes.primes[dimension];
+	double invBase = 1.0 / primeBase;
+	double factor = invBase;
+	double value = 0;
+	uint32_t digitSeed = hashCombine(pixelSeed, dimension);
+	for (uint32_t index = sample; index > 0; index /= primeBase)
+	{
+		uint32_t digit = index % primeBase;
+		value += permute(digit, primeBase, digitSeed) * factor;
+		digitSeed = hashCombine(digitSeed, digit);
+		factor *= invBase;
+	}
+	value += toFloat(digitSeed) * factor * primeBase;
+	return (std::min(static_cast<float>(value), ONE_MINUS_EPSILON));
+}
+
+// Every dimension reads the mask at its own toroidal shift, so the offsets
+// of neighbouring pixels differ in all of them.
+float Sampler::getBlueNoiseOffset(uint32_t dimension) const
+{
+	uint32_t shift = mix(dimension + BLUE_NOISE_SEED);
+	return (getBlueNoiseMask().get(x + (shift & 0xffff), y + (shift >> 16)));
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+// Sample points of one path, addressed by dimension so that every use of a
+// random number reads the same dimension on every sample of a pixel. The
+// camera ray takes the first CAMERA_DIMENSIONS, then each bounce reserves
+// BOUNCE_DIMENSIONS whatever its material uses, see startBounce.
+//
+// RANDOM hashes (pixel, sample, dimension). STRATIFIED jitters the samples
+// of a pixel in shuffled strata of the nbSamples budget. SOBOL is an Owen
+// scrambled 4D Sobol sequence, padded to higher dimensions by scrambling
+// each group of 4 with its own seed. HALTON is a Halton sequence whose
+// digits are Owen scrambled with a seed per pixel and dimension, RANDOM
+// beyond its table of primes. BLUE_NOISE is the SOBOL sequence shared by
+// every pixel and rotated by a blue noise mask, which spreads the remaining
+// error as high frequency noise over the screen.
+//
+// Like Material, the generator is picked by a type tag rather than a vtable:
+// the state of a path is a few words kept by value in the RayStream.
+class Sampler
+{
+public:
+	enum class Type : uint32_t
+	{
+		RANDOM,
+		STRATIFIED,
+		SOBOL,
+		HALTON,
+		BLUE_NOISE,
+		COUNT
+	};
+
+	// Dimensions of the camera ray.
+	static constexpr uint32_t PIXEL = 0; // 2D jitter inside the pixel
+	static constexpr uint32_t LENS = 2; // 2D point on the lens
+	static constexpr uint32_t CAMERA_DIMENSIONS = 4;
+	// Offsets inside the dimensions of a bounce. Groups of 4 stay aligned so
+	// that SOBOL stratifies the 3 scatter dimensions together.
+	static constexpr uint32_t SCATTER = 0; // 3D, see Material::scatter
+	static constexpr uint32_t ROULETTE = 3; // 1D
+	static constexpr uint32_t LIGHT = 4; // 3D, see SphereLights::sample
+	static constexpr uint32_t BOUNCE_DIMENSIONS = 8;
+
+	Sampler() = default;
+	// nbSamples is the samples per pixel budget STRATIFIED divides into
+	// strata, sample indices past it start a new shuffled round.
+	Sampler(Type type, uint32_t nbSamples);
+
+	// Selects the pixel and the sample index, rewinds to the camera
+	// dimensions.
+	void startSample(uint32_t x, uint32_t y, uint32_t sample);
+	// Moves the bounce offsets to the dimensions of bounce depth.
+	void startBounce(uint32_t depth) { base = CAMERA_DIMENSIONS + depth * BOUNCE_DIMENSIONS; }
+
+	// Values in [0, 1) of dimensions offset, offset + 1... of the current
+	// bounce, or of the camera before the first startBounce.
+	float get1D(uint32_t offset) const;
+	glm::vec2 get2D(uint32_t offset) const;
+	glm::vec3 get3D(uint32_t offset) const;
+
+	Type getType() const { return (type); }
+	static const char *getTypeName(Type type);
+
+private:
+	Type type = Type::RANDOM;
+	uint32_t nbSamples = 1;
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t sample = 0;
+	uint32_t pixelSeed = 0;
+	uint32_t base = 0;
+
+	// Fills values with count consecutive dimensions.
+	void get(uint32_t dimension, uint32_t count, float *values) const;
+	float getRandom(uint32_t dimension) const;
+	float getStratified(uint32_t dimension) const;
+	glm::vec2 getStratified2D(uint32_t dimension) const;
+	void getSobol(uint32_t dimension, uint32_t count, uint32_t seed, float *values) const;
+	float getHalton(uint32_t dimension) const;
+	float getBlueNoiseOffset(uint32_t dimension) const;
+};
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "SceneArena.h"
+
+constexpr size_t SceneArena::BLOCK_SIZE;
+constexpr size_t SceneArena::ALIGNMENT;
+
+namespace
+{
+	// Larger allocations get a block of their own instead of wasting the
+	// end of the current one.
+	constexpr size_t MAX_SHARED_ALLOCATION = SceneArena::BLOCK_SIZE / 4;
+}
+
+SceneArena::SceneArena(SceneArena &&ref)
+{
+	*this = std::move(ref);
+}
+
+SceneArena &SceneArena::operator=(SceneArena &&ref)
+{
+	if (this != &ref)
+	{
+		release();
+		blocks = std::move(ref.blocks);
+		destructors = std::move(ref.destructors);
+		current = ref.current;
+		remaining = ref.remaining;
+		reservedSize = ref.reservedSize;
+		for (size_t i = 0; i < static_cast<size_t>(Category::COUNT); i++)
+			usedSizes[i] = ref.usedSizes[i];
+		ref.blocks.clear();
+		ref.destructors.clear();
+		ref.release();
+	}
+	return (*this);
+}
+
+SceneArena::~SceneArena()
+{
+	release();
+}
+
+void *SceneArena::allocate(size_t size, Category category)
+{
+	size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	if (size == 0)
+		size = ALIGNMENT;
+	usedSizes[static_cast<size_t>(category)] += size;
+	if (size > MAX_SHARED_ALLOCATION)
+		return (allocateBlock(size));
+
+	if (size > remaining)
+	{
+		current = allocateBlock(BLOCK_SIZE);
+		remaining = BLOCK_SIZE;
+	}
+	void *memory = current;
+	current += size;
+	remaining -= size;
+	return (memory);
+}
+
+void SceneArena::release()
+{
+	for (size_t i = destructors.size(); i > 0; i--)
+		destructors[i - 1].destroy(destructors[i - 1].object);
+	destructors.clear();
+	blocks.clear();
+	current = nullptr;
+	remaining = 0;
+	for (size_t &usedSize : usedSizes)
+		usedSize = 0;
+	reservedSize = 0;
+}
+
+const char *SceneArena::getCategoryName(Category category)
+{
+	switch (category)
+	{
+	case Category::PRIMITIVE:
+		return ("primitives");
+	case Category::GEOMETRY:
+		return ("geometry");
+	default:
+		return ("nodes");
+	}
+}
+
+uint8_t *SceneArena::allocateBlock(size_t size)
+{
+	blocks.emplace_back(new uint8_t[size + ALIGNMENT - 1]);
+	reservedSize += size;
+	uintptr_t address = reinterpret_cast<uintptr_t>(blocks.back().get());
+	return (reinterpret_cast<uint8_t *>((address + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT));
+}
\ No newline at end of file
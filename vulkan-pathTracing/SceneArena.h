@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Linear allocator holding the objects of a scene in a few large blocks.
+// Allocations are bumped from the current block and never freed one by
+// one: release destroys every object in the reverse order of creation and
+// frees the blocks at once. Bytes are counted per category so the memory
+// footprint of a scene can be reported.
+class SceneArena
+{
+public:
+	static constexpr size_t BLOCK_SIZE = 1 << 20;
+	// Every allocation starts on a cache line.
+	static constexpr size_t ALIGNMENT = 64;
+
+	enum class Category
+	{
+		PRIMITIVE, // hitables and the lists pointing to them
+		GEOMETRY, // vertex and index arrays
+		NODE, // acceleration structure nodes
+		COUNT
+	};
+
+	SceneArena() = default;
+	SceneArena(SceneArena &&ref);
+	SceneArena &operator=(SceneArena &&ref);
+	SceneArena(const SceneArena &ref) = delete;
+	SceneArena &operator=(const SceneArena &ref) = delete;
+	~SceneArena();
+
+	void *allocate(size_t size, Category category);
+
+	template <typename T, typename... Args>
+	T *create(Category category, Args&&... args)
+	{
+		T *object = new (allocate(sizeof(T), category)) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value)
+			destructors.push_back(Destructor{ object, &destroy<T> });
+		return (object);
+	}
+
+	// Uninitialized storage for count trivially destructible values.
+	template <typename T>
+	T *createArray(size_t count, Category category)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Array elements are never destroyed.");
+		return (static_cast<T *>(allocate(count * sizeof(T), category)));
+	}
+
+	// For APIs sharing ownership, such as Instance: the returned pointer
+	// never deletes the object, the arena destroys it.
+	template <typename T>
+	static std::shared_ptr<T> share(T *object)
+	{
+		return (std::shared_ptr<T>(object, [](T *) {}));
+	}
+
+	void release();
+
+	// Bytes handed out for the category, alignment padding included.
+	size_t getUsedSize(Category category) const { return (usedSizes[static_cast<size_t>(category)]); }
+	// Bytes of every block, used or not.
+	size_t getReservedSize() const { return (reservedSize); }
+	size_t getBlockCount() const { return (blocks.size()); }
+	static const char *getCategoryName(Category category);
+
+private:
+	struct Destructor
+	{
+		void *object;
+		void (*destroy)(void *object);
+	};
+
+	std::vector<std::unique_ptr<uint8_t[]>> blocks;
+	std::vector<Destructor> destructors;
+	uint8_t *current = nullptr; // next free byte of the last regular block
+	size_t remaining = 0;
+	size_t usedSizes[static_cast<size_t>(Category::COUNT)] = {};
+	size_t reservedSize = 0;
+
+	template <typename T>
+	static void destroy(void *object)
+	{
+		static_cast<T *>(object)->~T();
+	}
+
+	uint8_t *allocateBlock(size_t size);
+};
\ No newline at end of file
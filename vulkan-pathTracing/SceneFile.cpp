@@ -0,0 +1,668 @@
+#include "SceneFile.h"
+
+#include <glm/glm.hpp>
+
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# define NOMINMAX
+# include <process.h>
+# include <windows.h>
+#else
+# include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+#include "LogMessage.h"
+#include "Instance.h"
+#include "Material.h"
+#include "MaterialTable.h"
+#include "PackedSpheres.h"
+#include "Scenes.h"
+#include "TriangleMesh.h"
+
+namespace
+{
+	const char CACHE_MAGIC[4] = { 'P', 'T', 'S', 'C' };
+	constexpr uint32_t CACHE_VERSION = 6;
+	constexpr uint32_t MAX_MESH_PATH = 256;
+	// Arrays start on a cache line, the mapping itself is page aligned.
+	constexpr uint64_t CACHE_ALIGNMENT = 64;
+	// Spheres this much larger than the median one, like a ground sphere,
+	// get a chunk of their own so they do not blow up the box of their
+	// neighbours.
+	constexpr float LARGE_RADIUS_FACTOR = 8;
+	const float PADDING_VALUE = std::numeric_limits<float>::quiet_NaN();
+
+	enum CacheArray
+	{
+		CENTER_X,
+		CENTER_Y,
+		CENTER_Z,
+		RADIUS2,
+		RADIUS,
+		MATERIAL_INDEX,
+		OBJECT_INDEX,
+		NBR_ARRAYS
+	};
+
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		float camera[12]; // lookFrom, lookAt, up, vfov, aperture, focusDist
+		float sky[6]; // horizon and zenith colors
+		uint32_t nbMaterials;
+		uint32_t nbSpheres;
+		uint32_t nbChunks;
+		uint32_t nbSlots; // length of every sphere array, padding included
+		uint32_t nbMeshes;
+		uint32_t nbObjects;
+		uint32_t nbInstances;
+		uint64_t materialOffset;
+		uint64_t chunkOffset;
+		uint64_t meshOffset;
+		uint64_t objectOffset;
+		uint64_t instanceOffset;
+		uint64_t arrayOffsets[NBR_ARRAYS];
+	};
+
+	struct MaterialRecord
+	{
+		uint32_t type; // Material::Type
+		float albedo[3];
+		float parameter; // fuzz or refraction index
+	};
+
+	struct MeshRecord
+	{
+		uint32_t material;
+		char path[MAX_MESH_PATH]; // as written in the scene, null-terminated
+	};
+
+	// Geometry shared by instances, loaded once.
+	struct ObjectRecord
+	{
+		char path[MAX_MESH_PATH];
+	};
+
+	struct InstanceRecord
+	{
+		uint32_t object;
+		uint32_t material;
+		float linear[9]; // object to world, column major
+		float translation[3];
+	};
+
+	// Chunks start on a multiple of SceneFile::CHUNK_SIZE slots.
+	struct ChunkRecord
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+	static_assert(std::is_trivially_copyable<CacheHeader>::value, "The cache header is written as is.");
+	static_assert(SceneFile::CHUNK_SIZE % PackedSpheres::PADDING == 0, "Chunks must keep the PackedSpheres padding.");
+
+	struct SourceSphere
+	{
+		glm::vec3 center;
+		float radius;
+		uint32_t material;
+		uint32_t index; // in the file, the chunks reorder the spheres
+	};
+
+	struct SourceScene
+	{
+		float camera[12] = { 13, 2, 3, 0, 0, 0, 0, 1, 0, 20, 0.1f, 10 };
+		float sky[6] = { 1, 1, 1, 0.5f, 0.7f, 1 };
+		// Equal materials under different names share one record, so the
+		// records map one to one to the ids of an empty MaterialTable.
+		MaterialTable materials;
+		std::vector<SourceSphere> spheres;
+		std::vector<MeshRecord> meshes;
+		std::vector<ObjectRecord> objects;
+		std::vector<InstanceRecord> instances;
+	};
+
+	// Writes next to path and renames over it, so a reader either maps the
+	// old file or the whole new one.
+	bool writeAtomically(const std::string &path, const std::vector<uint8_t> &data)
+	{
+#ifdef _WIN32
+		std::string temporaryPath = path + "." + std::to_string(_getpid()) + ".tmp";
+#else
+		std::string temporaryPath = path + "." + std::to_string(getpid()) + ".tmp";
+#endif
+		{
+			std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+			if (!output.write(reinterpret_cast<const char *>(data.data()), data.size()) || !output.flush())
+			{
+				output.close();
+				remove(temporaryPath.c_str());
+				return (false);
+			}
+		}
+#ifdef _WIN32
+		bool isRenamed = MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		bool isRenamed = rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+		if (!isRenamed)
+			remove(temporaryPath.c_str());
+		return (isRenamed);
+	}
+
+	bool getSourceInfo(const std::string &path, uint64_t &size, int64_t &time)
+	{
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			return (false);
+		size = static_cast<uint64_t>(info.st_size);
+		time = static_cast<int64_t>(info.st_mtime);
+		return (true);
+	}
+
+	void readFloats(std::istringstream &line, float *values, uint32_t count, const std::string &where)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (!(line >> values[i]))
+				throw std::runtime_error(where + ": expected a number.");
+		}
+	}
+
+	uint32_t readMaterial(std::istringstream &line, const std::unordered_map<std::string, uint32_t> &materialNames, const std::string &where)
+	{
+		std::string name;
+		if (!(line >> name))
+			throw std::runtime_error(where + ": expected a material name.");
+		auto it = materialNames.find(name);
+		if (it == materialNames.end())
+			throw std::runtime_error(where + ": unknown material " + name + ".");
+		return (it->second);
+	}
+
+	void readPath(std::istringstream &line, char (&path)[MAX_MESH_PATH], const std::string &where)
+	{
+		std::string text;
+		if (!(line >> text))
+			throw std::runtime_error(where + ": expected a mesh path.");
+		if (text.size() >= MAX_MESH_PATH)
+			throw std::runtime_error(where + ": mesh path is too long.");
+		memcpy(path, text.c_str(), text.size());
+	}
+
+	SourceScene parse(const std::string &path)
+	{
+		std::ifstream input(path);
+		if (!input)
+			throw std::runtime_error("Unable to open scene " + path + ".");
+
+		SourceScene scene;
+		std::unordered_map<std::string, uint32_t> materialNames;
+		std::unordered_map<std::string, uint32_t> objectNames;
+		std::string text;
+		uint32_t lineNumber = 0;
+		while (std::getline(input, text))
+		{
+			lineNumber += 1;
+			std::string where = path + ":" + std::to_string(lineNumber);
+			size_t comment = text.find('#');
+			if (comment != std::string::npos)
+				text.resize(comment);
+
+			std::istringstream line(text);
+			std::string keyword;
+			if (!(line >> keyword))
+				continue;
+
+			if (keyword == "camera")
+				readFloats(line, scene.camera, 12, where);
+			else if (keyword == "sky")
+				readFloats(line, scene.sky, 6, where);
+			else if (keyword == "lambert" || keyword == "metal" || keyword == "dielectric" || keyword == "emissive")
+			{
+				std::string name;
+				if (!(line >> name))
+					throw std::runtime_error(where + ": expected a material name.");
+				if (materialNames.count(name))
+					throw std::runtime_error(where + ": material " + name + " is already defined.");
+
+				glm::vec3 albedo;
+				float parameter;
+				Material material;
+				if (keyword == "lambert")
+				{
+					readFloats(line, &albedo.x, 3, where);
+					material = Material::lambert(albedo);
+				}
+				else if (keyword == "emissive")
+				{
+					readFloats(line, &albedo.x, 3, where);
+					material = Material::emissive(albedo);
+				}
+				else if (keyword == "metal")
+				{
+					readFloats(line, &albedo.x, 3, where);
+					readFloats(line, &parameter, 1, where);
+					material = Material::metal(albedo, parameter);
+				}
+				else if (keyword == "dielectric")
+				{
+					readFloats(line, &parameter, 1, where);
+					material = Material::dialectric(parameter);
+				}
+				else
+					throw std::runtime_error(where + ": unknown material type " + keyword + ".");
+				materialNames[name] = scene.materials.add(material);
+			}
+			else if (keyword == "sphere")
+			{
+				SourceSphere sphere;
+				readFloats(line, &sphere.center.x, 1, where);
+				readFloats(line, &sphere.center.y, 1, where);
+				readFloats(line, &sphere.center.z, 1, where);
+				readFloats(line, &sphere.radius, 1, where);
+				sphere.material = readMaterial(line, materialNames, where);
+				sphere.index = static_cast<uint32_t>(scene.spheres.size());
+				scene.spheres.push_back(sphere);
+			}
+			else if (keyword == "mesh")
+			{
+				MeshRecord mesh = {};
+				readPath(line, mesh.path, where);
+				mesh.material = readMaterial(line, materialNames, where);
+				scene.meshes.push_back(mesh);
+			}
+			else if (keyword == "object")
+			{
+				std::string name;
+				if (!(line >> name))
+					throw std::runtime_error(where + ": expected an object name.");
+				if (objectNames.count(name))
+					throw std::runtime_error(where + ": object " + name + " is already defined.");
+				ObjectRecord object = {};
+				readPath(line, object.path, where);
+				objectNames[name] = static_cast<uint32_t>(scene.objects.size());
+				scene.objects.push_back(object);
+			}
+			else if (keyword == "instance")
+			{
+				std::string name;
+				if (!(line >> name))
+					throw std::runtime_error(where + ": expected an object name.");
+				auto it = objectNames.find(name);
+				if (it == objectNames.end())
+					throw std::runtime_error(where + ": unknown object " + name + ".");
+				InstanceRecord instance = {};
+				instance.object = it->second;
+				instance.material = readMaterial(line, materialNames, where);
+				glm::vec3 translation;
+				glm::vec3 degrees;
+				float scale;
+				readFloats(line, &translation.x, 1, where);
+				readFloats(line, &translation.y, 1, where);
+				readFloats(line, &translation.z, 1, where);
+				readFloats(line, &degrees.x, 1, where);
+				readFloats(line, &degrees.y, 1, where);
+				readFloats(line, &degrees.z, 1, where);
+				readFloats(line, &scale, 1, where);
+				if (scale == 0)
+					throw std::runtime_error(where + ": the scale can not be 0.");
+				glm::mat3 linear = Instance::rotation(degrees) * scale;
+				for (int column = 0; column < 3; column++)
+				{
+					for (int row = 0; row < 3; row++)
+						instance.linear[column * 3 + row] = linear[column][row];
+					instance.translation[column] = translation[column];
+				}
+				scene.instances.push_back(instance);
+			}
+			else
+				throw std::runtime_error(where + ": unknown statement " + keyword + ".");
+
+			std::string extra;
+			if (line >> extra)
+				throw std::runtime_error(where + ": unexpected " + extra + ".");
+		}
+		return (scene);
+	}
+
+	uint32_t spreadBits(uint32_t value)
+	{
+		value &= 0x3ff;
+		value = (value | (value << 16)) & 0x030000ff;
+		value = (value | (value << 8)) & 0x0300f00f;
+		value = (value | (value << 4)) & 0x030c30c3;
+		value = (value | (value << 2)) & 0x09249249;
+		return (value);
+	}
+
+	// Orders the spheres so that each run of CHUNK_SIZE small spheres is
+	// compact in space, and returns the chunks.
+	std::vector<ChunkRecord> buildChunks(std::vector<SourceSphere> &spheres)
+	{
+		std::vector<ChunkRecord> chunks;
+		if (spheres.empty())
+			return (chunks);
+
+		std::vector<float> radii;
+		for (const SourceSphere &sphere : spheres)
+			radii.push_back(sphere.radius);
+		std::nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+		float largeRadius = radii[radii.size() / 2] * LARGE_RADIUS_FACTOR;
+
+		auto isLarge = [largeRadius](const SourceSphere &sphere) { return (sphere.radius > largeRadius); };
+		auto firstSmall = std::stable_partition(spheres.begin(), spheres.end(), isLarge);
+
+		glm::vec3 low(FLT_MAX, FLT_MAX, FLT_MAX);
+		glm::vec3 high(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (auto it = firstSmall; it != spheres.end(); ++it)
+		{
+			low = glm::min(low, it->center);
+			high = glm::max(high, it->center);
+		}
+		glm::vec3 extent = glm::max(high - low, glm::vec3(FLT_MIN, FLT_MIN, FLT_MIN));
+		auto mortonCode = [&low, &extent](const SourceSphere &sphere)
+		{
+			glm::vec3 p = (sphere.center - low) / extent * 1023.0f;
+			return (spreadBits(static_cast<uint32_t>(p.x))
+				| (spreadBits(static_cast<uint32_t>(p.y)) << 1)
+				| (spreadBits(static_cast<uint32_t>(p.z)) << 2));
+		};
+		std::stable_sort(firstSmall, spheres.end(), [&mortonCode](const SourceSphere &a, const SourceSphere &b)
+		{
+			return (mortonCode(a) < mortonCode(b));
+		});
+
+		uint32_t nbLarge = static_cast<uint32_t>(firstSmall - spheres.begin());
+		uint32_t slot = 0;
+		for (uint32_t i = 0; i < nbLarge; i++, slot += SceneFile::CHUNK_SIZE)
+			chunks.push_back(ChunkRecord{ slot, 1 });
+		for (uint32_t i = nbLarge; i < spheres.size(); i += SceneFile::CHUNK_SIZE, slot += SceneFile::CHUNK_SIZE)
+		{
+			uint32_t count = static_cast<uint32_t>(std::min<size_t>(SceneFile::CHUNK_SIZE, spheres.size() - i));
+			chunks.push_back(ChunkRecord{ slot, count });
+		}
+		return (chunks);
+	}
+
+	uint64_t append(std::vector<uint8_t> &data, const void *values, size_t size)
+	{
+		uint64_t offset = (data.size() + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+		data.resize(static_cast<size_t>(offset) + size);
+		if (size > 0)
+			memcpy(data.data() + offset, values, size);
+		return (offset);
+	}
+
+	template <typename T>
+	const T *getArray(const uint8_t *data, uint64_t offset)
+	{
+		return (reinterpret_cast<const T *>(data + offset));
+	}
+}
+
+std::shared_ptr<SceneFile> SceneFile::load(const std::string &path)
+{
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!getSourceInfo(path, sourceSize, sourceTime))
+		throw std::runtime_error("Unable to open scene " + path + ".");
+
+	std::shared_ptr<SceneFile> scene(new SceneFile());
+	size_t separator = path.find_last_of("/\\");
+	if (separator != std::string::npos)
+		scene->directory = path.substr(0, separator + 1);
+	std::string cachePath = getCachePath(path);
+	if (!scene->map(cachePath, sourceSize, sourceTime))
+	{
+		LOG_MSG("Compiling scene %s.", path.c_str());
+		std::vector<uint8_t> data = build(path);
+		// Someone else may have replaced the cache since, or the directory
+		// is read-only: the scene then runs from the compiled copy.
+		if (!writeAtomically(cachePath, data) || !scene->map(cachePath, sourceSize, sourceTime))
+		{
+			LOG_MSG("Unable to use scene cache %s, keeping the scene in memory.", cachePath.c_str());
+			scene->memoryCache.swap(data);
+		}
+	}
+	return (scene);
+}
+
+void SceneFile::compile(const std::string &sourcePath, const std::string &cachePath)
+{
+	if (!writeAtomically(cachePath, build(sourcePath)))
+		throw std::runtime_error("Unable to write scene cache " + cachePath + ".");
+}
+
+std::vector<uint8_t> SceneFile::build(const std::string &sourcePath)
+{
+	CacheHeader header = {};
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	if (!getSourceInfo(sourcePath, header.sourceSize, header.sourceTime))
+		throw std::runtime_error("Unable to open scene " + sourcePath + ".");
+
+	SourceScene scene = parse(sourcePath);
+	std::vector<ChunkRecord> chunks = buildChunks(scene.spheres);
+	uint32_t nbSlots = static_cast<uint32_t>(chunks.size()) * CHUNK_SIZE;
+
+	std::vector<float> arrays[RADIUS + 1];
+	for (std::vector<float> &array : arrays)
+		array.assign(nbSlots, PADDING_VALUE);
+	std::vector<uint32_t> materialIndex(nbSlots, 0);
+	std::vector<uint32_t> objectIndex(nbSlots, 0);
+	uint32_t sphere = 0;
+	for (const ChunkRecord &chunk : chunks)
+	{
+		for (uint32_t i = chunk.first; i < chunk.first + chunk.count; i++, sphere++)
+		{
+			const SourceSphere &source = scene.spheres[sphere];
+			arrays[CENTER_X][i] = source.center.x;
+			arrays[CENTER_Y][i] = source.center.y;
+			arrays[CENTER_Z][i] = source.center.z;
+			arrays[RADIUS2][i] = source.radius * source.radius;
+			arrays[RADIUS][i] = source.radius;
+			materialIndex[i] = source.material;
+			objectIndex[i] = source.index;
+		}
+	}
+
+	memcpy(header.camera, scene.camera, sizeof(header.camera));
+	memcpy(header.sky, scene.sky, sizeof(header.sky));
+	std::vector<MaterialRecord> materials;
+	for (uint32_t i = 0; i < scene.materials.size(); i++)
+	{
+		const Material &material = scene.materials[i];
+		materials.push_back(MaterialRecord{ static_cast<uint32_t>(material.type),
+			{ material.albedo.x, material.albedo.y, material.albedo.z }, material.parameter });
+	}
+	header.nbMaterials = static_cast<uint32_t>(materials.size());
+	header.nbSpheres = static_cast<uint32_t>(scene.spheres.size());
+	header.nbChunks = static_cast<uint32_t>(chunks.size());
+	header.nbSlots = nbSlots;
+	header.nbMeshes = static_cast<uint32_t>(scene.meshes.size());
+	header.nbObjects = static_cast<uint32_t>(scene.objects.size());
+	header.nbInstances = static_cast<uint32_t>(scene.instances.size());
+
+	std::vector<uint8_t> data(sizeof(CacheHeader));
+	header.materialOffset = append(data, materials.data(), materials.size() * sizeof(MaterialRecord));
+	header.chunkOffset = append(data, chunks.data(), chunks.size() * sizeof(ChunkRecord));
+	header.meshOffset = append(data, scene.meshes.data(), scene.meshes.size() * sizeof(MeshRecord));
+	header.objectOffset = append(data, scene.objects.data(), scene.objects.size() * sizeof(ObjectRecord));
+	header.instanceOffset = append(data, scene.instances.data(), scene.instances.size() * sizeof(InstanceRecord));
+	for (uint32_t i = 0; i <= RADIUS; i++)
+		header.arrayOffsets[i] = append(data, arrays[i].data(), nbSlots * sizeof(float));
+	header.arrayOffsets[MATERIAL_INDEX] = append(data, materialIndex.data(), nbSlots * sizeof(uint32_t));
+	header.arrayOffsets[OBJECT_INDEX] = append(data, objectIndex.data(), nbSlots * sizeof(uint32_t));
+	memcpy(data.data(), &header, sizeof(CacheHeader));
+	return (data);
+}
+
+std::string SceneFile::getCachePath(const std::string &path)
+{
+	return (path + ".cache");
+}
+
+void SceneFile::describe(SceneDescription &scene) const
+{
+	const uint8_t *data = getData();
+	const CacheHeader &header = *getArray<CacheHeader>(data, 0);
+	const ChunkRecord *chunks = getArray<ChunkRecord>(data, header.chunkOffset);
+	const float *centerX = getArray<float>(data, header.arrayOffsets[CENTER_X]);
+	const float *centerY = getArray<float>(data, header.arrayOffsets[CENTER_Y]);
+	const float *centerZ = getArray<float>(data, header.arrayOffsets[CENTER_Z]);
+	const float *radius2 = getArray<float>(data, header.arrayOffsets[RADIUS2]);
+	const float *radius = getArray<float>(data, header.arrayOffsets[RADIUS]);
+	const uint32_t *materialIndex = getArray<uint32_t>(data, header.arrayOffsets[MATERIAL_INDEX]);
+	const uint32_t *objectIndex = getArray<uint32_t>(data, header.arrayOffsets[OBJECT_INDEX]);
+
+	// The sphere arrays hold material ids, the records must land on them.
+	const MaterialRecord *records = getArray<MaterialRecord>(data, header.materialOffset);
+	for (uint32_t i = 0; i < header.nbMaterials; i++)
+	{
+		const MaterialRecord &record = records[i];
+		Material material = { static_cast<Material::Type>(record.type),
+			glm::vec3(record.albedo[0], record.albedo[1], record.albedo[2]), record.parameter };
+		if (scene.materials.add(material) != i)
+			throw std::runtime_error("Scene files need an empty material table.");
+	}
+
+	// Everything goes to the arena, which also releases what was built if a
+	// mesh fails to load.
+	SceneArena &arena = scene.arena;
+	uint32_t nbHitables = header.nbChunks + header.nbMeshes + header.nbInstances;
+	IHitable **hitables = arena.createArray<IHitable *>(nbHitables + 1, SceneArena::Category::PRIMITIVE);
+	uint32_t index = 0;
+	for (uint32_t i = 0; i < header.nbChunks; i++)
+	{
+		uint32_t first = chunks[i].first;
+		PackedSpheres *spheres = arena.create<PackedSpheres>(SceneArena::Category::PRIMITIVE);
+		hitables[index++] = spheres;
+		spheres->attach(chunks[i].count, centerX + first, centerY + first, centerZ + first,
+			radius2 + first, radius + first, materialIndex + first, objectIndex + first);
+	}
+	const MeshRecord *meshes = getArray<MeshRecord>(data, header.meshOffset);
+	for (uint32_t i = 0; i < header.nbMeshes; i++)
+	{
+		TriangleMesh *mesh = arena.create<TriangleMesh>(SceneArena::Category::PRIMITIVE, meshes[i].material);
+		hitables[index++] = mesh;
+		mesh->setObjectId(header.nbSpheres + i);
+		mesh->loadObj(resolvePath(meshes[i].path));
+		mesh->moveTo(arena);
+	}
+	// Instances always replace the material, the objects get none.
+	const ObjectRecord *objectRecords = getArray<ObjectRecord>(data, header.objectOffset);
+	std::vector<std::shared_ptr<TriangleMesh>> objects;
+	for (uint32_t i = 0; i < header.nbObjects; i++)
+	{
+		TriangleMesh *mesh = arena.create<TriangleMesh>(SceneArena::Category::PRIMITIVE, MaterialTable::NONE);
+		mesh->loadObj(resolvePath(objectRecords[i].path));
+		mesh->moveTo(arena);
+		objects.push_back(SceneArena::share(mesh));
+	}
+	const InstanceRecord *instances = getArray<InstanceRecord>(data, header.instanceOffset);
+	for (uint32_t i = 0; i < header.nbInstances; i++)
+	{
+		const InstanceRecord &instance = instances[i];
+		const float *m = instance.linear;
+		glm::mat3 linear(glm::vec3(m[0], m[1], m[2]), glm::vec3(m[3], m[4], m[5]), glm::vec3(m[6], m[7], m[8]));
+		glm::vec3 translation(instance.translation[0], instance.translation[1], instance.translation[2]);
+		Instance *hitable = arena.create<Instance>(SceneArena::Category::PRIMITIVE, objects[instance.object], linear, translation, instance.material);
+		hitable->setObjectId(header.nbSpheres + header.nbMeshes + i);
+		hitables[index++] = hitable;
+	}
+	hitables[index] = nullptr;
+	scene.hitables = hitables;
+
+	scene.lookFrom = glm::vec3(header.camera[0], header.camera[1], header.camera[2]);
+	scene.lookAt = glm::vec3(header.camera[3], header.camera[4], header.camera[5]);
+	scene.up = glm::vec3(header.camera[6], header.camera[7], header.camera[8]);
+	scene.vfov = header.camera[9];
+	scene.aperture = header.camera[10];
+	scene.focusDist = header.camera[11];
+	scene.skyHorizon = glm::vec3(header.sky[0], header.sky[1], header.sky[2]);
+	scene.skyZenith = glm::vec3(header.sky[3], header.sky[4], header.sky[5]);
+}
+
+uint32_t SceneFile::getSphereCount() const
+{
+	return (getArray<CacheHeader>(getData(), 0)->nbSpheres);
+}
+
+std::string SceneFile::resolvePath(const std::string &path) const
+{
+	if (directory.empty() || path.empty() || path[0] == '/' || path[0] == '\\' || path.find(':') != std::string::npos)
+		return (path);
+	return (directory + path);
+}
+
+// Only validates the cache, its arrays are used from the mapping as is.
+bool SceneFile::map(const std::string &cachePath, uint64_t sourceSize, int64_t sourceTime)
+{
+	if (!file.open(cachePath) || file.getSize() < sizeof(CacheHeader))
+		return (false);
+
+	const uint8_t *data = file.getData();
+	uint64_t size = file.getSize();
+	const CacheHeader &header = *getArray<CacheHeader>(data, 0);
+	if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION
+		|| header.sourceSize != sourceSize || header.sourceTime != sourceTime
+		|| static_cast<uint64_t>(header.nbChunks) * CHUNK_SIZE != header.nbSlots)
+	{
+		file.close();
+		return (false);
+	}
+
+	auto fits = [size](uint64_t offset, uint64_t length) { return (offset % CACHE_ALIGNMENT == 0 && offset <= size && length <= size - offset); };
+	bool isValid = fits(header.materialOffset, header.nbMaterials * sizeof(MaterialRecord))
+		&& fits(header.chunkOffset, header.nbChunks * sizeof(ChunkRecord))
+		&& fits(header.meshOffset, header.nbMeshes * sizeof(MeshRecord))
+		&& fits(header.objectOffset, header.nbObjects * sizeof(ObjectRecord))
+		&& fits(header.instanceOffset, static_cast<uint64_t>(header.nbInstances) * sizeof(InstanceRecord));
+	for (uint32_t i = 0; i < NBR_ARRAYS; i++)
+		isValid = isValid && fits(header.arrayOffsets[i], static_cast<uint64_t>(header.nbSlots) * sizeof(float));
+	const MaterialRecord *records = getArray<MaterialRecord>(data, header.materialOffset);
+	for (uint32_t i = 0; isValid && i < header.nbMaterials; i++)
+		isValid = records[i].type < static_cast<uint32_t>(Material::Type::COUNT);
+	const ChunkRecord *chunks = getArray<ChunkRecord>(data, header.chunkOffset);
+	for (uint32_t i = 0; isValid && i < header.nbChunks; i++)
+		isValid = chunks[i].first == i * CHUNK_SIZE && chunks[i].count <= CHUNK_SIZE;
+	// Only the spheres of the chunks are hit, the padding keeps material 0.
+	const uint32_t *materialIndex = getArray<uint32_t>(data, header.arrayOffsets[MATERIAL_INDEX]);
+	for (uint32_t i = 0; isValid && i < header.nbChunks; i++)
+	{
+		for (uint32_t slot = chunks[i].first; isValid && slot < chunks[i].first + chunks[i].count; slot++)
+			isValid = materialIndex[slot] < header.nbMaterials;
+	}
+	const MeshRecord *meshes = getArray<MeshRecord>(data, header.meshOffset);
+	for (uint32_t i = 0; isValid && i < header.nbMeshes; i++)
+		isValid = meshes[i].material < header.nbMaterials && meshes[i].path[MAX_MESH_PATH - 1] == '\0';
+	const ObjectRecord *objects = getArray<ObjectRecord>(data, header.objectOffset);
+	for (uint32_t i = 0; isValid && i < header.nbObjects; i++)
+		isValid = objects[i].path[MAX_MESH_PATH - 1] == '\0';
+	const InstanceRecord *instances = getArray<InstanceRecord>(data, header.instanceOffset);
+	for (uint32_t i = 0; isValid && i < header.nbInstances; i++)
+		isValid = instances[i].object < header.nbObjects && instances[i].material < header.nbMaterials;
+	if (!isValid)
+	{
+		file.close();
+		return (false);
+	}
+
+	return (true);
+}
\ No newline at end of file
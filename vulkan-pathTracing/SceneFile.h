@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+struct SceneDescription;
+
+// Scene loaded from a text description. The text is compiled once into a
+// binary cache next to it, whose sphere arrays are laid out exactly like
+// PackedSpheres stores them, so loading maps the cache and points the
+// spheres at it without copying or parsing anything. Meshes only keep
+// their path in the cache and are read from their OBJ file. An object is
+// read once however many times it is instanced. The object ids of the
+// AOVs number the spheres in file order, then the meshes, then the
+// instances.
+//
+// Text format, one statement per line, # starts a comment:
+//   camera <from x y z> <at x y z> <up x y z> <vfov> <aperture> <focus distance>
+//   sky <horizon r g b> <zenith r g b>
+//   lambert <name> <r g b>
+//   metal <name> <r g b> <fuzz>
+//   dielectric <name> <refraction index>
+//   emissive <name> <radiance r g b>
+//   sphere <x y z> <radius> <material name>
+//   mesh <obj path, relative to the scene file> <material name>
+//   object <name> <obj path>
+//   instance <object name> <material name> <x y z> <degrees around x y z> <scale>
+class SceneFile
+{
+public:
+	// Spheres close to each other are grouped by chunks of this size, each
+	// chunk becoming one PackedSpheres for the BVH.
+	static constexpr uint32_t CHUNK_SIZE = 16;
+
+	SceneFile(const SceneFile &ref) = delete;
+	SceneFile &operator=(const SceneFile &ref) = delete;
+
+	// Recompiles the cache when it is missing or older than the text, and
+	// keeps the compiled scene in memory when the cache can not be written.
+	// Throws std::runtime_error on syntax errors or unreadable files.
+	static std::shared_ptr<SceneFile> load(const std::string &path);
+	// The cache is written to a temporary file renamed into place, so
+	// concurrent loads never map a partial one.
+	static void compile(const std::string &sourcePath, const std::string &cachePath);
+	static std::string getCachePath(const std::string &path);
+
+	// Fills the camera and the material table, which must be empty, and
+	// hands out a new null-terminated list of sphere chunks, meshes and
+	// instances, which only stays valid while this SceneFile lives.
+	void describe(SceneDescription &scene) const;
+	uint32_t getSphereCount() const;
+
+private:
+	MappedFile file;
+	// Cache image used instead of the file when it could not be written.
+	std::vector<uint8_t> memoryCache;
+	std::string directory;
+
+	SceneFile() = default;
+	static std::vector<uint8_t> build(const std::string &sourcePath);
+	const uint8_t *getData() const { return (memoryCache.empty() ? file.getData() : memoryCache.data()); }
+	std::string resolvePath(const std::string &path) const;
+	bool map(const std::string &cachePath, uint64_t sourceSize, int64_t sourceTime);
+};
\ No newline at end of file
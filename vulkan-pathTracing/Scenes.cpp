@@ -0,0 +1,237 @@
+#include "Scenes.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <math.h>
+#include <string.h>
+
+#include <memory>
+
+#include "ctmRand.h"
+#include "Instance.h"
+#include "LogMessage.h"
+#include "Material.h"
+#include "MaterialTable.h"
+#include "SceneFile.h"
+#include "Sphere.h"
+#include "TriangleMesh.h"
+
+namespace
+{
+	// Object ids of the AOVs, stable for a given scene. Scene files number
+	// their own primitives.
+	void numberObjects(IHitable *const *list)
+	{
+		for (uint32_t i = 0; list[i]; i++)
+			list[i]->setObjectId(i);
+	}
+
+	IHitable **random_scene(SceneArena &arena, MaterialTable &materials)
+	{
+		int i = 0;
+		uint32_t material = 0;
+		IHitable **list = arena.createArray<IHitable *>(490, SceneArena::Category::PRIMITIVE);
+		memset(list, 0, 490 * sizeof(IHitable *));
+
+		material = materials.add(Material::lambert(glm::vec3(0.5, 0.5, 0.5)));
+		list[i] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(0, -1000, 0), 1000, material);
+		i++;
+
+		for (int a = -11; a < 11; a++)
+		{
+			for (int b = -11; b < 11; b++)
+			{
+				float choose_mat = ctmRand();
+				glm::vec3 center(a + 0.9 * ctmRand(), 0.2, b + 0.9 * ctmRand());
+				if ((center - glm::vec3(4, 0.2, 0)).length() > 0.9)
+				{
+					if (choose_mat < 0.8)
+					{
+						material = materials.add(Material::lambert(glm::vec3(ctmRand() * ctmRand(),
+							ctmRand() * ctmRand(),
+							ctmRand() * ctmRand())));
+					}
+					else if (choose_mat < 0.95)
+					{
+						material = materials.add(Material::metal(glm::vec3(0.5f * (1.0f + ctmRand()),
+							0.5f * (1.0f + ctmRand()),
+							0.5f * (1.0f + ctmRand())), 0.5f * ctmRand()));
+					}
+					else
+					{
+						material = materials.add(Material::dialectric(1.5));
+					}
+					list[i] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, center, 0.2f, material);
+					i++;
+				}
+			}
+		}
+		material = materials.add(Material::dialectric(1.3f));
+		list[i] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(0, 1, 0), 1, material);
+		i++;
+
+		material = materials.add(Material::lambert(glm::vec3(0.4, 0.2, 0.1)));
+		list[i] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(-4, 1, 0), 1, material);
+		i++;
+
+		material = materials.add(Material::metal(glm::vec3(0.7, 0.6, 0.5), 0));
+		list[i] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(4, 1, 0), 1, material);
+		i++;
+
+		list[i] = nullptr;
+		LOG_MSG("%d", i);
+		return list;
+	}
+
+	// The three large spheres of random_scene on the ground plane.
+	IHitable **simple_scene(SceneArena &arena, MaterialTable &materials)
+	{
+		IHitable **list = arena.createArray<IHitable *>(5, SceneArena::Category::PRIMITIVE);
+		list[0] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(0, -1000, 0), 1000, materials.add(Material::lambert(glm::vec3(0.5, 0.5, 0.5))));
+		list[1] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(0, 1, 0), 1, materials.add(Material::dialectric(1.3f)));
+		list[2] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(-4, 1, 0), 1, materials.add(Material::lambert(glm::vec3(0.4, 0.2, 0.1))));
+		list[3] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(4, 1, 0), 1, materials.add(Material::metal(glm::vec3(0.7, 0.6, 0.5), 0)));
+		list[4] = nullptr;
+		return list;
+	}
+
+	// simple_scene at night, lit by two small lamps, the sky barely adds
+	// anything.
+	IHitable **lights_scene(SceneArena &arena, MaterialTable &materials)
+	{
+		IHitable **list = arena.createArray<IHitable *>(7, SceneArena::Category::PRIMITIVE);
+		list[0] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(0, -1000, 0), 1000, materials.add(Material::lambert(glm::vec3(0.5, 0.5, 0.5))));
+		list[1] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(0, 1, 0), 1, materials.add(Material::dialectric(1.3f)));
+		list[2] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(-4, 1, 0), 1, materials.add(Material::lambert(glm::vec3(0.4, 0.2, 0.1))));
+		list[3] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(4, 1, 0), 1, materials.add(Material::metal(glm::vec3(0.7, 0.6, 0.5), 0)));
+		list[4] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(-2, 3, 2), 0.2f, materials.add(Material::emissive(glm::vec3(60, 45, 30))));
+		list[5] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(2, 0.25f, 2.5f), 0.25f, materials.add(Material::emissive(glm::vec3(5, 10, 25))));
+		list[6] = nullptr;
+		return (list);
+	}
+
+	Material random_material()
+	{
+		float choose_mat = ctmRand();
+		if (choose_mat < 0.8)
+			return (Material::lambert(glm::vec3(ctmRand() * ctmRand(), ctmRand() * ctmRand(), ctmRand() * ctmRand())));
+		if (choose_mat < 0.95)
+		{
+			return (Material::metal(glm::vec3(0.5f * (1.0f + ctmRand()), 0.5f * (1.0f + ctmRand()), 0.5f * (1.0f + ctmRand())),
+				0.5f * ctmRand()));
+		}
+		return (Material::dialectric(1.5));
+	}
+
+	// Torus around the Y axis, counter-clockwise seen from outside.
+	TriangleMesh *torus(SceneArena &arena, float majorRadius, float minorRadius, uint32_t rings, uint32_t segments)
+	{
+		std::vector<glm::vec3> vertices;
+		std::vector<uint32_t> indices;
+		for (uint32_t ring = 0; ring < rings; ring++)
+		{
+			float u = 2 * glm::pi<float>() * ring / rings;
+			for (uint32_t segment = 0; segment < segments; segment++)
+			{
+				float v = 2 * glm::pi<float>() * segment / segments;
+				float distance = majorRadius + minorRadius * cosf(v);
+				vertices.push_back(glm::vec3(distance * cosf(u), minorRadius * sinf(v), distance * sinf(u)));
+			}
+		}
+		for (uint32_t ring = 0; ring < rings; ring++)
+		{
+			for (uint32_t segment = 0; segment < segments; segment++)
+			{
+				uint32_t a = ring * segments + segment;
+				uint32_t b = ((ring + 1) % rings) * segments + segment;
+				uint32_t c = ring * segments + (segment + 1) % segments;
+				uint32_t d = ((ring + 1) % rings) * segments + (segment + 1) % segments;
+				indices.insert(indices.end(), { a, c, b, b, c, d });
+			}
+		}
+		TriangleMesh *mesh = arena.create<TriangleMesh>(SceneArena::Category::PRIMITIVE, MaterialTable::NONE);
+		mesh->setGeometry(std::move(vertices), std::move(indices));
+		mesh->moveTo(arena);
+		return (mesh);
+	}
+
+	// A field of randomly oriented instances of a single 65536 triangle
+	// torus, about 10^8 triangles for the memory of one mesh.
+	IHitable **instances_scene(SceneArena &arena, MaterialTable &materials)
+	{
+		constexpr int HALF_GRID = 20;
+		constexpr float MINOR_RADIUS = 0.35f;
+		std::shared_ptr<TriangleMesh> mesh = SceneArena::share(torus(arena, 1, MINOR_RADIUS, 256, 128));
+
+		IHitable **list = arena.createArray<IHitable *>((2 * HALF_GRID) * (2 * HALF_GRID) + 2, SceneArena::Category::PRIMITIVE);
+		int i = 0;
+		list[i++] = arena.create<Sphere>(SceneArena::Category::PRIMITIVE, glm::vec3(0, -1000, 0), 1000, materials.add(Material::lambert(glm::vec3(0.5, 0.5, 0.5))));
+		for (int a = -HALF_GRID; a < HALF_GRID; a++)
+		{
+			for (int b = -HALF_GRID; b < HALF_GRID; b++)
+			{
+				float scale = 0.25f + 0.1f * ctmRand();
+				glm::vec3 degrees(360 * ctmRand(), 360 * ctmRand(), 360 * ctmRand());
+				// High enough to clear the ground whatever the orientation.
+				glm::vec3 center(a + 0.5f, scale * (1 + MINOR_RADIUS), b + 0.5f);
+				list[i++] = arena.create<Instance>(SceneArena::Category::PRIMITIVE, mesh, Instance::rotation(degrees) * scale, center, materials.add(random_material()));
+			}
+		}
+		list[i] = nullptr;
+		return (list);
+	}
+}
+
+namespace Scenes
+{
+	bool create(const std::string &name, SceneDescription &scene)
+	{
+		static const std::string extension = ".scene";
+		if (name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0)
+		{
+			scene.file = SceneFile::load(name);
+			scene.file->describe(scene);
+			scene.lights.build(scene.hitables, scene.materials);
+			return (true);
+		}
+
+		if (name == "random")
+			scene.hitables = random_scene(scene.arena, scene.materials);
+		else if (name == "simple")
+			scene.hitables = simple_scene(scene.arena, scene.materials);
+		else if (name == "instances")
+			scene.hitables = instances_scene(scene.arena, scene.materials);
+		else if (name == "lights")
+			scene.hitables = lights_scene(scene.arena, scene.materials);
+		else
+			return (false);
+		numberObjects(scene.hitables);
+		scene.lights.build(scene.hitables, scene.materials);
+
+		scene.lookFrom = glm::vec3(13, 2, 3);
+		scene.lookAt = glm::vec3(0, 0, 0);
+		scene.up = glm::vec3(0, 1, 0);
+		scene.vfov = 20;
+		scene.aperture = 0.1f;
+		scene.focusDist = 10;
+		if (name == "instances")
+		{
+			// Outside the field, looking across it.
+			scene.lookFrom = glm::vec3(22, 5, 22);
+			scene.vfov = 30;
+			scene.focusDist = 20;
+		}
+		else if (name == "lights")
+		{
+			scene.skyHorizon = glm::vec3(0.01f, 0.01f, 0.02f);
+			scene.skyZenith = glm::vec3(0.005f, 0.01f, 0.03f);
+		}
+		return (true);
+	}
+
+	const std::vector<std::string> &getNames()
+	{
+		static const std::vector<std::string> names = { "random", "simple", "instances", "lights" };
+		return (names);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MaterialTable.h"
+#include "SceneArena.h"
+#include "SphereLights.h"
+
+class IHitable;
+class SceneFile;
+
+// Built-in scenes shared by the viewer and the headless renderer.
+struct SceneDescription
+{
+	// Holds the hitables, the list and the meshes, declared first so that
+	// it goes last.
+	SceneArena arena;
+	// Null-terminated list in the arena, meant to be handed to BVH::build.
+	IHitable **hitables = nullptr;
+	// Set for scenes loaded from a file, the hitables point into it.
+	std::shared_ptr<SceneFile> file;
+	// Every material id set by the hitables, to hand to PathTracing.
+	MaterialTable materials;
+	// Emissive spheres of the hitables, also for PathTracing.
+	SphereLights lights;
+	glm::vec3 skyHorizon = glm::vec3(1, 1, 1);
+	glm::vec3 skyZenith = glm::vec3(0.5f, 0.7f, 1);
+
+	glm::vec3 lookFrom;
+	glm::vec3 lookAt;
+	glm::vec3 up = glm::vec3(0, 1, 0);
+	float vfov = 20;
+	float aperture = 0;
+	float focusDist = 1;
+};
+
+namespace Scenes
+{
+	// Names ending in .scene are loaded with SceneFile, which throws on
+	// errors. Returns false if no built-in scene has this name.
+	bool create(const std::string &name, SceneDescription &scene);
+	const std::vector<std::string> &getNames();
+}
\ No newline at end of file
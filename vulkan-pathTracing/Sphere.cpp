@@ -1,17 +1,18 @@
 #include "Sphere.h"
 
+#include "AABB.h"
 #include "HitRecord.h"
-#include "Material.h"
+#include "RenderStats.h"
 
-Sphere::Sphere(glm::vec3 center, float radius, IMaterial *material)
-	: center(center), radius(radius), material(material)
+Sphere::Sphere(glm::vec3 center, float radius, uint32_t materialId)
+	: center(center), radius(radius), materialId(materialId)
 {}
 
 Sphere::Sphere(const Sphere &ref)
 {
 	center = ref.center;
 	radius = ref.radius;
-	material = ref.material;
+	materialId = ref.materialId;
 }
 
 Sphere &Sphere::operator=(const Sphere &ref)
@@ -20,14 +21,17 @@ Sphere &Sphere::operator=(const Sphere &ref)
 	{
 		center = ref.center;
 		radius = ref.radius;
-		material = ref.material;
+		materialId = ref.materialId;
 	}
 	return (*this);
 }
 
 bool Sphere::hit(const Ray& ray, const float t_min, const float t_max, HitRecord& record) const
 {
-	record.material = material;
+	if (RenderStats *stats = RenderStats::getThreadStats())
+		stats->primitiveTests += 1;
+	record.materialId = materialId;
+	record.objectId = getObjectId();
 
 	glm::vec3 oc = ray.getOrigin() - center;
 	float a = glm::dot(ray.getDirection(), ray.getDirection());
@@ -55,4 +59,11 @@ bool Sphere::hit(const Ray& ray, const float t_min, const float t_max, HitRecord
 
 	}
 	return (false);
+}
+
+bool Sphere::boundingBox(AABB &box) const
+{
+	glm::vec3 extent(radius, radius, radius);
+	box = AABB(center - extent, center + extent);
+	return (true);
 }
\ No newline at end of file
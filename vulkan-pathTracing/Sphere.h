@@ -2,20 +2,25 @@
 
 #include <glm/glm.hpp>
 
-#include "IHitable.h"
+#include <stdint.h>
 
-class IMaterial;
+#include "IHitable.h"
 
 class Sphere : public IHitable
 {
 	glm::vec3					center;
-	IMaterial					*material;
+	uint32_t					materialId;
 	float						radius;
 
 public:
-	Sphere(glm::vec3 center, float radius, IMaterial *material);
+	Sphere(glm::vec3 center, float radius, uint32_t materialId);
 	Sphere(const Sphere &ref);
 	Sphere &operator=(const Sphere &ref);
 
+	const glm::vec3 &getCenter() const { return (center); }
+	float getRadius() const { return (radius); }
+	uint32_t getMaterialId() const { return (materialId); }
+
 	bool hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const override;
+	bool boundingBox(AABB &box) const override;
 };
\ No newline at end of file
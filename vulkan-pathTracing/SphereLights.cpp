@@ -0,0 +1,112 @@
+#include "SphereLights.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <math.h>
+
+#include <stdexcept>
+#include <string>
+
+#include "HitRecord.h"
+#include "Material.h"
+#include "MaterialTable.h"
+#include "PackedSpheres.h"
+#include "Sphere.h"
+
+constexpr uint32_t SphereLights::NO_LIGHT;
+
+namespace
+{
+	// 1 - cos of the half angle of the cone, written to stay accurate for
+	// small and distant lights.
+	float getOneMinusCosMax(float radius2, float distance2)
+	{
+		float sin2Max = radius2 / distance2;
+		return (sin2Max / (1 + sqrtf(1 - sin2Max)));
+	}
+}
+
+void SphereLights::build(IHitable *const *list, const MaterialTable &materials)
+{
+	clear();
+	if (!list)
+		return;
+
+	for (uint32_t i = 0; list[i]; i++)
+	{
+		if (const Sphere *sphere = dynamic_cast<const Sphere *>(list[i]))
+			add(sphere->getCenter(), sphere->getRadius(), sphere->getMaterialId(), sphere->getObjectId(), materials);
+		else if (const PackedSpheres *spheres = dynamic_cast<const PackedSpheres *>(list[i]))
+		{
+			for (uint32_t j = 0; j < spheres->size(); j++)
+				add(spheres->getCenter(j), spheres->getRadius(j), spheres->getMaterialId(j), spheres->getObjectId(j), materials);
+		}
+	}
+}
+
+void SphereLights::clear()
+{
+	lights.clear();
+	lightIndices.clear();
+}
+
+bool SphereLights::sample(const glm::vec3 &origin, const glm::vec3 &u, Sample &sample) const
+{
+	uint32_t index = static_cast<uint32_t>(u.x * lights.size());
+	const Light &light = lights[index < lights.size() ? index : lights.size() - 1];
+
+	glm::vec3 toCenter = light.center - origin;
+	float distance2 = glm::dot(toCenter, toCenter);
+	float radius2 = light.radius * light.radius;
+	if (distance2 <= radius2)
+		return (false);
+
+	float oneMinusCosMax = getOneMinusCosMax(radius2, distance2);
+	float oneMinusCos = u.y * oneMinusCosMax;
+	float cosTheta = 1 - oneMinusCos;
+	float sinTheta = sqrtf(glm::max(0.0f, oneMinusCos * (2 - oneMinusCos)));
+	float phi = 2 * glm::pi<float>() * u.z;
+
+	glm::vec3 w = toCenter / sqrtf(distance2);
+	glm::vec3 axis = fabsf(w.x) > 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+	glm::vec3 tangent = glm::normalize(glm::cross(w, axis));
+	glm::vec3 bitangent = glm::cross(tangent, w);
+	sample.direction = glm::normalize(bitangent * (cosf(phi) * sinTheta) + tangent * (sinf(phi) * sinTheta) + w * cosTheta);
+
+	float b = glm::dot(toCenter, sample.direction);
+	float discriminant = radius2 - (distance2 - b * b);
+	sample.distance = b - sqrtf(glm::max(0.0f, discriminant));
+	sample.radiance = light.radiance;
+	sample.pdf = 1 / (lights.size() * 2 * glm::pi<float>() * oneMinusCosMax);
+	return (true);
+}
+
+float SphereLights::pdf(const glm::vec3 &origin, const HitRecord &hit) const
+{
+	if (hit.objectId >= lightIndices.size() || lightIndices[hit.objectId] == NO_LIGHT)
+		return (0);
+	return (getConePdf(lights[lightIndices[hit.objectId]], origin));
+}
+
+void SphereLights::add(const glm::vec3 &center, float radius, uint32_t materialId, uint32_t objectId, const MaterialTable &materials)
+{
+	const Material &material = materials[materialId];
+	if (material.type != Material::Type::EMISSIVE || !(radius > 0))
+		return;
+	if (objectId >= lightIndices.size())
+		lightIndices.resize(objectId + 1, NO_LIGHT);
+	if (lightIndices[objectId] != NO_LIGHT)
+		throw std::runtime_error("Two lights share the object id " + std::to_string(objectId) + ".");
+	lightIndices[objectId] = static_cast<uint32_t>(lights.size());
+	lights.push_back(Light{ center, radius, material.albedo });
+}
+
+float SphereLights::getConePdf(const Light &light, const glm::vec3 &origin) const
+{
+	glm::vec3 toCenter = light.center - origin;
+	float distance2 = glm::dot(toCenter, toCenter);
+	float radius2 = light.radius * light.radius;
+	if (distance2 <= radius2)
+		return (0);
+	return (1 / (lights.size() * 2 * glm::pi<float>() * getOneMinusCosMax(radius2, distance2)));
+}
\ No newline at end of file
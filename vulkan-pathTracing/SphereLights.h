@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include <vector>
+
+class IHitable;
+class MaterialTable;
+struct HitRecord;
+
+// Spheres with an emissive material, sampled explicitly by the integrator.
+// A light is picked uniformly, then a direction uniformly in the cone it
+// subtends from the shaded point. Emissive meshes and instances are not in
+// the list, they are only found by the scattered rays.
+class SphereLights
+{
+	static constexpr uint32_t NO_LIGHT = 0xffffffff;
+
+	struct Light
+	{
+		glm::vec3 center;
+		float radius;
+		glm::vec3 radiance;
+	};
+
+public:
+	struct Sample
+	{
+		glm::vec3 direction; // normalized
+		float distance; // to the surface of the light along direction
+		glm::vec3 radiance;
+		float pdf; // solid angle density, light selection included
+	};
+
+	// Collects the emissive Sphere and PackedSpheres of a null-terminated
+	// list, other hitables are skipped. The lights are told apart by their
+	// object id, see IHitable::getObjectId; throws std::runtime_error when
+	// two of them share one.
+	void build(IHitable *const *list, const MaterialTable &materials);
+	void clear();
+
+	bool isEmpty() const { return (lights.empty()); }
+	uint32_t size() const { return (static_cast<uint32_t>(lights.size())); }
+
+	// u holds the uniform numbers of the Sampler::LIGHT dimensions, the
+	// first one picks the light, the other two the direction in its cone.
+	// False when the picked light contains origin.
+	bool sample(const glm::vec3 &origin, const glm::vec3 &u, Sample &sample) const;
+	// Density sample would have given to the direction from origin to a hit
+	// on an emissive surface, 0 if the surface is not in the list.
+	float pdf(const glm::vec3 &origin, const HitRecord &hit) const;
+
+private:
+	std::vector<Light> lights;
+	// Index in lights by object id, NO_LIGHT for the other objects.
+	std::vector<uint32_t> lightIndices;
+
+	void add(const glm::vec3 &center, float radius, uint32_t materialId, uint32_t objectId, const MaterialTable &materials);
+	float getConePdf(const Light &light, const glm::vec3 &origin) const;
+};
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "ThreadPool.h"
+
+#include <chrono>
+
+#include "LogMessage.h"
+
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# define NOMINMAX
+# include <windows.h>
+#elif defined(__linux__)
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+ThreadPool::ThreadPool(uint32_t nbThreads, bool pinThreads)
+{
+	if (nbThreads == 0)
+		nbThreads = std::thread::hardware_concurrency();
+	if (nbThreads == 0)
+		nbThreads = 1;
+
+	threads.reserve(nbThreads);
+	for (uint32_t i = 0; i < nbThreads; i++)
+	{
+		threads.emplace_back([this, i]() { this->workerLoop(i); });
+		if (pinThreads)
+			pinToCore(threads.back(), i);
+	}
+	LOG_MSG("Thread pool started with %u threads.", nbThreads);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(locker);
+		jobFinished.wait(lock, [this]() { return (nbRunning == 0); });
+		isStopping = true;
+	}
+	jobAvailable.notify_all();
+	for (std::thread &thread : threads)
+	{
+		if (thread.joinable())
+			thread.join();
+	}
+}
+
+void ThreadPool::dispatch(std::function<void(uint32_t)> newJob)
+{
+	{
+		std::unique_lock<std::mutex> lock(locker);
+		jobFinished.wait(lock, [this]() { return (nbRunning == 0); });
+		job = std::move(newJob);
+		nbRunning = static_cast<uint32_t>(threads.size());
+		generation += 1;
+	}
+	jobAvailable.notify_all();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(locker);
+	jobFinished.wait(lock, [this]() { return (nbRunning == 0); });
+}
+
+bool ThreadPool::waitFor(uint32_t timeoutMs)
+{
+	std::unique_lock<std::mutex> lock(locker);
+	return (jobFinished.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return (nbRunning == 0); }));
+}
+
+bool ThreadPool::isBusy()
+{
+	std::lock_guard<std::mutex> lock(locker);
+	return (nbRunning != 0);
+}
+
+void ThreadPool::workerLoop(uint32_t index)
+{
+	uint64_t seenGeneration = 0;
+	while (true)
+	{
+		std::function<void(uint32_t)> *currentJob;
+		{
+			std::unique_lock<std::mutex> lock(locker);
+			jobAvailable.wait(lock, [&]() { return (isStopping || generation != seenGeneration); });
+			if (isStopping)
+				return;
+			seenGeneration = generation;
+			currentJob = &job;
+		}
+
+		(*currentJob)(index);
+
+		bool isLast;
+		{
+			std::lock_guard<std::mutex> lock(locker);
+			nbRunning -= 1;
+			isLast = nbRunning == 0;
+		}
+		if (isLast)
+			jobFinished.notify_all();
+	}
+}
+
+void ThreadPool::pinToCore(std::thread &thread, uint32_t core)
+{
+#ifdef _WIN32
+	SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core % CPU_SETSIZE, &set);
+	pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set);
+#else
+	(void)thread;
+	(void)core;
+#endif
+}
\ No newline at end of file
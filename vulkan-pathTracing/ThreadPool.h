@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent set of worker threads. The threads are created once and sleep
+// between jobs, so several renders can reuse them without paying for thread
+// creation. A job is run once on every worker with the worker index.
+class ThreadPool
+{
+public:
+	// nbThreads == 0 uses std::thread::hardware_concurrency().
+	ThreadPool(uint32_t nbThreads = 0, bool pinThreads = false);
+	ThreadPool(const ThreadPool &ref) = delete;
+	ThreadPool &operator=(const ThreadPool &ref) = delete;
+	~ThreadPool();
+
+	uint32_t getThreadCount() const { return (static_cast<uint32_t>(threads.size())); }
+
+	// Starts job(workerIndex) on every worker and returns immediately.
+	// A previous job must be finished before dispatching a new one.
+	void dispatch(std::function<void(uint32_t)> newJob);
+	// Blocks until every worker returned from the current job.
+	void wait();
+	// Same as wait for at most timeoutMs, returns whether the job finished.
+	bool waitFor(uint32_t timeoutMs);
+	bool isBusy();
+
+private:
+	std::vector<std::thread> threads;
+
+	std::mutex locker;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobFinished;
+
+	std::function<void(uint32_t)> job;
+	uint64_t generation = 0;
+	uint32_t nbRunning = 0;
+	bool isStopping = false;
+
+	void workerLoop(uint32_t index);
+	static void pinToCore(std::thread &thread, uint32_t core);
+};
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "PixelBlock.h"
+
+void TileScheduler::configure(uint32_t width, uint32_t height, uint32_t newTileSize, Order newOrder)
+{
+	tileSize = newTileSize;
+	order = newOrder;
+	tiles.clear();
+
+	if (order == Order::SCANLINE)
+	{
+		uint32_t length = SCANLINE_LENGTH; // std::min takes references
+		uint32_t nbPixels = width * height;
+		for (uint32_t start = 0; start < nbPixels; start += length)
+		{
+			tiles.push_back({ start % width, start / width, std::min(length, nbPixels - start), 1 });
+		}
+		return;
+	}
+
+	uint32_t side = tileSize;
+	while (side * side > PixelBlock::MAX_PIXELS_PER_BLOCK)
+		side -= 1;
+	tileSize = side;
+
+	uint32_t tilesX = (width + side - 1) / side;
+	uint32_t tilesY = (height + side - 1) / side;
+	uint32_t gridSide = 1;
+	while (gridSide < tilesX || gridSide < tilesY)
+		gridSide <<= 1;
+
+	std::vector<std::pair<uint32_t, Tile>> keyedTiles;
+	keyedTiles.reserve(tilesX * tilesY);
+	for (uint32_t ty = 0; ty < tilesY; ty++)
+	{
+		for (uint32_t tx = 0; tx < tilesX; tx++)
+		{
+			Tile tile = { tx * side, ty * side, std::min(side, width - tx * side), std::min(side, height - ty * side) };
+			uint32_t key = order == Order::MORTON ? mortonIndex(tx, ty) : hilbertIndex(gridSide, tx, ty);
+			keyedTiles.emplace_back(key, tile);
+		}
+	}
+	std::sort(keyedTiles.begin(), keyedTiles.end(),
+		[](const std::pair<uint32_t, Tile> &a, const std::pair<uint32_t, Tile> &b) { return (a.first < b.first); });
+
+	tiles.reserve(keyedTiles.size());
+	for (const std::pair<uint32_t, Tile> &keyedTile : keyedTiles)
+	{
+		tiles.push_back(keyedTile.second);
+	}
+}
+
+const char *TileScheduler::getOrderName(Order order)
+{
+	switch (order)
+	{
+	case Order::MORTON:
+		return ("morton");
+	case Order::HILBERT:
+		return ("hilbert");
+	default:
+		return ("scanline");
+	}
+}
+
+TileScheduler::Tile TileScheduler::getBounds(const Tile &tile, uint32_t imageWidth)
+{
+	if (tile.x + tile.width <= imageWidth)
+		return (tile);
+	return (Tile{ 0, tile.y, imageWidth, (tile.x + tile.width - 1) / imageWidth + 1 });
+}
+
+uint32_t TileScheduler::mortonIndex(uint32_t x, uint32_t y)
+{
+	auto spread = [](uint32_t v)
+	{
+		v &= 0xffff;
+		v = (v | (v << 8)) & 0x00ff00ff;
+		v = (v | (v << 4)) & 0x0f0f0f0f;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return (v);
+	};
+	return (spread(x) | (spread(y) << 1));
+}
+
+// Distance of (x, y) along the Hilbert curve filling a side x side square,
+// side being a power of two.
+uint32_t TileScheduler::hilbertIndex(uint32_t side, uint32_t x, uint32_t y)
+{
+	uint32_t d = 0;
+	for (uint32_t s = side / 2; s > 0; s /= 2)
+	{
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		d += s * s * ((3 * rx) ^ ry);
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = side - 1 - x;
+				y = side - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return (d);
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+// Splits the image into tiles and decides the order they are handed out in.
+// SCANLINE reproduces the historical blocks, runs of pixels in row major
+// order, MORTON and HILBERT issue square tiles along a space filling curve
+// so that consecutive blocks, and the rays inside a block, touch
+// neighbouring geometry.
+class TileScheduler
+{
+public:
+	// Pixels of a SCANLINE run, whatever the tile size.
+	static constexpr uint32_t SCANLINE_LENGTH = 512;
+
+	enum class Order
+	{
+		SCANLINE,
+		MORTON,
+		HILBERT
+	};
+
+	// Square tiles are rectangles. Scanline runs are a single row of width
+	// pixels that goes on at the start of the next image rows when it
+	// passes the end of row y, so pixel i of row r of any tile is at
+	// x + i + (y + r) * imageWidth.
+	struct Tile
+	{
+		uint32_t x;
+		uint32_t y;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	// Square tiles are tileSize x tileSize.
+	void configure(uint32_t width, uint32_t height, uint32_t tileSize, Order order);
+
+	uint32_t getTileCount() const { return (static_cast<uint32_t>(tiles.size())); }
+	const Tile &getTile(uint32_t index) const { return (tiles[index]); }
+	uint32_t getTileSize() const { return (tileSize); }
+	Order getOrder() const { return (order); }
+
+	static const char *getOrderName(Order order);
+	// Smallest rectangle of the image holding the tile.
+	static Tile getBounds(const Tile &tile, uint32_t imageWidth);
+
+private:
+	uint32_t tileSize = 0;
+	Order order = Order::SCANLINE;
+	std::vector<Tile> tiles;
+
+	static uint32_t mortonIndex(uint32_t x, uint32_t y);
+	static uint32_t hilbertIndex(uint32_t side, uint32_t x, uint32_t y);
+};
\ No newline at end of file
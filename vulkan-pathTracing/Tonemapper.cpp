@@ -0,0 +1,301 @@
+#include "Tonemapper.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "PackedSpheres.h"
+#include "PathTracing.h"
+#include "ThreadPool.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+# define TONEMAPPER_X86
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  define TARGET_AVX2
+# else
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+# endif
+#endif
+
+namespace
+{
+	// ACES filmic curve fitted by Krzysztof Narkowicz.
+	constexpr float ACES_A = 2.51f;
+	constexpr float ACES_B = 0.03f;
+	constexpr float ACES_C = 2.43f;
+	constexpr float ACES_D = 0.59f;
+	constexpr float ACES_E = 0.14f;
+
+	// 4x4 Bayer matrix scaled to the 8 fractional bits of the LUT.
+	const uint16_t DITHER[4][4] =
+	{
+		{ 8, 136, 40, 168 },
+		{ 200, 72, 232, 104 },
+		{ 56, 184, 24, 152 },
+		{ 248, 120, 216, 88 }
+	};
+
+	typedef void (*TonemapKernel)(const float *in, uint32_t count, float exposure, float scale, uint16_t *levels);
+
+	// Each kernel maps count floats to LUT levels. The three operators work
+	// per channel, so a row of glm::vec3 is processed as a flat float array.
+	// NaN and negative values end up at level 0.
+	template <Tonemapper::Operator OP>
+	void tonemapScalar(const float *in, uint32_t count, float exposure, float scale, uint16_t *levels)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			float x = in[i] * exposure;
+			x = x > 0 ? x : 0;
+			if (OP == Tonemapper::Operator::REINHARD)
+				x = x / (1 + x);
+			else if (OP == Tonemapper::Operator::ACES)
+				x = (x * (ACES_A * x + ACES_B)) / (x * (ACES_C * x + ACES_D) + ACES_E);
+			x = x < 1 ? x : 1;
+			levels[i] = static_cast<uint16_t>(x * scale + 0.5f);
+		}
+	}
+
+#ifdef TONEMAPPER_X86
+	template <Tonemapper::Operator OP>
+	void tonemapSSE(const float *in, uint32_t count, float exposure, float scale, uint16_t *levels)
+	{
+		const __m128 vexposure = _mm_set1_ps(exposure);
+		const __m128 vscale = _mm_set1_ps(scale);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		uint32_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), vexposure), zero);
+			if (OP == Tonemapper::Operator::REINHARD)
+				x = _mm_div_ps(x, _mm_add_ps(one, x));
+			else if (OP == Tonemapper::Operator::ACES)
+			{
+				__m128 numerator = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ACES_A), x), _mm_set1_ps(ACES_B)));
+				__m128 denominator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ACES_C), x), _mm_set1_ps(ACES_D))),
+					_mm_set1_ps(ACES_E));
+				x = _mm_div_ps(numerator, denominator);
+			}
+			x = _mm_min_ps(x, one);
+			__m128i level = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(x, vscale), half));
+			// Levels fit in 16 bits, so the signed saturation is exact.
+			_mm_storel_epi64(reinterpret_cast<__m128i *>(levels + i), _mm_packs_epi32(level, level));
+		}
+		tonemapScalar<OP>(in + i, count - i, exposure, scale, levels + i);
+	}
+
+	template <Tonemapper::Operator OP>
+	TARGET_AVX2
+	void tonemapAVX2(const float *in, uint32_t count, float exposure, float scale, uint16_t *levels)
+	{
+		const __m256 vexposure = _mm256_set1_ps(exposure);
+		const __m256 vscale = _mm256_set1_ps(scale);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+
+		uint32_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 x = _mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), vexposure), zero);
+			if (OP == Tonemapper::Operator::REINHARD)
+				x = _mm256_div_ps(x, _mm256_add_ps(one, x));
+			else if (OP == Tonemapper::Operator::ACES)
+			{
+				__m256 numerator = _mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ACES_A), x), _mm256_set1_ps(ACES_B)));
+				__m256 denominator = _mm256_add_ps(_mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ACES_C), x), _mm256_set1_ps(ACES_D))),
+					_mm256_set1_ps(ACES_E));
+				x = _mm256_div_ps(numerator, denominator);
+			}
+			x = _mm256_min_ps(x, one);
+			__m256i level = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(x, vscale), half));
+			__m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(level), _mm256_extracti128_si256(level, 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(levels + i), packed);
+		}
+		tonemapScalar<OP>(in + i, count - i, exposure, scale, levels + i);
+	}
+#endif
+
+	template <Tonemapper::Operator OP>
+	TonemapKernel selectKernel()
+	{
+#ifdef TONEMAPPER_X86
+		PackedSpheres::SimdLevel level = PackedSpheres::getSupportedSimdLevel();
+		if (static_cast<int>(level) >= static_cast<int>(PackedSpheres::SimdLevel::AVX2))
+			return (&tonemapAVX2<OP>);
+		if (level == PackedSpheres::SimdLevel::SSE)
+			return (&tonemapSSE<OP>);
+#endif
+		return (&tonemapScalar<OP>);
+	}
+
+	TonemapKernel getKernel(Tonemapper::Operator tonemap)
+	{
+		static const TonemapKernel kernels[3] =
+		{
+			selectKernel<Tonemapper::Operator::CLAMP>(),
+			selectKernel<Tonemapper::Operator::REINHARD>(),
+			selectKernel<Tonemapper::Operator::ACES>()
+		};
+		return (kernels[static_cast<uint32_t>(tonemap)]);
+	}
+
+	float linearToSrgb(float x)
+	{
+		if (x <= 0.0031308f)
+			return (12.92f * x);
+		return (1.055f * powf(x, 1 / 2.4f) - 0.055f);
+	}
+}
+
+Tonemapper::Tonemapper(ThreadPool &pool)
+	: pool(pool)
+{
+	buildLut();
+}
+
+void Tonemapper::setSettings(const Settings &newSettings)
+{
+	settings = newSettings;
+	buildLut();
+	readState.tileVersions.clear();
+}
+
+uint32_t Tonemapper::update(PathTracing &pathTracing)
+{
+	return (update(pathTracing, nullptr));
+}
+
+uint32_t Tonemapper::update(PathTracing &pathTracing, const glm::vec3 *picture)
+{
+	uint32_t newWidth = static_cast<uint32_t>(pathTracing.getWidth());
+	uint32_t newHeight = static_cast<uint32_t>(pathTracing.getHeight());
+	if (newWidth != width || newHeight != height)
+	{
+		width = newWidth;
+		height = newHeight;
+		output.assign(width * height, 0xff000000);
+	}
+	if (picture)
+		readState.tileVersions.clear();
+	pathTracing.prepareRead(readState);
+	source = picture;
+	if (outputVersions.size() != pathTracing.getTileCount())
+	{
+		outputVersions.assign(pathTracing.getTileCount(), 1);
+		outputTiles.assign(pathTracing.getTileCount(), TileScheduler::Tile{ 0, 0, 0, 0 });
+	}
+
+	nextTile.store(0, std::memory_order_relaxed);
+	nbConverted.store(0, std::memory_order_relaxed);
+	pool.dispatch([this, &pathTracing](uint32_t) { this->convertTiles(pathTracing); });
+	pool.wait();
+	source = nullptr;
+	return (nbConverted.load(std::memory_order_relaxed));
+}
+
+uint32_t Tonemapper::getDirtyTiles(PathTracing::ReadState &state, std::vector<TileScheduler::Tile> &dirtyTiles) const
+{
+	if (state.tileVersions.size() != outputVersions.size())
+		state.tileVersions.assign(outputVersions.size(), 0);
+
+	uint32_t nbDirty = 0;
+	for (uint32_t i = 0; i < outputVersions.size(); i++)
+	{
+		if (state.tileVersions[i] != outputVersions[i])
+		{
+			state.tileVersions[i] = outputVersions[i];
+			dirtyTiles.push_back(outputTiles[i]);
+			nbDirty += 1;
+		}
+	}
+	return (nbDirty);
+}
+
+const char *Tonemapper::getOperatorName(Operator tonemap)
+{
+	switch (tonemap)
+	{
+	case Operator::REINHARD:
+		return ("reinhard");
+	case Operator::ACES:
+		return ("aces");
+	default:
+		return ("clamp");
+	}
+}
+
+void Tonemapper::buildLut()
+{
+	for (uint32_t i = 0; i < LUT_SIZE; i++)
+	{
+		float x = static_cast<float>(i) / (LUT_SIZE - 1);
+		if (settings.isSrgb)
+			x = linearToSrgb(x);
+		lut[i] = static_cast<uint16_t>(x * 255 * 256 + 0.5f);
+	}
+}
+
+void Tonemapper::convertTiles(PathTracing &pathTracing)
+{
+	std::vector<uint16_t> levels;
+	uint32_t tileCount = static_cast<uint32_t>(outputVersions.size());
+	uint32_t tileIndex;
+	while ((tileIndex = nextTile.fetch_add(1, std::memory_order_relaxed)) < tileCount)
+		convertTile(pathTracing, tileIndex, levels);
+}
+
+void Tonemapper::convertTile(PathTracing &pathTracing, uint32_t tileIndex, std::vector<uint16_t> &levels)
+{
+	PathTracing::DirtyTile dirtyTile;
+	if (source)
+	{
+		dirtyTile.rect = pathTracing.getTile(tileIndex);
+		dirtyTile.data = source + dirtyTile.rect.x + dirtyTile.rect.y * width;
+	}
+	else if (!pathTracing.readDirtyTile(readState, tileIndex, dirtyTile))
+		return;
+
+	const TileScheduler::Tile &tile = dirtyTile.rect;
+	TonemapKernel kernel = getKernel(settings.tonemap);
+	float scale = static_cast<float>(LUT_SIZE - 1);
+	levels.resize(tile.width * 3);
+	uint32_t first = tile.x + tile.y * width;
+	for (uint32_t row = 0; row < tile.height; row++)
+	{
+		// Scanline runs are cut where they wrap onto the next image row.
+		uint32_t pixel = tile.x + (tile.y + row) * width;
+		uint32_t end = pixel + tile.width;
+		while (pixel < end)
+		{
+			uint32_t x0 = pixel % width;
+			uint32_t y = pixel / width;
+			uint32_t length = std::min(end - pixel, width - x0);
+			kernel(&dirtyTile.data[pixel - first].x, length * 3, settings.exposure, scale, levels.data());
+
+			// The picture is stored bottom row first, the output top row first.
+			uint32_t *out = output.data() + x0 + (height - y - 1) * width;
+			const uint16_t *dither = DITHER[(height - y - 1) & 3];
+			for (uint32_t x = 0; x < length; x++)
+			{
+				uint32_t offset = settings.isDithering ? dither[(x0 + x) & 3] : 128;
+				uint32_t r = (lut[levels[x * 3]] + offset) >> 8;
+				uint32_t g = (lut[levels[x * 3 + 1]] + offset) >> 8;
+				uint32_t b = (lut[levels[x * 3 + 2]] + offset) >> 8;
+				r = r < 255 ? r : 255;
+				g = g < 255 ? g : 255;
+				b = b < 255 ? b : 255;
+				out[x] = b | (g << 8) | (r << 16) | 0xff000000;
+			}
+			pixel += length;
+		}
+	}
+	TileScheduler::Tile bounds = TileScheduler::getBounds(tile, width);
+	outputTiles[tileIndex] = TileScheduler::Tile{ bounds.x, height - bounds.y - bounds.height, bounds.width, bounds.height };
+	outputVersions[tileIndex] += 1;
+	nbConverted.fetch_add(1, std::memory_order_relaxed);
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "PathTracing.h"
+#include "TileScheduler.h"
+
+class ThreadPool;
+
+// Converts the picture of a PathTracing into a BGRA8 image, top row first,
+// ready to be copied into the viewer's staging buffer. The conversion runs
+// on the given pool with SSE or AVX2 kernels and only touches the tiles
+// whose version changed since the previous update.
+class Tonemapper
+{
+	static constexpr uint32_t LUT_SIZE = 4096;
+public:
+	enum class Operator
+	{
+		CLAMP,
+		REINHARD,
+		ACES
+	};
+
+	struct Settings
+	{
+		Operator tonemap = Operator::CLAMP;
+		float exposure = 1;
+		bool isSrgb = true;
+		bool isDithering = false;
+	};
+
+	Tonemapper(ThreadPool &pool);
+
+	// Every tile is converted again at the next update.
+	void setSettings(const Settings &newSettings);
+	const Settings &getSettings() const { return (settings); }
+
+	// Blocks until the changed tiles are converted, returns how many were.
+	uint32_t update(PathTracing &pathTracing);
+	// Converts every tile of picture instead, a buffer laid out like the
+	// picture of pathTracing such as the output of a Denoiser. The next
+	// update without a picture converts every tile again.
+	uint32_t update(PathTracing &pathTracing, const glm::vec3 *picture);
+
+	const uint32_t *getOutput() const { return (output.data()); }
+	// Output tiles converted since the last read of this state, in output
+	// coordinates. Appends them to dirtyTiles and returns how many there were.
+	uint32_t getDirtyTiles(PathTracing::ReadState &state, std::vector<TileScheduler::Tile> &dirtyTiles) const;
+
+	static const char *getOperatorName(Operator tonemap);
+
+private:
+	ThreadPool &pool;
+	Settings settings;
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint32_t> output;
+	PathTracing::ReadState readState;
+	// Picture of the update in progress, null to read the dirty tiles of
+	// the PathTracing.
+	const glm::vec3 *source = nullptr;
+	// Bumped every time a tile of the output is converted, starts at 1 so a
+	// new read state sees the whole output.
+	std::vector<uint32_t> outputVersions;
+	std::vector<TileScheduler::Tile> outputTiles;
+
+	// Output value of each quantized tonemapped level, in 8.8 fixed point so
+	// the dither can be added before the final shift.
+	uint16_t lut[LUT_SIZE];
+
+	std::atomic<uint32_t> nextTile = { 0 };
+	std::atomic<uint32_t> nbConverted = { 0 };
+
+	void buildLut();
+	void convertTiles(PathTracing &pathTracing);
+	void convertTile(PathTracing &pathTracing, uint32_t tileIndex, std::vector<uint16_t> &levels);
+};
\ No newline at end of file
@@ -0,0 +1,752 @@
+#include "TriangleMesh.h"
+
+#include <float.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "HitRecord.h"
+#include "LogMessage.h"
+#include "Ray.h"
+#include "RenderStats.h"
+#include "SceneArena.h"
+
+// The SIMD kernels must not be fused into FMAs or they would stop matching
+// the scalar path bit for bit.
+#if defined(__clang__)
+# pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+# pragma GCC optimize("fp-contract=off")
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+# define TRIANGLE_MESH_X86
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  define TARGET_AVX2
+# else
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+# endif
+#endif
+
+namespace
+{
+	const float PADDING_VALUE = std::numeric_limits<float>::quiet_NaN();
+
+	// U, V or W exactly 0 means the ray goes through an edge or a vertex,
+	// recomputing them in double keeps neighbouring triangles watertight.
+	void recomputeEdgeFunctions(float axs, float ays, float bxs, float bys, float cxs, float cys, float &u, float &v, float &w)
+	{
+		u = static_cast<float>(static_cast<double>(cxs) * bys - static_cast<double>(cys) * bxs);
+		v = static_cast<float>(static_cast<double>(axs) * cys - static_cast<double>(ays) * cxs);
+		w = static_cast<float>(static_cast<double>(bxs) * ays - static_cast<double>(bys) * axs);
+	}
+
+#ifdef TRIANGLE_MESH_X86
+	// Picks the lane with the smallest t, the lowest triangle on ties, which
+	// is what the scalar loop returns with its strict comparison.
+	int32_t reduceLanes(const float *laneT, const int32_t *laneIndex, uint32_t width, float &t)
+	{
+		int32_t best = -1;
+		for (uint32_t i = 0; i < width; i++)
+		{
+			if (laneIndex[i] < 0)
+				continue;
+			if (best < 0 || laneT[i] < t || (laneT[i] == t && laneIndex[i] < best))
+			{
+				best = laneIndex[i];
+				t = laneT[i];
+			}
+		}
+		return (best);
+	}
+#endif
+
+	// Slab test with the near and far planes picked from the sign of the
+	// direction up front, cheaper than AABB::hit in the inner loop.
+	bool hitBox(const AABB &box, const glm::vec3 &origin, const glm::vec3 &invDirection, const bool *isDirectionNegative,
+		float minTime, float maxTime)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			float nearPlane = isDirectionNegative[a] ? box.max[a] : box.min[a];
+			float farPlane = isDirectionNegative[a] ? box.min[a] : box.max[a];
+			float t0 = (nearPlane - origin[a]) * invDirection[a];
+			float t1 = (farPlane - origin[a]) * invDirection[a];
+			minTime = t0 > minTime ? t0 : minTime;
+			maxTime = t1 < maxTime ? t1 : maxTime;
+		}
+		return (minTime <= maxTime);
+	}
+
+	const char *skipSpaces(const char *text)
+	{
+		while (*text == ' ' || *text == '\t')
+			text++;
+		return (text);
+	}
+
+	const char *skipToken(const char *text)
+	{
+		while (*text && *text != ' ' && *text != '\t' && *text != '\r' && *text != '\n')
+			text++;
+		return (text);
+	}
+}
+
+constexpr uint32_t TriangleMesh::LEAF_WIDTH;
+
+TriangleMesh::TriangleMesh(uint32_t materialId)
+	: materialId(materialId)
+{
+	setSimdLevel(PackedSpheres::getSupportedSimdLevel());
+}
+
+void TriangleMesh::loadObj(const std::string &path)
+{
+	std::ifstream input(path);
+	if (!input)
+		throw std::runtime_error("Unable to open mesh " + path + ".");
+
+	std::vector<glm::vec3> newVertices;
+	std::vector<uint32_t> newIndices;
+	std::vector<uint32_t> face;
+	std::string line;
+	uint32_t lineNumber = 0;
+	while (std::getline(input, line))
+	{
+		lineNumber += 1;
+		const char *text = skipSpaces(line.c_str());
+		if (text[0] == 'v' && (text[1] == ' ' || text[1] == '\t'))
+		{
+			char *end;
+			glm::vec3 vertex;
+			text += 1;
+			for (int i = 0; i < 3; i++)
+			{
+				vertex[i] = strtof(text, &end);
+				if (end == text)
+					throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": invalid vertex.");
+				text = end;
+			}
+			newVertices.push_back(vertex);
+		}
+		else if (text[0] == 'f' && (text[1] == ' ' || text[1] == '\t'))
+		{
+			face.clear();
+			text = skipSpaces(text + 1);
+			while (*text && *text != '\r' && *text != '\n')
+			{
+				char *end;
+				long index = strtol(text, &end, 10);
+				if (end == text)
+					throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": invalid face.");
+				// Negative indices count back from the last vertex.
+				long resolved = index > 0 ? index - 1 : static_cast<long>(newVertices.size()) + index;
+				if (index == 0 || resolved < 0 || resolved >= static_cast<long>(newVertices.size()))
+					throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": vertex index out of range.");
+				face.push_back(static_cast<uint32_t>(resolved));
+				text = skipSpaces(skipToken(end));
+			}
+			for (size_t i = 2; i < face.size(); i++)
+			{
+				newIndices.push_back(face[0]);
+				newIndices.push_back(face[i - 1]);
+				newIndices.push_back(face[i]);
+			}
+		}
+	}
+	setGeometry(std::move(newVertices), std::move(newIndices));
+	LOG_MSG("Loaded %s: %u vertices, %u triangles.", path.c_str(), getVertexCount(), getTriangleCount());
+}
+
+void TriangleMesh::setGeometry(std::vector<glm::vec3> &&newVertices, std::vector<uint32_t> &&newIndices)
+{
+	vertices = std::move(newVertices);
+	indices = std::move(newIndices);
+	indices.resize(indices.size() / 3 * 3);
+	nbVertices = static_cast<uint32_t>(vertices.size());
+	nbTriangles = static_cast<uint32_t>(indices.size() / 3);
+	build();
+	vertexData = vertices.data();
+	indexData = indices.data();
+	nodeData = nodes.data();
+	leafBlockData = leafBlocks.data();
+	nbNodes = static_cast<uint32_t>(nodes.size());
+}
+
+void TriangleMesh::moveTo(SceneArena &arena)
+{
+	glm::vec3 *arenaVertices = arena.createArray<glm::vec3>(vertices.size(), SceneArena::Category::GEOMETRY);
+	uint32_t *arenaIndices = arena.createArray<uint32_t>(indices.size(), SceneArena::Category::GEOMETRY);
+	Node *arenaNodes = arena.createArray<Node>(nodes.size(), SceneArena::Category::NODE);
+	LeafBlock *arenaLeafBlocks = arena.createArray<LeafBlock>(leafBlocks.size(), SceneArena::Category::GEOMETRY);
+	std::uninitialized_copy(vertices.begin(), vertices.end(), arenaVertices);
+	std::uninitialized_copy(indices.begin(), indices.end(), arenaIndices);
+	std::uninitialized_copy(nodes.begin(), nodes.end(), arenaNodes);
+	std::uninitialized_copy(leafBlocks.begin(), leafBlocks.end(), arenaLeafBlocks);
+	std::vector<glm::vec3>().swap(vertices);
+	std::vector<uint32_t>().swap(indices);
+	std::vector<Node>().swap(nodes);
+	std::vector<LeafBlock>().swap(leafBlocks);
+	vertexData = arenaVertices;
+	indexData = arenaIndices;
+	nodeData = arenaNodes;
+	leafBlockData = arenaLeafBlocks;
+}
+
+void TriangleMesh::setSimdLevel(PackedSpheres::SimdLevel level)
+{
+	PackedSpheres::SimdLevel supported = PackedSpheres::getSupportedSimdLevel();
+	simdLevel = static_cast<int>(level) > static_cast<int>(supported) ? supported : level;
+	if (simdLevel == PackedSpheres::SimdLevel::AVX512)
+		simdLevel = PackedSpheres::SimdLevel::AVX2;
+}
+
+bool TriangleMesh::hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const
+{
+	if (nbNodes == 0)
+		return (false);
+
+	glm::vec3 invDirection = 1.0f / ray.getDirection();
+	bool isDirectionNegative[3] = { invDirection.x < 0, invDirection.y < 0, invDirection.z < 0 };
+	RayShear shear = computeShear(ray.getDirection());
+
+	uint32_t stack[MAX_DEPTH];
+	uint32_t stackSize = 0;
+	uint32_t current = 0;
+
+	float closest = maxTime;
+	int32_t best = -1;
+	uint32_t nbVisits = 0;
+	uint32_t nbTests = 0;
+	while (true)
+	{
+		const Node &node = nodeData[current];
+		nbVisits += 1;
+		if (hitBox(node.box, ray.getOrigin(), invDirection, isDirectionNegative, minTime, closest))
+		{
+			if (node.count > 0)
+			{
+				int32_t triangle = intersectLeaf(ray, shear, node.offset, node.count, minTime, closest);
+				nbTests += node.count;
+				if (triangle >= 0)
+					best = triangle;
+			}
+			else
+			{
+				if (isDirectionNegative[node.axis])
+				{
+					stack[stackSize++] = current + 1;
+					current = node.offset;
+				}
+				else
+				{
+					stack[stackSize++] = node.offset;
+					current = current + 1;
+				}
+				continue;
+			}
+		}
+		if (stackSize == 0)
+			break;
+		current = stack[--stackSize];
+	}
+	if (RenderStats *stats = RenderStats::getThreadStats())
+	{
+		stats->nodeVisits += nbVisits;
+		stats->primitiveTests += nbTests;
+	}
+	if (best < 0)
+		return (false);
+
+	const glm::vec3 &v0 = vertexData[indexData[best * 3]];
+	const glm::vec3 &v1 = vertexData[indexData[best * 3 + 1]];
+	const glm::vec3 &v2 = vertexData[indexData[best * 3 + 2]];
+	record.t = closest;
+	record.p = ray.pointAtTime(closest);
+	record.normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+	record.materialId = materialId;
+	record.objectId = getObjectId();
+	return (true);
+}
+
+bool TriangleMesh::boundingBox(AABB &box) const
+{
+	if (nbNodes == 0)
+		return (false);
+	box = nodeData[0].box;
+	return (true);
+}
+
+// The triangles of a leaf stay contiguous in buildTriangles, so once the
+// tree is built the index buffer is rewritten in that order and the leaf
+// blocks are copied from it.
+void TriangleMesh::build()
+{
+	nodes.clear();
+	leafBlocks.clear();
+	uint32_t triangleCount = getTriangleCount();
+	if (triangleCount == 0)
+		return;
+
+	std::vector<BuildTriangle> buildTriangles(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		BuildTriangle &triangle = buildTriangles[i];
+		triangle.box = AABB();
+		triangle.box.grow(vertices[indices[i * 3]]);
+		triangle.box.grow(vertices[indices[i * 3 + 1]]);
+		triangle.box.grow(vertices[indices[i * 3 + 2]]);
+		triangle.centroid = triangle.box.getCenter();
+		triangle.index = i;
+	}
+
+	nodes.reserve(2 * triangleCount / MAX_TRIANGLES_PER_LEAF + 1);
+	buildNode(buildTriangles, 0, triangleCount, 0);
+
+	std::vector<uint32_t> sortedIndices(indices.size());
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		uint32_t source = buildTriangles[i].index;
+		sortedIndices[i * 3] = indices[source * 3];
+		sortedIndices[i * 3 + 1] = indices[source * 3 + 1];
+		sortedIndices[i * 3 + 2] = indices[source * 3 + 2];
+	}
+	indices = std::move(sortedIndices);
+	buildLeafBlocks();
+	LOG_MSG("Mesh BVH built with %zu nodes and %zu leaf blocks for %u triangles.", nodes.size(), leafBlocks.size(), triangleCount);
+}
+
+// Leaves are numbered in node order, which is also the order of their
+// triangles, and a leaf larger than LEAF_WIDTH takes consecutive blocks.
+void TriangleMesh::buildLeafBlocks()
+{
+	for (Node &node : nodes)
+	{
+		if (node.count == 0)
+			continue;
+		uint32_t firstBlock = static_cast<uint32_t>(leafBlocks.size());
+		for (uint32_t first = node.offset; first < node.offset + node.count; first += LEAF_WIDTH)
+		{
+			leafBlocks.emplace_back();
+			LeafBlock &block = leafBlocks.back();
+			block.first = first;
+			for (uint32_t lane = 0; lane < LEAF_WIDTH; lane++)
+			{
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					if (first + lane < node.offset + node.count)
+					{
+						const uint32_t *triangle = &indices[(first + lane) * 3];
+						block.a[axis][lane] = vertices[triangle[0]][axis];
+						block.b[axis][lane] = vertices[triangle[1]][axis];
+						block.c[axis][lane] = vertices[triangle[2]][axis];
+					}
+					else
+					{
+						block.a[axis][lane] = PADDING_VALUE;
+						block.b[axis][lane] = PADDING_VALUE;
+						block.c[axis][lane] = PADDING_VALUE;
+					}
+				}
+			}
+		}
+		node.offset = firstBlock;
+	}
+}
+
+// Same binned surface area heuristic as BVH::build.
+uint32_t TriangleMesh::buildNode(std::vector<BuildTriangle> &buildTriangles, uint32_t begin, uint32_t end, uint32_t depth)
+{
+	uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+
+	AABB box;
+	AABB centroidBox;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		box.grow(buildTriangles[i].box);
+		centroidBox.grow(buildTriangles[i].centroid);
+	}
+	nodes[nodeIndex].box = box;
+
+	uint32_t count = end - begin;
+	glm::vec3 extent = centroidBox.max - centroidBox.min;
+	uint16_t axis = 0;
+	if (extent.y > extent.x)
+		axis = 1;
+	if (extent.z > extent[axis])
+		axis = 2;
+
+	// Every centroid at the same place, no split can help.
+	bool isLeaf = count == 1 || depth + 1 >= MAX_DEPTH || (extent[axis] <= 0 && count <= UINT16_MAX);
+	uint32_t mid = begin;
+	if (!isLeaf && extent[axis] > 0)
+	{
+		struct Bin
+		{
+			AABB box;
+			uint32_t count = 0;
+		};
+
+		Bin bins[NBR_BINS];
+		float scale = NBR_BINS / extent[axis];
+		auto binIndex = [&](const BuildTriangle &triangle)
+		{
+			uint32_t index = static_cast<uint32_t>((triangle.centroid[axis] - centroidBox.min[axis]) * scale);
+			return (index < NBR_BINS ? index : NBR_BINS - 1);
+		};
+
+		for (uint32_t i = begin; i < end; i++)
+		{
+			Bin &bin = bins[binIndex(buildTriangles[i])];
+			bin.box.grow(buildTriangles[i].box);
+			bin.count += 1;
+		}
+
+		float rightArea[NBR_BINS];
+		uint32_t rightCount[NBR_BINS];
+		AABB accumulated;
+		uint32_t accumulatedCount = 0;
+		for (uint32_t i = NBR_BINS - 1; i > 0; i--)
+		{
+			accumulated.grow(bins[i].box);
+			accumulatedCount += bins[i].count;
+			rightArea[i] = accumulated.getSurfaceArea();
+			rightCount[i] = accumulatedCount;
+		}
+
+		float bestCost = FLT_MAX;
+		uint32_t bestSplit = 0;
+		accumulated = AABB();
+		accumulatedCount = 0;
+		for (uint32_t i = 0; i < NBR_BINS - 1; i++)
+		{
+			accumulated.grow(bins[i].box);
+			accumulatedCount += bins[i].count;
+			if (accumulatedCount == 0 || rightCount[i + 1] == 0)
+				continue;
+			float cost = accumulated.getSurfaceArea() * accumulatedCount + rightArea[i + 1] * rightCount[i + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = i;
+			}
+		}
+
+		float area = box.getSurfaceArea();
+		float splitCost = TRAVERSAL_COST + INTERSECTION_COST * (area > 0 ? bestCost / area : 0);
+		float leafCost = INTERSECTION_COST * count;
+		isLeaf = count <= MAX_TRIANGLES_PER_LEAF && leafCost <= splitCost;
+		if (!isLeaf && bestCost < FLT_MAX)
+		{
+			auto it = std::partition(buildTriangles.begin() + begin, buildTriangles.begin() + end,
+				[&](const BuildTriangle &triangle) { return (binIndex(triangle) <= bestSplit); });
+			mid = static_cast<uint32_t>(it - buildTriangles.begin());
+		}
+	}
+	if (isLeaf)
+	{
+		nodes[nodeIndex].offset = begin;
+		nodes[nodeIndex].count = static_cast<uint16_t>(count);
+		return (nodeIndex);
+	}
+
+	// A child too large to be halved down to leaves that fit a Node before
+	// MAX_DEPTH is split by median instead.
+	uint64_t capacity = getSubtreeCapacity(depth + 1);
+	if (mid - begin > capacity || end - mid > capacity)
+		mid = begin;
+
+	if (mid == begin || mid == end)
+	{
+		mid = begin + count / 2;
+		std::nth_element(buildTriangles.begin() + begin, buildTriangles.begin() + mid, buildTriangles.begin() + end,
+			[axis](const BuildTriangle &a, const BuildTriangle &b) { return (a.centroid[axis] < b.centroid[axis]); });
+	}
+
+	buildNode(buildTriangles, begin, mid, depth + 1);
+	uint32_t secondChild = buildNode(buildTriangles, mid, end, depth + 1);
+	nodes[nodeIndex].offset = secondChild;
+	nodes[nodeIndex].axis = axis;
+	return (nodeIndex);
+}
+
+// Most triangles a node at depth can hold when every node below it splits
+// by median, so that the leaves at MAX_DEPTH still fit Node::count.
+uint64_t TriangleMesh::getSubtreeCapacity(uint32_t depth)
+{
+	uint32_t nbLevels = MAX_DEPTH - 1 - depth;
+	return (nbLevels >= 32 ? UINT64_MAX : static_cast<uint64_t>(UINT16_MAX) << nbLevels);
+}
+
+TriangleMesh::RayShear TriangleMesh::computeShear(const glm::vec3 &direction)
+{
+	RayShear shear;
+	glm::vec3 absDirection = glm::abs(direction);
+	shear.kz = 0;
+	if (absDirection.y > absDirection.x)
+		shear.kz = 1;
+	if (absDirection.z > absDirection[shear.kz])
+		shear.kz = 2;
+	shear.kx = (shear.kz + 1) % 3;
+	shear.ky = (shear.kx + 1) % 3;
+	// Keeps the winding of the triangles when looking down a negative axis.
+	if (direction[shear.kz] < 0)
+		std::swap(shear.kx, shear.ky);
+	shear.sx = direction[shear.kx] / direction[shear.kz];
+	shear.sy = direction[shear.ky] / direction[shear.kz];
+	shear.sz = 1.0f / direction[shear.kz];
+	return (shear);
+}
+
+int32_t TriangleMesh::intersectLeaf(const Ray &ray, const RayShear &shear, uint32_t firstBlock, uint32_t count, float minTime, float &closest) const
+{
+	int32_t best = -1;
+	for (uint32_t i = 0; i < count; i += LEAF_WIDTH)
+	{
+		const LeafBlock &block = leafBlockData[firstBlock + i / LEAF_WIDTH];
+		uint32_t batch = std::min(LEAF_WIDTH, count - i);
+		int32_t triangle;
+		switch (simdLevel)
+		{
+		case PackedSpheres::SimdLevel::AVX2:
+			triangle = intersectBlockAVX2(ray, shear, block, batch, minTime, closest);
+			break;
+		case PackedSpheres::SimdLevel::SSE:
+			triangle = intersectBlockSSE(ray, shear, block, batch, minTime, closest);
+			break;
+		default:
+			triangle = intersectBlockScalar(ray, shear, block, batch, minTime, closest);
+			break;
+		}
+		if (triangle >= 0)
+			best = triangle;
+	}
+	return (best);
+}
+
+// Reference implementation. The SIMD kernels mirror these operations one
+// for one, so keep them in sync (and keep fp contraction off).
+int32_t TriangleMesh::intersectBlockScalar(const Ray &ray, const RayShear &shear, const LeafBlock &block, uint32_t count, float minTime, float &closest) const
+{
+	const glm::vec3 &origin = ray.getOrigin();
+	int32_t best = -1;
+	float bestT = closest;
+	for (uint32_t lane = 0; lane < count; lane++)
+	{
+		float az = block.a[shear.kz][lane] - origin[shear.kz];
+		float bz = block.b[shear.kz][lane] - origin[shear.kz];
+		float cz = block.c[shear.kz][lane] - origin[shear.kz];
+		float axs = (block.a[shear.kx][lane] - origin[shear.kx]) - shear.sx * az;
+		float ays = (block.a[shear.ky][lane] - origin[shear.ky]) - shear.sy * az;
+		float bxs = (block.b[shear.kx][lane] - origin[shear.kx]) - shear.sx * bz;
+		float bys = (block.b[shear.ky][lane] - origin[shear.ky]) - shear.sy * bz;
+		float cxs = (block.c[shear.kx][lane] - origin[shear.kx]) - shear.sx * cz;
+		float cys = (block.c[shear.ky][lane] - origin[shear.ky]) - shear.sy * cz;
+
+		float u = cxs * bys - cys * bxs;
+		float v = axs * cys - ays * cxs;
+		float w = bxs * ays - bys * axs;
+		if (u == 0 || v == 0 || w == 0)
+			recomputeEdgeFunctions(axs, ays, bxs, bys, cxs, cys, u, v, w);
+		if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+			continue;
+
+		float det = u + v + w;
+		float t = (u * (shear.sz * az) + v * (shear.sz * bz) + w * (shear.sz * cz)) / det;
+		if (det != 0 && minTime < t && t < bestT)
+		{
+			bestT = t;
+			best = static_cast<int32_t>(block.first + lane);
+		}
+	}
+	if (best >= 0)
+		closest = bestT;
+	return (best);
+}
+
+#ifdef TRIANGLE_MESH_X86
+
+int32_t TriangleMesh::intersectBlockSSE(const Ray &ray, const RayShear &shear, const LeafBlock &block, uint32_t count, float minTime, float &closest) const
+{
+	const glm::vec3 &origin = ray.getOrigin();
+	const __m128 ox = _mm_set1_ps(origin[shear.kx]);
+	const __m128 oy = _mm_set1_ps(origin[shear.ky]);
+	const __m128 oz = _mm_set1_ps(origin[shear.kz]);
+	const __m128 sx = _mm_set1_ps(shear.sx);
+	const __m128 sy = _mm_set1_ps(shear.sy);
+	const __m128 sz = _mm_set1_ps(shear.sz);
+	const __m128 vmin = _mm_set1_ps(minTime);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128i step = _mm_set1_epi32(4);
+
+	__m128 bestT = _mm_set1_ps(closest);
+	__m128i bestIndex = _mm_set1_epi32(-1);
+	__m128i index = _mm_setr_epi32(0, 1, 2, 3);
+	for (uint32_t lane = 0; lane < count; lane += 4)
+	{
+		__m128 az = _mm_sub_ps(_mm_loadu_ps(&block.a[shear.kz][lane]), oz);
+		__m128 bz = _mm_sub_ps(_mm_loadu_ps(&block.b[shear.kz][lane]), oz);
+		__m128 cz = _mm_sub_ps(_mm_loadu_ps(&block.c[shear.kz][lane]), oz);
+		__m128 axs = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(&block.a[shear.kx][lane]), ox), _mm_mul_ps(sx, az));
+		__m128 ays = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(&block.a[shear.ky][lane]), oy), _mm_mul_ps(sy, az));
+		__m128 bxs = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(&block.b[shear.kx][lane]), ox), _mm_mul_ps(sx, bz));
+		__m128 bys = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(&block.b[shear.ky][lane]), oy), _mm_mul_ps(sy, bz));
+		__m128 cxs = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(&block.c[shear.kx][lane]), ox), _mm_mul_ps(sx, cz));
+		__m128 cys = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(&block.c[shear.ky][lane]), oy), _mm_mul_ps(sy, cz));
+
+		__m128 u = _mm_sub_ps(_mm_mul_ps(cxs, bys), _mm_mul_ps(cys, bxs));
+		__m128 v = _mm_sub_ps(_mm_mul_ps(axs, cys), _mm_mul_ps(ays, cxs));
+		__m128 w = _mm_sub_ps(_mm_mul_ps(bxs, ays), _mm_mul_ps(bys, axs));
+		__m128 isOnEdge = _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(u, zero), _mm_cmpeq_ps(v, zero)), _mm_cmpeq_ps(w, zero));
+		if (_mm_movemask_ps(isOnEdge))
+		{
+			alignas(16) float laneValues[9][4];
+			_mm_store_ps(laneValues[0], axs);
+			_mm_store_ps(laneValues[1], ays);
+			_mm_store_ps(laneValues[2], bxs);
+			_mm_store_ps(laneValues[3], bys);
+			_mm_store_ps(laneValues[4], cxs);
+			_mm_store_ps(laneValues[5], cys);
+			_mm_store_ps(laneValues[6], u);
+			_mm_store_ps(laneValues[7], v);
+			_mm_store_ps(laneValues[8], w);
+			int mask = _mm_movemask_ps(isOnEdge);
+			for (int i = 0; i < 4; i++)
+			{
+				if (mask & (1 << i))
+					recomputeEdgeFunctions(laneValues[0][i], laneValues[1][i], laneValues[2][i], laneValues[3][i],
+						laneValues[4][i], laneValues[5][i], laneValues[6][i], laneValues[7][i], laneValues[8][i]);
+			}
+			u = _mm_load_ps(laneValues[6]);
+			v = _mm_load_ps(laneValues[7]);
+			w = _mm_load_ps(laneValues[8]);
+		}
+
+		__m128 hasNegative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)), _mm_cmplt_ps(w, zero));
+		__m128 hasPositive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)), _mm_cmpgt_ps(w, zero));
+		__m128 det = _mm_add_ps(_mm_add_ps(u, v), w);
+		__m128 t = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(u, _mm_mul_ps(sz, az)), _mm_mul_ps(v, _mm_mul_ps(sz, bz))),
+			_mm_mul_ps(w, _mm_mul_ps(sz, cz))), det);
+		__m128 isCloser = _mm_andnot_ps(_mm_and_ps(hasNegative, hasPositive),
+			_mm_and_ps(_mm_cmpneq_ps(det, zero), _mm_and_ps(_mm_cmplt_ps(vmin, t), _mm_cmplt_ps(t, bestT))));
+
+		bestT = _mm_or_ps(_mm_and_ps(isCloser, t), _mm_andnot_ps(isCloser, bestT));
+		__m128i isCloserInt = _mm_castps_si128(isCloser);
+		bestIndex = _mm_or_si128(_mm_and_si128(isCloserInt, index), _mm_andnot_si128(isCloserInt, bestIndex));
+		index = _mm_add_epi32(index, step);
+	}
+
+	alignas(16) float laneT[4];
+	alignas(16) int32_t laneIndex[4];
+	_mm_store_ps(laneT, bestT);
+	_mm_store_si128(reinterpret_cast<__m128i *>(laneIndex), bestIndex);
+	float t = closest;
+	int32_t best = reduceLanes(laneT, laneIndex, 4, t);
+	if (best < 0)
+		return (-1);
+	closest = t;
+	return (static_cast<int32_t>(block.first) + best);
+}
+
+TARGET_AVX2
+int32_t TriangleMesh::intersectBlockAVX2(const Ray &ray, const RayShear &shear, const LeafBlock &block, uint32_t count, float minTime, float &closest) const
+{
+	const glm::vec3 &origin = ray.getOrigin();
+	const __m256 ox = _mm256_set1_ps(origin[shear.kx]);
+	const __m256 oy = _mm256_set1_ps(origin[shear.ky]);
+	const __m256 oz = _mm256_set1_ps(origin[shear.kz]);
+	const __m256 sx = _mm256_set1_ps(shear.sx);
+	const __m256 sy = _mm256_set1_ps(shear.sy);
+	const __m256 sz = _mm256_set1_ps(shear.sz);
+	const __m256 vmin = _mm256_set1_ps(minTime);
+	const __m256 zero = _mm256_setzero_ps();
+
+	__m256 az = _mm256_sub_ps(_mm256_loadu_ps(block.a[shear.kz]), oz);
+	__m256 bz = _mm256_sub_ps(_mm256_loadu_ps(block.b[shear.kz]), oz);
+	__m256 cz = _mm256_sub_ps(_mm256_loadu_ps(block.c[shear.kz]), oz);
+	__m256 axs = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.a[shear.kx]), ox), _mm256_mul_ps(sx, az));
+	__m256 ays = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.a[shear.ky]), oy), _mm256_mul_ps(sy, az));
+	__m256 bxs = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.b[shear.kx]), ox), _mm256_mul_ps(sx, bz));
+	__m256 bys = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.b[shear.ky]), oy), _mm256_mul_ps(sy, bz));
+	__m256 cxs = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.c[shear.kx]), ox), _mm256_mul_ps(sx, cz));
+	__m256 cys = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(block.c[shear.ky]), oy), _mm256_mul_ps(sy, cz));
+
+	__m256 u = _mm256_sub_ps(_mm256_mul_ps(cxs, bys), _mm256_mul_ps(cys, bxs));
+	__m256 v = _mm256_sub_ps(_mm256_mul_ps(axs, cys), _mm256_mul_ps(ays, cxs));
+	__m256 w = _mm256_sub_ps(_mm256_mul_ps(bxs, ays), _mm256_mul_ps(bys, axs));
+	__m256 isOnEdge = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_EQ_OQ), _mm256_cmp_ps(v, zero, _CMP_EQ_OQ)),
+		_mm256_cmp_ps(w, zero, _CMP_EQ_OQ));
+	if (_mm256_movemask_ps(isOnEdge))
+	{
+		alignas(32) float laneValues[9][8];
+		_mm256_store_ps(laneValues[0], axs);
+		_mm256_store_ps(laneValues[1], ays);
+		_mm256_store_ps(laneValues[2], bxs);
+		_mm256_store_ps(laneValues[3], bys);
+		_mm256_store_ps(laneValues[4], cxs);
+		_mm256_store_ps(laneValues[5], cys);
+		_mm256_store_ps(laneValues[6], u);
+		_mm256_store_ps(laneValues[7], v);
+		_mm256_store_ps(laneValues[8], w);
+		int mask = _mm256_movemask_ps(isOnEdge);
+		for (int i = 0; i < 8; i++)
+		{
+			if (mask & (1 << i))
+				recomputeEdgeFunctions(laneValues[0][i], laneValues[1][i], laneValues[2][i], laneValues[3][i],
+					laneValues[4][i], laneValues[5][i], laneValues[6][i], laneValues[7][i], laneValues[8][i]);
+		}
+		u = _mm256_load_ps(laneValues[6]);
+		v = _mm256_load_ps(laneValues[7]);
+		w = _mm256_load_ps(laneValues[8]);
+	}
+
+	__m256 hasNegative = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ), _mm256_cmp_ps(v, zero, _CMP_LT_OQ)),
+		_mm256_cmp_ps(w, zero, _CMP_LT_OQ));
+	__m256 hasPositive = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_GT_OQ), _mm256_cmp_ps(v, zero, _CMP_GT_OQ)),
+		_mm256_cmp_ps(w, zero, _CMP_GT_OQ));
+	__m256 det = _mm256_add_ps(_mm256_add_ps(u, v), w);
+	__m256 t = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(u, _mm256_mul_ps(sz, az)), _mm256_mul_ps(v, _mm256_mul_ps(sz, bz))),
+		_mm256_mul_ps(w, _mm256_mul_ps(sz, cz))), det);
+	__m256 isCloser = _mm256_andnot_ps(_mm256_and_ps(hasNegative, hasPositive),
+		_mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_NEQ_OQ),
+			_mm256_and_ps(_mm256_cmp_ps(vmin, t, _CMP_LT_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(closest), _CMP_LT_OQ))));
+
+	// Lanes past count are padding, masked out instead of relying on the
+	// NaN vertices to miss.
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	isCloser = _mm256_and_ps(isCloser, _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int32_t>(count)), lanes)));
+
+	alignas(32) float laneT[8];
+	alignas(32) int32_t laneIndex[8];
+	_mm256_store_ps(laneT, t);
+	_mm256_store_si256(reinterpret_cast<__m256i *>(laneIndex),
+		_mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(_mm256_set1_epi32(-1)), _mm256_castsi256_ps(lanes), isCloser)));
+	float bestT = closest;
+	int32_t best = reduceLanes(laneT, laneIndex, 8, bestT);
+	if (best < 0)
+		return (-1);
+	closest = bestT;
+	return (static_cast<int32_t>(block.first) + best);
+}
+
+#else
+
+int32_t TriangleMesh::intersectBlockSSE(const Ray &ray, const RayShear &shear, const LeafBlock &block, uint32_t count, float minTime, float &closest) const
+{
+	return (intersectBlockScalar(ray, shear, block, count, minTime, closest));
+}
+
+int32_t TriangleMesh::intersectBlockAVX2(const Ray &ray, const RayShear &shear, const LeafBlock &block, uint32_t count, float minTime, float &closest) const
+{
+	return (intersectBlockScalar(ray, shear, block, count, minTime, closest));
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "AABB.h"
+#include "IHitable.h"
+#include "PackedSpheres.h"
+
+class SceneArena;
+
+// Indexed triangle mesh with its own bounding volume hierarchy. Vertices
+// are shared through a 32 bit index buffer that the build reorders so every
+// leaf owns a contiguous run of triangles. The build also copies the
+// vertices of every leaf into structure of arrays blocks, the layout of
+// PackedSpheres, and the triangles of a block are tested together with the
+// watertight algorithm of Woop, Benthin and Wald, 4 or 8 at a time with SSE
+// or AVX2; the scalar path performs the same operations in the same order.
+//
+// Both sides of a triangle can be hit, the normal follows the winding
+// order (counter-clockwise faces outward) like the outward normal of a
+// sphere. PathTracing turns it toward the ray for every material but
+// Dialectric, so meshes used with Dialectric must be closed and
+// consistently wound.
+class TriangleMesh : public IHitable
+{
+	static constexpr uint32_t NBR_BINS = 16;
+	static constexpr uint32_t MAX_TRIANGLES_PER_LEAF = 8;
+	static constexpr uint32_t LEAF_WIDTH = 8;
+	static constexpr uint32_t MAX_DEPTH = 64;
+	static constexpr float TRAVERSAL_COST = 1.0f;
+	static constexpr float INTERSECTION_COST = 0.25f;
+
+	// Same depth first layout as BVH::Node.
+	struct Node
+	{
+		AABB box;
+		uint32_t offset = 0; // first LeafBlock for a leaf, second child otherwise
+		uint16_t count = 0; // 0 for interior nodes
+		uint16_t axis = 0;
+	};
+
+	// Up to LEAF_WIDTH consecutive triangles of a leaf, one lane each, with
+	// the vertex coordinates indexed by world axis. Unused lanes hold NaN.
+	struct LeafBlock
+	{
+		float a[3][LEAF_WIDTH];
+		float b[3][LEAF_WIDTH];
+		float c[3][LEAF_WIDTH];
+		uint32_t first; // triangle of lane 0
+	};
+
+	struct BuildTriangle
+	{
+		AABB box;
+		glm::vec3 centroid;
+		uint32_t index;
+	};
+
+	// Per ray constants of the watertight test.
+	struct RayShear
+	{
+		uint32_t kx;
+		uint32_t ky;
+		uint32_t kz;
+		float sx;
+		float sy;
+		float sz;
+	};
+
+public:
+	// MaterialTable::NONE for a mesh only drawn through instances.
+	TriangleMesh(uint32_t materialId);
+
+	// Streams the positions and faces of a Wavefront OBJ file, polygons are
+	// split into fans. Normals, texture coordinates, groups and materials
+	// are ignored. Throws std::runtime_error on unreadable files.
+	void loadObj(const std::string &path);
+	// Takes three indices per triangle.
+	void setGeometry(std::vector<glm::vec3> &&newVertices, std::vector<uint32_t> &&newIndices);
+
+	uint32_t getTriangleCount() const { return (nbTriangles); }
+	uint32_t getVertexCount() const { return (nbVertices); }
+
+	// Copies the vertices, indices, nodes and leaf blocks into the arena, which must
+	// outlive the mesh, and frees the vectors. The geometry can no longer
+	// be replaced afterwards.
+	void moveTo(SceneArena &arena);
+
+	// The requested level is clamped to what the CPU supports, AVX-512 runs
+	// the AVX2 kernel.
+	void setSimdLevel(PackedSpheres::SimdLevel level);
+
+	bool hit(const Ray& ray, const float minTime, const float maxTime, HitRecord& record) const override;
+	bool boundingBox(AABB &box) const override;
+
+private:
+	uint32_t materialId;
+	PackedSpheres::SimdLevel simdLevel = PackedSpheres::SimdLevel::SCALAR;
+
+	// Point into the vectors below, or into a SceneArena after moveTo.
+	const glm::vec3 *vertexData = nullptr;
+	const uint32_t *indexData = nullptr;
+	const Node *nodeData = nullptr;
+	const LeafBlock *leafBlockData = nullptr;
+	uint32_t nbVertices = 0;
+	uint32_t nbTriangles = 0;
+	uint32_t nbNodes = 0;
+
+	std::vector<glm::vec3> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<Node> nodes;
+	std::vector<LeafBlock> leafBlocks;
+
+	void build();
+	uint32_t buildNode(std::vector<BuildTriangle> &buildTriangles, uint32_t begin, uint32_t end, uint32_t depth);
+	static uint64_t getSubtreeCapacity(uint32_t depth);
+	void buildLeafBlocks();
+
+	static RayShear computeShear(const glm::vec3 &direction);
+	// Returns the index of the closest of the count triangles starting at
+	// leaf block firstBlock hit in ]minTime, closest[ and lowers closest, or
+	// -1.
+	int32_t intersectLeaf(const Ray &ray, const RayShear &shear, uint32_t firstBlock, uint32_t count, float minTime, float &closest) const;
+	// Same for the first count lanes of a single block.
+	int32_t intersectBlockScalar(const Ray &ray, const RayShear &shear, const LeafBlock &block, uint32_t count, float minTime, float &closest) const;
+	int32_t intersectBlockSSE(const Ray &ray, const RayShear &shear, const LeafBlock &block, uint32_t count, float minTime, float &closest) const;
+	int32_t intersectBlockAVX2(const Ray &ray, const RayShear &shear, const LeafBlock &block, uint32_t count, float minTime, float &closest) const;
+};
\ No newline at end of file
@@ -13,7 +13,11 @@ public:
 	~WindowApplication();
 
 	bool startFrame();
+	// The staging buffer of the acquired swapchain image. Each image has its
+	// own buffer and it keeps what was written into it at previous frames.
 	void *getCurrentBuffer();
+	uint32_t getCurrentBufferIndex() const { return (currentImage); }
+	uint32_t getBufferCount() const { return (swapchainSize); }
 	void render();
 	bool isWindowOpen();
 
@@ -1,16 +1,22 @@
-#include <cstdint>
+#include "ctmRand.h"
 
-#include <random>
+#include "Pcg32.h"
+
+namespace
+{
+	Pcg32 &getEngine()
+	{
+		thread_local Pcg32 rng;
+		return (rng);
+	}
+}
 
 float ctmRand()
 {
-	static uint32_t x = 123456789;
-	static uint32_t y = 362436069;
-	static uint32_t z = 521288629;
-	static uint32_t w = 88675123;
-	uint32_t t;
-	t = x ^ (x << 11);
-	x = y; y = z; z = w;
-	w = w ^ (w >> 19) ^ (t ^ (t >> 8));
-	return (static_cast<float>(w % 1000) / 1000);
+	return (getEngine().nextFloat());
+}
+
+void ctmSeed(uint64_t seed)
+{
+	getEngine().seed(seed, 0);
 }
\ No newline at end of file
@@ -1,3 +1,11 @@
 #pragma once
 
-float ctmRand();
\ No newline at end of file
+#include <stdint.h>
+
+// Uniform float in [0, 1) drawn from a per-thread engine. Meant for scene
+// setup; the render path reads its numbers from a Sampler instead.
+float ctmRand();
+
+// Reseeds the engine of the calling thread, so that a scene built right
+// after is the same on every run and every thread.
+void ctmSeed(uint64_t seed);
\ No newline at end of file
@@ -1,122 +1,137 @@
 #include <glm/glm.hpp>
 
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+#include "BVH.h"
 #include "Camera.h"
-#include "ctmRand.h"
-#include "HitableCollection.h"
+#include "Denoiser.h"
 #include "LogMessage.h"
-#include "Material.h"
 #include "PathTracing.h"
-#include "Sphere.h"
+#include "RenderStats.h"
+#include "Scenes.h"
+#include "ThreadPool.h"
+#include "Tonemapper.h"
 #include "WindowApplication.h"
 
 constexpr int WIDTH = 1080;
 constexpr int HEIGHT = 720;
 constexpr uint32_t NBR_SAMPLE = 8;
-
-struct Color
-{
-	unsigned char b;
-	unsigned char g;
-	unsigned char r;
-	unsigned char a;
-};
-
-namespace
-{
-	IHitable **random_scene()
-	{
-		int i = 0;
-		IMaterial *material = nullptr;
-		IHitable **list = new IHitable*[490];
-		memset(list, 0, 450 * sizeof(IHitable));
-
-		material = new Lambert(glm::vec3(0.5, 0.5, 0.5));
-		list[i] = new Sphere(glm::vec3(0, -1000, 0), 1000, material);
-		i++;
-
-		for (int a = -11; a < 11; a++)
-		{
-			for (int b = -11; b < 11; b++)
-			{
-				float choose_mat = ctmRand();
-				glm::vec3 center(a + 0.9 * ctmRand(), 0.2, b + 0.9 * ctmRand());
-				if ((center - glm::vec3(4, 0.2, 0)).length() > 0.9)
-				{
-					if (choose_mat < 0.8)
-					{
-						material = new Lambert(glm::vec3(ctmRand() * ctmRand(),
-							ctmRand() * ctmRand(),
-							ctmRand() * ctmRand()));
-					}
-					else if (choose_mat < 0.95)
-					{
-						material = new Metal(glm::vec3(0.5f * (1.0f + ctmRand()),
-							0.5f * (1.0f + ctmRand()),
-							0.5f * (1.0f + ctmRand())), 0.5f * ctmRand());
-					}
-					else
-					{
-						material = new Dialectric(1.5);
-					}
-					list[i] = new Sphere(center, 0.2f, material);
-					i++;
-				}
-			}
-		}
-		material = new Dialectric(1.3f);
-		list[i] = new Sphere(glm::vec3(0, 1, 0), 1, material);
-		i++;
-
-		material = new Lambert(glm::vec3(0.4, 0.2, 0.1));
-		list[i] = new Sphere(glm::vec3(-4, 1, 0), 1, material);
-		i++;
-
-		material = new Metal(glm::vec3(0.7, 0.6, 0.5), 0);
-		list[i] = new Sphere(glm::vec3(4, 1, 0), 1, material);
-		i++;
-
-		list[i] = nullptr;
-		LOG_MSG("%d", i);
-		return list;
-	}
-}
+constexpr uint32_t NBR_THREAD = 0; // 0 uses every hardware thread
+constexpr bool PIN_THREADS = false;
+constexpr uint32_t TILE_SIZE = 16;
+constexpr TileScheduler::Order TILE_ORDER = TileScheduler::Order::HILBERT;
+constexpr const char *SCENE = "random";
+constexpr PathTracing::IntegratorMode INTEGRATOR_MODE = PathTracing::IntegratorMode::PER_PATH;
+constexpr Sampler::Type SAMPLER_TYPE = Sampler::Type::SOBOL;
+constexpr bool RUSSIAN_ROULETTE = true;
+// The render pool is held by the rendering job, the display conversion gets
+// its own small pool.
+constexpr uint32_t NBR_DISPLAY_THREAD = 2;
+constexpr Tonemapper::Operator TONEMAP_OPERATOR = Tonemapper::Operator::CLAMP;
+constexpr float EXPOSURE = 1;
+constexpr bool SRGB_OUTPUT = true; // the swapchain is UNORM in the sRGB color space
+constexpr bool DITHERING = true;
+// The denoised picture replaces the noisy one on screen, refreshed at this
+// interval while rendering and once more at the end.
+constexpr bool DENOISE = false;
+constexpr uint32_t DENOISE_INTERVAL_MS = 500;
+// Rays per second printed at this interval while rendering, and the render
+// statistics once at the end.
+constexpr bool SHOW_STATS = true;
+constexpr uint32_t STATS_INTERVAL_MS = 1000;
 
 int main()
 {
 	try
 	{
-		HitableCollection collection;
-		collection.takeOwnershipOf(random_scene());
-
-		glm::vec3 lookFrom(13, 2, 3);
-		glm::vec3 lookAt(0, 0, 0);
-		float dist_to_focus = 10;
-		float aperture = 0.1f;
-		Camera cam(lookFrom, lookAt, glm::vec3(0, 1, 0), 20, static_cast<float>(WIDTH) / HEIGHT, aperture, dist_to_focus);
-
-		PathTracing pathTracing(WIDTH, HEIGHT, NBR_SAMPLE, collection, cam);
+		SceneDescription scene;
+		if (!Scenes::create(SCENE, scene))
+			throw std::runtime_error("Unknown scene.");
+
+		BVH world;
+		world.build(scene.hitables, scene.arena);
+		Camera cam(scene.lookFrom, scene.lookAt, scene.up, scene.vfov, static_cast<float>(WIDTH) / HEIGHT, scene.aperture, scene.focusDist);
+
+		ThreadPool pool(NBR_THREAD, PIN_THREADS);
+		PathTracing pathTracing(WIDTH, HEIGHT, NBR_SAMPLE, world, scene.materials, scene.lights, cam, pool);
+		pathTracing.setSky(scene.skyHorizon, scene.skyZenith);
+		pathTracing.setTileScheduling(TILE_ORDER, TILE_SIZE);
+		pathTracing.setIntegratorMode(INTEGRATOR_MODE);
+		pathTracing.setSampler(SAMPLER_TYPE);
+		pathTracing.setRussianRoulette(RUSSIAN_ROULETTE);
+		pathTracing.setGuideBuffers(DENOISE);
 		WindowApplication winApp(WIDTH, HEIGHT);
 
+		ThreadPool displayPool(NBR_DISPLAY_THREAD);
+		Tonemapper tonemapper(displayPool);
+		Tonemapper::Settings settings;
+		settings.tonemap = TONEMAP_OPERATOR;
+		settings.exposure = EXPOSURE;
+		settings.isSrgb = SRGB_OUTPUT;
+		settings.isDithering = DITHERING;
+		tonemapper.setSettings(settings);
+		Denoiser denoiser(displayPool);
+		auto nextDenoise = std::chrono::steady_clock::now();
+		bool isDenoiseFinal = false;
+		std::vector<PathTracing::ReadState> bufferStates(winApp.getBufferCount());
+		std::vector<TileScheduler::Tile> dirtyTiles;
+
 		pathTracing.startRendering();
+		auto startTime = std::chrono::steady_clock::now();
+		auto statsTime = startTime;
+		uint64_t statsRays = 0;
+		bool areStatsFinal = false;
 		while (winApp.isWindowOpen())
 		{
 			pathTracing.retreiveThreadResult();
+			if (SHOW_STATS && !areStatsFinal)
+			{
+				auto now = std::chrono::steady_clock::now();
+				if (!pathTracing.isRendering())
+				{
+					double seconds = std::chrono::duration<double>(now - startTime).count();
+					printf("\nRendered in %.3f s\n", seconds);
+					pathTracing.getStats().print(stdout, seconds);
+					areStatsFinal = true;
+				}
+				else if (now - statsTime >= std::chrono::milliseconds(STATS_INTERVAL_MS))
+				{
+					uint64_t nbRays = pathTracing.getStats().getRayCount();
+					printf("\r%.3f M rays/s ", (nbRays - statsRays) / std::chrono::duration<double>(now - statsTime).count() / 1e6);
+					fflush(stdout);
+					statsTime = now;
+					statsRays = nbRays;
+				}
+			}
 			if (winApp.startFrame())
 			{
-				Color *pixels = reinterpret_cast<Color *>(winApp.getCurrentBuffer());
-
-				const glm::vec3 *pic = pathTracing.getPic();
-
-				for (uint32_t i = 0; i < WIDTH * HEIGHT; i++)
+				// The whole staging buffer is still copied to the swapchain image,
+				// whose content is not kept between presents, but only the tiles
+				// converted since this buffer was last filled are written.
+				if (!DENOISE)
+					tonemapper.update(pathTracing);
+				else if (!isDenoiseFinal && std::chrono::steady_clock::now() >= nextDenoise)
 				{
-					uint32_t x = i % WIDTH;
-					uint32_t vy = i / WIDTH; // Vulkan image buffer index
-					uint32_t py = HEIGHT - i / WIDTH - 1; // Pathtracing image buffer index
-
-					pixels[x + vy * WIDTH].a = 255;
-					pixels[x + vy * WIDTH].r = static_cast<unsigned char>(pic[x + py * WIDTH][0] * 255.99);
-					pixels[x + vy * WIDTH].g = static_cast<unsigned char>(pic[x + py * WIDTH][1] * 255.99);
-					pixels[x + vy * WIDTH].b = static_cast<unsigned char>(pic[x + py * WIDTH][2] * 255.99);
+					// Samples may still come in during the denoise, only one that
+					// started after the end is the last.
+					bool wasRendering = pathTracing.isRendering();
+					tonemapper.update(pathTracing, denoiser.denoise(pathTracing));
+					isDenoiseFinal = !wasRendering;
+					nextDenoise = std::chrono::steady_clock::now() + std::chrono::milliseconds(DENOISE_INTERVAL_MS);
+				}
+				uint32_t *pixels = reinterpret_cast<uint32_t *>(winApp.getCurrentBuffer());
+				const uint32_t *output = tonemapper.getOutput();
+				dirtyTiles.clear();
+				tonemapper.getDirtyTiles(bufferStates[winApp.getCurrentBufferIndex()], dirtyTiles);
+				for (const TileScheduler::Tile &tile : dirtyTiles)
+				{
+					for (uint32_t y = tile.y; y < tile.y + tile.height; y++)
+						memcpy(pixels + tile.x + y * WIDTH, output + tile.x + y * WIDTH, tile.width * sizeof(uint32_t));
 				}
 				winApp.render();
 			}